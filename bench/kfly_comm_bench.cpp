@@ -0,0 +1,1048 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+/*
+ * Benchmark suite for kfly_comm.
+ *
+ * Usage: kfly_comm_bench [--filter=<substring>] [--json=<file>]
+ *                        [--min-time=<seconds>]
+ *
+ * Every benchmark reports time per operation, throughput and heap
+ * allocations per operation. With --json the results are also written in a
+ * machine readable format for regression tracking.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "kfly_comm/kfly_comm.hpp"
+#include "kfly_comm/telemetry_table.hpp"
+#include "kfly_comm/trace.hpp"
+
+#if defined(KFLY_COMM_SERIAL_LINK) || defined(KFLY_COMM_LOG_REPLAY)
+#include <thread>
+#endif
+
+#ifdef KFLY_COMM_LOG_REPLAY
+#include "kfly_comm/flight_recorder.hpp"
+#include "kfly_comm/log_replay.hpp"
+#endif
+
+#ifdef KFLY_COMM_SERIAL_LINK
+#include <sys/socket.h>
+#include <unistd.h>
+#include "kfly_comm/link_manager.hpp"
+#include "kfly_comm/tx_scheduler.hpp"
+#endif
+
+using namespace kfly_comm;
+
+/*********************************
+ * Allocation counting
+ ********************************/
+
+static std::atomic< uint64_t > allocation_count(0);
+
+static void *counted_malloc(std::size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size)
+{
+  return counted_malloc(size);
+}
+
+void *operator new[](std::size_t size)
+{
+  return counted_malloc(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+/*********************************
+ * Harness
+ ********************************/
+
+namespace
+{
+/** @brief Result of one benchmark. */
+struct bench_result
+{
+  std::string name;
+  uint64_t iterations;
+  double ns_per_op;
+  double ops_per_second;
+  double bytes_per_second;
+  double allocations_per_op;
+};
+
+/** @brief Settings from the command line. */
+struct bench_settings
+{
+  std::string filter;
+  std::string json;
+  double min_time = 0.2;
+};
+
+bench_settings settings;
+std::vector< bench_result > results;
+
+/** @brief Sink keeping the compiler from removing benchmarked work. */
+volatile uint64_t sink;
+
+/**
+ * @brief   Runs a benchmark, the iteration count is doubled until the run
+ *          takes at least the minimum time.
+ *
+ * @param[in] name            Name of the benchmark.
+ * @param[in] bytes_per_op    Bytes processed per operation, 0 if none.
+ * @param[in] fun             The operation, runs n iterations.
+ */
+void run(const std::string &name, std::size_t bytes_per_op,
+         const std::function< void(uint64_t) > &fun)
+{
+  if (name.find(settings.filter) == std::string::npos)
+    return;
+
+  using clock = std::chrono::steady_clock;
+
+  /* Warm up. */
+  fun(1);
+
+  uint64_t iterations = 1;
+  double elapsed      = 0;
+  uint64_t allocs     = 0;
+
+  while (true)
+  {
+    const uint64_t allocs_start = allocation_count.load();
+    const auto start            = clock::now();
+
+    fun(iterations);
+
+    elapsed = std::chrono::duration< double >(clock::now() - start).count();
+    allocs  = allocation_count.load() - allocs_start;
+
+    if (elapsed >= settings.min_time || iterations >= (1ull << 40))
+      break;
+
+    iterations *= 2;
+  }
+
+  bench_result r;
+  r.name               = name;
+  r.iterations         = iterations;
+  r.ns_per_op          = elapsed * 1e9 / iterations;
+  r.ops_per_second     = iterations / elapsed;
+  r.bytes_per_second   = bytes_per_op * r.ops_per_second;
+  r.allocations_per_op = double(allocs) / iterations;
+
+  std::cout << std::left << std::setw(52) << r.name << std::right
+            << std::fixed << std::setprecision(1) << std::setw(12)
+            << r.ns_per_op << " ns" << std::setw(14) << std::setprecision(0)
+            << r.ops_per_second << " op/s";
+
+  if (bytes_per_op > 0)
+    std::cout << std::setw(10) << std::setprecision(3)
+              << r.bytes_per_second / 1e9 << " GB/s";
+  else
+    std::cout << std::setw(15) << "";
+
+  std::cout << std::setw(10) << std::setprecision(2) << r.allocations_per_op
+            << " alloc/op\n";
+
+  results.push_back(r);
+}
+
+/**
+ * @brief   Writes the results as JSON.
+ */
+void write_json(const std::string &file)
+{
+  std::ofstream out(file);
+
+  out << "{\n  \"benchmarks\": [\n";
+
+  for (std::size_t i = 0; i < results.size(); i++)
+  {
+    const auto &r = results[i];
+
+    out << "    {\"name\": \"" << r.name << "\", \"iterations\": "
+        << r.iterations << std::setprecision(6) << std::fixed
+        << ", \"ns_per_op\": " << r.ns_per_op
+        << ", \"ops_per_second\": " << r.ops_per_second
+        << ", \"bytes_per_second\": " << r.bytes_per_second
+        << ", \"allocations_per_op\": " << r.allocations_per_op << "}"
+        << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+
+  out << "  ]\n}\n";
+}
+
+/**
+ * @brief   Fills a datagram with random bytes.
+ */
+template < typename Datagram >
+Datagram random_datagram(std::mt19937 &rng)
+{
+  Datagram d;
+  uint8_t *bytes = reinterpret_cast< uint8_t * >(&d);
+
+  for (std::size_t i = 0; i < sizeof(Datagram); i++)
+    bytes[i] = static_cast< uint8_t >(rng());
+
+  return d;
+}
+
+/**
+ * @brief   Encodes a datagram as if sent from KFly with a receive command.
+ */
+template < typename Datagram >
+void append_frame(std::vector< uint8_t > &stream, commands cmd,
+                  std::mt19937 &rng)
+{
+  uint8_t frame[max_encoded_size< Datagram >::value];
+
+  const std::size_t n =
+      encode_packet(cmd, random_datagram< Datagram >(rng), false, frame,
+                    sizeof(frame));
+
+  stream.insert(stream.end(), frame, frame + n);
+}
+
+/*********************************
+ * Encoding
+ ********************************/
+
+template < typename Datagram >
+void bench_generate(const char *name)
+{
+  std::mt19937 rng(1);
+  const Datagram d = random_datagram< Datagram >(rng);
+
+  run(std::string("generate_packet/") + name, 0, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      sink = codec::generate_packet(d).size();
+  });
+
+  run(std::string("generate_packet_into/") + name, 0, [&](uint64_t n) {
+    uint8_t out[max_encoded_size< Datagram >::value];
+
+    for (uint64_t i = 0; i < n; i++)
+      sink = codec::generate_packet_into(d, out, sizeof(out));
+  });
+}
+
+void bench_encoding()
+{
+#define BENCH_GENERATE(type) bench_generate< datagrams::type >(#type)
+  BENCH_GENERATE(ManageSubscription);
+  BENCH_GENERATE(SystemStrings);
+  BENCH_GENERATE(SystemStatus);
+  BENCH_GENERATE(SetDeviceStrings);
+  BENCH_GENERATE(MotorOverride);
+  BENCH_GENERATE(ControllerLimits);
+  BENCH_GENERATE(ArmSettings);
+  BENCH_GENERATE(RateControllerData);
+  BENCH_GENERATE(AttitudeControllerData);
+  BENCH_GENERATE(ChannelMix);
+  BENCH_GENERATE(RCInputSettings);
+  BENCH_GENERATE(RCOutputSettings);
+  BENCH_GENERATE(IMUCalibration);
+  BENCH_GENERATE(ControlFilterSettings);
+  BENCH_GENERATE(ComputerControlReference);
+  BENCH_GENERATE(MotionCaptureFrame);
+#undef BENCH_GENERATE
+
+  run("generate_command/Ping", 0, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      sink = codec::generate_command(commands::Ping).size();
+  });
+
+  run("generate_command_into/Ping", 0, [&](uint64_t n) {
+    uint8_t buffer[max_encoded_size< datagrams::Ack, false >::value];
+
+    for (uint64_t i = 0; i < n; i++)
+      sink = codec::generate_command_into(commands::Ping, buffer,
+                                          sizeof(buffer));
+  });
+}
+
+/*********************************
+ * Decoding
+ ********************************/
+
+void telemetry_callback(const datagrams::IMUData &)
+{
+  sink = sink + 1;
+}
+
+void bench_decoding()
+{
+  /* A mixed telemetry stream, as a subscribed vehicle sends it. */
+  std::mt19937 rng(2);
+  std::vector< uint8_t > stream;
+  std::size_t frames = 0;
+
+  while (stream.size() < (64 << 10))
+  {
+    append_frame< datagrams::IMUData >(stream, commands::GetIMUData, rng);
+    append_frame< datagrams::RawIMUData >(stream, commands::GetRawIMUData,
+                                          rng);
+    append_frame< datagrams::EstimationAttitude >(
+        stream, commands::GetEstimationAttitude, rng);
+    append_frame< datagrams::ControlSignals >(
+        stream, commands::GetControlSignals, rng);
+    append_frame< datagrams::RCValues >(stream, commands::GetRCValues, rng);
+    append_frame< datagrams::SystemStatus >(stream,
+                                            commands::GetSystemStatus, rng);
+    frames += 6;
+  }
+
+  codec c;
+  c.register_callback(telemetry_callback);
+
+  run("parse/mixed_stream/4KiB_reads", stream.size(), [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+    {
+      for (std::size_t off = 0; off < stream.size(); off += 4096)
+      {
+        const std::size_t len =
+            std::min< std::size_t >(4096, stream.size() - off);
+        sink = c.parse(stream.data() + off, len).packets;
+      }
+    }
+  });
+
+  run("parse/mixed_stream/single_bytes", stream.size(), [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      for (auto b : stream)
+        c.parse(b);
+  });
+
+  std::cout << "  (mixed stream: " << frames << " packets, " << stream.size()
+            << " bytes per operation)\n";
+}
+
+/*********************************
+ * CRC
+ ********************************/
+
+void bench_crc()
+{
+  std::mt19937 rng(3);
+
+  for (std::size_t size : {64u, 256u, 1u << 20})
+  {
+    std::vector< uint8_t > data(size);
+    for (auto &b : data)
+      b = static_cast< uint8_t >(rng());
+
+    const std::string suffix = "/" + std::to_string(size) + "B";
+
+    run("crc16/bytewise" + suffix, size, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++)
+        sink = CRC16_CCITT::generateCRC_bytewise(data.data(), data.size());
+    });
+
+    run("crc16/slice8" + suffix, size, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++)
+        sink = CRC16_CCITT::generateCRC_slice8(data.data(), data.size());
+    });
+
+    run("crc16/runtime_selected" + suffix, size, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++)
+        sink = CRC16_CCITT::generateCRC(data.data(), data.size());
+    });
+  }
+
+  std::cout << "  (runtime selected engine: "
+            << (CRC16_CCITT::has_clmul_engine() ? "pclmulqdq" : "slice8")
+            << ")\n";
+}
+
+/*********************************
+ * SLIP
+ ********************************/
+
+void bench_slip()
+{
+  /* Realistic telemetry: a stream of plausible IMU samples, and the worst
+   * case where every byte needs escaping. */
+  std::vector< uint8_t > telemetry;
+
+  for (int i = 0; telemetry.size() < (64 << 10); i++)
+  {
+    datagrams::IMUData d;
+    d.accelerometer[0] = 0.01f * std::sin(0.01f * i);
+    d.accelerometer[1] = -0.02f * std::cos(0.01f * i);
+    d.accelerometer[2] = 1.0f + 0.001f * (i % 17);
+    d.gyroscope[0]     = 0.1f * std::sin(0.02f * i);
+    d.gyroscope[1]     = 0.1f * std::cos(0.03f * i);
+    d.gyroscope[2]     = 0.001f * (i % 31);
+    d.magnetometer[0]  = 0.3f;
+    d.magnetometer[1]  = -0.1f + 0.0001f * i;
+    d.magnetometer[2]  = 0.9f;
+    d.temperature      = 35.0f + 0.01f * (i % 100);
+    d.pressure         = 101325.0f + i % 50;
+    d.time_stamp_ns    = 1000000LL * i;
+
+    const uint8_t *bytes = reinterpret_cast< const uint8_t * >(&d);
+    telemetry.insert(telemetry.end(), bytes, bytes + sizeof(d));
+  }
+
+  const std::vector< uint8_t > all_escape(64 << 10, slip::END);
+
+  const std::pair< slip::engine, const char * > engines[] = {
+      {slip::engine::scalar, "scalar"},
+      {slip::engine::sse2, "sse2"},
+      {slip::engine::avx2, "avx2"}};
+
+  const slip::engine selected = slip::active_engine();
+
+  for (const auto &e : engines)
+  {
+    if (!slip::select_engine(e.first))
+      continue;
+
+    const std::pair< const std::vector< uint8_t > *, const char * > inputs[] =
+        {{&telemetry, "telemetry"}, {&all_escape, "all_escape"}};
+
+    for (const auto &input : inputs)
+    {
+      const std::vector< uint8_t > &in = *input.first;
+      const std::string suffix =
+          std::string("/") + input.second + "/" + e.second;
+
+      std::vector< uint8_t > encoded(slip::max_encoded_size(in.size()));
+      encoded.resize(slip::encode_frame(in.data(), in.size(), encoded.data()));
+
+      std::vector< uint8_t > out(encoded.size());
+
+      run("slip/encode" + suffix, in.size(), [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+          sink = slip::encode(in.data(), in.size(), out.data());
+      });
+
+      /* The decoder holds one frame, large enough for the whole input. */
+      std::unique_ptr< slip::decoder< 64 << 10 > > decoder(
+          new slip::decoder< 64 << 10 >());
+
+      run("slip/decode" + suffix, encoded.size(), [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+          decoder->parse(encoded.data(), encoded.size(),
+                         [](const uint8_t *, std::size_t size, std::size_t) {
+                           sink = size;
+                         },
+                         [](std::size_t) {});
+      });
+    }
+  }
+
+  slip::select_engine(selected);
+}
+
+/*********************************
+ * Dispatch
+ ********************************/
+
+struct subscriber
+{
+  void on_imu(const datagrams::IMUData &)
+  {
+    sink = sink + 1;
+  }
+};
+
+void bench_dispatch()
+{
+  std::vector< subscriber > subscribers(8);
+
+  for (std::size_t count : {0u, 1u, 8u})
+  {
+    kfly_datagram_director director;
+
+    for (std::size_t i = 0; i < count; i++)
+      director.register_callback(&subscribers[i], &subscriber::on_imu);
+
+    const datagrams::IMUData d{};
+
+    run("execute_callback/IMUData/" + std::to_string(count) + "_subscribers",
+        0, [&](uint64_t n) {
+          for (uint64_t i = 0; i < n; i++)
+            director.execute_callback(d);
+        });
+  }
+}
+
+void bench_latest()
+{
+  codec c;
+  std::mt19937 rng(4);
+  std::vector< uint8_t > stream;
+
+  append_frame< datagrams::IMUData >(stream, commands::GetIMUData, rng);
+  c.parse(stream);
+
+  run("latest/IMUData", 0, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      sink = c.latest< datagrams::IMUData >().sequence;
+  });
+}
+
+void bench_telemetry()
+{
+  telemetry_table< datagrams::IMUData > table;
+  const datagrams::IMUData d{};
+
+  run("telemetry_table/append/IMUData", sizeof(d), [&](uint64_t n) {
+    table.clear();
+    table.reserve(n);
+
+    for (uint64_t i = 0; i < n; i++)
+      table.append(d);
+  });
+
+  table.clear();
+  for (int i = 0; i < 1 << 16; i++)
+    table.append(d);
+
+  const std::size_t column = table.column_index("gyroscope[0]");
+
+  run("telemetry_table/sum_column/65536_rows", (1 << 16) * sizeof(float),
+      [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+        {
+          float sum = 0;
+
+          for (std::size_t j = 0; j < table.chunk_count(); j++)
+            for (float v : table.column< float >(column, j))
+              sum += v;
+
+          sink = sink + static_cast< uint64_t >(sum);
+        }
+      });
+}
+
+/*********************************
+ * Tracing
+ ********************************/
+
+/**
+ * @brief   Checks frames with the stages traced as in the codec.
+ */
+template < typename Tracer >
+void check_traced(const std::vector< std::vector< uint8_t > > &frames)
+{
+  for (const auto &f : frames)
+  {
+    typename Tracer::scope frame_scope(trace::stage::frame, f[0]);
+
+    {
+      typename Tracer::scope check_scope(trace::stage::check_frame);
+      sink = sink + static_cast< uint64_t >(check_frame(f.data(), f.size()));
+    }
+  }
+}
+
+#ifdef KFLY_COMM_BENCH_TRACED
+/**
+ * @brief   Runs trace/parse in the benchmark built against the traced
+ *          library, as tracing cannot be enabled in this build without
+ *          mixing definitions of the codec. Its result line is reported
+ *          as if run here.
+ */
+void run_traced_parse()
+{
+  if (std::string("trace/parse/tracing_on").find(settings.filter) ==
+      std::string::npos)
+    return;
+
+  std::ostringstream command;
+  command << KFLY_COMM_BENCH_TRACED << " --filter=trace/parse/tracing_on"
+          << " --min-time=" << settings.min_time;
+
+  std::cout.flush();
+
+  FILE *child = popen(command.str().c_str(), "r");
+
+  if (child == nullptr)
+  {
+    std::cout << "  (unable to run " << KFLY_COMM_BENCH_TRACED << ")\n";
+    return;
+  }
+
+  char line[256];
+
+  while (std::fgets(line, sizeof(line), child) != nullptr)
+  {
+    /* name, ns, op/s, GB/s and alloc/op with their units. */
+    std::istringstream in(line);
+    bench_result r;
+    std::string unit;
+    double gb_per_second;
+
+    if (!(in >> r.name >> r.ns_per_op >> unit >> r.ops_per_second >> unit >>
+          gb_per_second >> unit >> r.allocations_per_op) ||
+        r.name.compare(0, 12, "trace/parse/") != 0)
+      continue;
+
+    std::cout << line;
+
+    r.iterations       = 0;
+    r.bytes_per_second = gb_per_second * 1e9;
+    results.push_back(r);
+  }
+
+  pclose(child);
+}
+#endif
+
+void bench_tracing()
+{
+  std::mt19937 rng(5);
+  std::vector< uint8_t > stream;
+
+  for (int i = 0; i < 256; i++)
+    append_frame< datagrams::IMUData >(stream, commands::GetIMUData, rng);
+
+  std::vector< std::vector< uint8_t > > frames;
+  slip::decoder< max_frame_size > decoder;
+
+  decoder.parse(stream.data(), stream.size(),
+                [&](const uint8_t *frame, std::size_t size, std::size_t) {
+                  frames.emplace_back(frame, frame + size);
+                },
+                [](std::size_t) {});
+
+  run("trace/check_frame/untraced", 0, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      for (const auto &f : frames)
+        sink = sink + static_cast< uint64_t >(check_frame(f.data(), f.size()));
+  });
+
+  run("trace/check_frame/null_tracer", 0, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      check_traced< trace::null_tracer >(frames);
+  });
+
+  run("trace/check_frame/ring_tracer", 0, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      check_traced< trace::ring_tracer >(frames);
+  });
+
+  trace::clear_thread();
+
+  std::cout << "  (" << frames.size() << " frames per operation, two "
+            << "stages each)\n";
+
+  /* The whole receive path, as traced in this build. */
+  codec c;
+  c.register_callback(telemetry_callback);
+
+#ifdef KFLY_COMM_TRACING
+  const char *parse_name = "trace/parse/tracing_on";
+#else
+  const char *parse_name = "trace/parse/tracing_off";
+#endif
+
+  run(parse_name, stream.size(), [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      sink = c.parse(stream).packets;
+  });
+
+  trace::clear_thread();
+
+#ifdef KFLY_COMM_BENCH_TRACED
+  run_traced_parse();
+#endif
+}
+
+#ifdef KFLY_COMM_LOG_REPLAY
+/*********************************
+ * Log replay
+ ********************************/
+
+/**
+ * @brief   Receives the replayed datagrams, concurrently from the workers.
+ */
+void replay_callback(const datagrams::IMUData &)
+{
+}
+
+void bench_log_replay()
+{
+  const char *file = "kfly_comm_bench.kflyrec";
+
+  /* A recording of about 16 MiB of IMU telemetry. */
+  std::mt19937 rng(7);
+  std::vector< uint8_t > stream;
+
+  for (int i = 0; i < 256; i++)
+    append_frame< datagrams::IMUData >(stream, commands::GetIMUData, rng);
+
+  std::vector< std::vector< uint8_t > > frames;
+  slip::decoder< max_frame_size > decoder;
+
+  decoder.parse(stream.data(), stream.size(),
+                [&](const uint8_t *frame, std::size_t size, std::size_t) {
+                  frames.emplace_back(frame, frame + size);
+                },
+                [](std::size_t) {});
+
+  {
+    flight_recorder_options options;
+    options.buffer_count = 64;
+
+    flight_recorder recorder(file, options);
+    std::size_t bytes = 0;
+
+    while (bytes < (16 << 20))
+    {
+      for (const auto &f : frames)
+      {
+        recorder.record(recording::direction::rx, 0, f.data(), f.size());
+        bytes += sizeof(recording::record_header) + f.size();
+      }
+
+      recorder.flush();
+    }
+  }
+
+  uint64_t datagrams = 0;
+
+  const std::size_t cores =
+      std::max< std::size_t >(1, std::thread::hardware_concurrency());
+
+  for (std::size_t threads = 1; threads <= cores; threads++)
+  {
+    log_replay_options options;
+    options.threads = threads;
+    options.order   = replay_order::unordered;
+
+    log_replay replay(file, options);
+    replay.callbacks().register_callback(replay_callback);
+
+    run("log_replay/recording/" + std::to_string(threads) + "_threads",
+        replay.run().bytes, [&](uint64_t n) {
+          for (uint64_t i = 0; i < n; i++)
+            datagrams = replay.run().datagrams;
+        });
+  }
+
+  std::remove(file);
+
+  std::cout << "  (" << datagrams << " datagrams per operation, " << cores
+            << " cores)\n";
+}
+#endif
+
+#ifdef KFLY_COMM_SERIAL_LINK
+/*********************************
+ * Link manager
+ ********************************/
+
+/** @brief Packet counter of one vehicle, on its own cache line. */
+struct vehicle_counter
+{
+  std::atomic< uint64_t > packets;
+  char padding[64 - sizeof(std::atomic< uint64_t >)];
+};
+
+void bench_link_manager()
+{
+  constexpr std::size_t vehicles = 40;
+
+  /* Whole frames, about 16 KiB per vehicle and operation. */
+  std::mt19937 rng(6);
+  std::vector< uint8_t > stream;
+  std::size_t frames = 0;
+
+  while (stream.size() < (16 << 10))
+  {
+    append_frame< datagrams::IMUData >(stream, commands::GetIMUData, rng);
+    frames++;
+  }
+
+  const std::size_t cores =
+      std::max< std::size_t >(1, std::thread::hardware_concurrency());
+
+  /* One feeder per core, so the feeding does not limit the workers. */
+  const std::size_t feeders = std::min(cores, vehicles);
+
+  for (std::size_t workers = 1; workers <= cores; workers++)
+  {
+    link_manager_options options;
+    options.workers = workers;
+
+    link_manager manager(options);
+    std::vector< vehicle_counter > counters(vehicles + 1);
+    std::vector< int > feeds;
+
+    for (auto &c : counters)
+      c.packets = 0;
+
+    manager.register_callback< datagrams::IMUData >(
+        [&](link_id id, const datagrams::IMUData &) {
+          counters[id].packets.fetch_add(1, std::memory_order_relaxed);
+        });
+
+    for (std::size_t i = 0; i < vehicles; i++)
+    {
+      int fds[2];
+
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        return;
+
+      manager.add_link(fds[0]);
+      feeds.push_back(fds[1]);
+    }
+
+    const auto received = [&]() {
+      uint64_t sum = 0;
+
+      for (const auto &c : counters)
+        sum += c.packets.load(std::memory_order_relaxed);
+
+      return sum;
+    };
+
+    uint64_t expected = 0;
+
+    run("link_manager/40_vehicles/" + std::to_string(workers) + "_workers",
+        vehicles * stream.size(), [&](uint64_t n) {
+          std::vector< std::thread > threads;
+
+          /* Blocking writes, the socket buffers pace the feeders. */
+          for (std::size_t f = 0; f < feeders; f++)
+            threads.emplace_back([&, f]() {
+              for (uint64_t i = 0; i < n; i++)
+              {
+                for (std::size_t v = f; v < feeds.size(); v += feeders)
+                {
+                  for (std::size_t off = 0; off < stream.size();)
+                  {
+                    const ssize_t w = write(feeds[v], stream.data() + off,
+                                            stream.size() - off);
+
+                    if (w <= 0)
+                      return;
+
+                    off += w;
+                  }
+                }
+              }
+            });
+
+          for (auto &t : threads)
+            t.join();
+
+          expected += n * frames * vehicles;
+
+          while (received() < expected)
+            std::this_thread::yield();
+        });
+
+    for (int fd : feeds)
+      close(fd);
+  }
+
+  std::cout << "  (" << frames * vehicles << " packets per operation, "
+            << feeders << " feeders, " << cores << " cores)\n";
+}
+
+/*********************************
+ * TX scheduler
+ ********************************/
+
+void bench_tx_scheduler()
+{
+  constexpr uint64_t frames_per_producer = 1024;
+
+  for (std::size_t producers : {1, 2, 4})
+  {
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+      return;
+
+    /* Discards what the scheduler writes. */
+    std::atomic< bool > draining(true);
+    std::thread drain([&]() {
+      std::vector< uint8_t > buffer(1 << 16);
+
+      while (draining.load(std::memory_order_relaxed))
+        if (read(fds[0], buffer.data(), buffer.size()) <= 0)
+          break;
+    });
+
+    uint64_t writes = 0, frames = 0;
+
+    /* The producers outrun the thread, the pool holds a whole burst. */
+    tx_scheduler_options options;
+    options.pool_size = producers * frames_per_producer;
+
+    {
+      tx_scheduler tx(fds[1], options);
+      uint64_t expected = 0;
+
+      run("tx_scheduler/" + std::to_string(producers) + "_producers",
+          0, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+            {
+              std::vector< std::thread > threads;
+
+              for (std::size_t p = 0; p < producers; p++)
+                threads.emplace_back([&]() {
+                  datagrams::ComputerControlReference reference{};
+
+                  for (uint64_t f = 0; f < frames_per_producer; f++)
+                    tx.send(reference);
+                });
+
+              for (auto &t : threads)
+                t.join();
+
+              /* Written before the next burst reuses the nodes. */
+              expected += producers * frames_per_producer;
+
+              while (tx.statistics().classes[0].frames < expected)
+                std::this_thread::yield();
+            }
+          });
+
+      const auto stats = tx.statistics();
+      writes           = stats.writes;
+      frames           = stats.classes[0].frames;
+    }
+
+    draining = false;
+    shutdown(fds[1], SHUT_RDWR);
+    drain.join();
+
+    close(fds[0]);
+    close(fds[1]);
+
+    if (writes > 0)
+      std::cout << "  (" << producers * frames_per_producer
+                << " frames per operation, "
+                << static_cast< double >(frames) / writes
+                << " frames per write)\n";
+  }
+
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    return;
+
+  /* Posting is a seqlock store, the node is only queued when sent. */
+  {
+    tx_scheduler tx(fds[1]);
+    auto &mailbox = tx.mailbox< datagrams::ComputerControlReference >();
+    datagrams::ComputerControlReference reference{};
+
+    run("tx_mailbox/post", 0, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++)
+      {
+        reference.direct_control[0] = static_cast< uint16_t >(i);
+        mailbox.post(reference);
+      }
+    });
+
+    const auto stats = mailbox.statistics();
+
+    std::cout << "  (" << stats.sent << " of " << stats.posted
+              << " samples sent, nothing reads the link)\n";
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+}
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+
+    if (arg.compare(0, 9, "--filter=") == 0)
+      settings.filter = arg.substr(9);
+    else if (arg.compare(0, 7, "--json=") == 0)
+      settings.json = arg.substr(7);
+    else if (arg.compare(0, 11, "--min-time=") == 0)
+      settings.min_time = std::atof(arg.substr(11).c_str());
+    else
+    {
+      std::cerr << "Usage: " << argv[0]
+                << " [--filter=<substring>] [--json=<file>]"
+                   " [--min-time=<seconds>]\n";
+      return 1;
+    }
+  }
+
+  bench_encoding();
+  bench_decoding();
+  bench_crc();
+  bench_slip();
+  bench_dispatch();
+  bench_latest();
+  bench_telemetry();
+  bench_tracing();
+
+#ifdef KFLY_COMM_LOG_REPLAY
+  bench_log_replay();
+#endif
+
+#ifdef KFLY_COMM_SERIAL_LINK
+  bench_link_manager();
+  bench_tx_scheduler();
+#endif
+
+  if (!settings.json.empty())
+    write_json(settings.json);
+
+  return 0;
+}
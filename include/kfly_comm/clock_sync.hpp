@@ -0,0 +1,256 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <ratio>
+#include <vector>
+
+/* Threading includes */
+#include <atomic>
+
+/* KFly includes */
+#include "kfly_comm/kfly_comm.hpp"
+#include "kfly_comm/seqlock.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   Settings of a clock_sync.
+ */
+struct clock_sync_options
+{
+  /** @brief Length of a block, the earliest arrival of each is kept. */
+  std::chrono::milliseconds block = std::chrono::milliseconds(500);
+
+  /** @brief Number of blocks fitted, the fit spans blocks * block. */
+  std::size_t blocks = 64;
+};
+
+/**
+ * @brief   A mapping between the vehicle clock and the host steady clock.
+ */
+struct clock_estimate
+{
+  /** @brief Number of timestamped datagrams behind the estimate. */
+  uint64_t samples;
+
+  /** @brief A vehicle time on the fitted line, in ns. */
+  int64_t vehicle_origin_ns;
+
+  /** @brief The host time matching vehicle_origin_ns. */
+  std::chrono::steady_clock::time_point host_origin;
+
+  /** @brief Host nanoseconds per vehicle nanosecond, 1 plus the drift. */
+  double rate;
+
+  /** @brief One-way transport latency subtracted, half the minimum Ping
+   *         round trip, 0 without pings. */
+  std::chrono::nanoseconds latency;
+
+  /**
+   * @brief   True when the estimate holds at least one sample.
+   */
+  bool valid() const noexcept
+  {
+    return samples > 0;
+  }
+
+  /**
+   * @brief   Converts a vehicle timestamp, e.g. IMUData::time_stamp_ns, to
+   *          the host time at which it was taken.
+   */
+  std::chrono::steady_clock::time_point to_host(int64_t vehicle_ns) const
+      noexcept
+  {
+    const std::chrono::duration< double, std::nano > dt(
+        rate * static_cast< double >(vehicle_ns - vehicle_origin_ns));
+
+    return host_origin +
+           std::chrono::duration_cast< std::chrono::steady_clock::duration >(
+               dt);
+  }
+
+  /**
+   * @brief   Converts a host time to the vehicle clock, in ns.
+   */
+  int64_t to_vehicle(std::chrono::steady_clock::time_point host) const
+      noexcept
+  {
+    const std::chrono::duration< double, std::nano > dt = host - host_origin;
+
+    return vehicle_origin_ns + static_cast< int64_t >(dt.count() / rate);
+  }
+};
+
+/**
+ * @brief     Estimates the offset and drift between the vehicle clock and
+ *            the host steady clock.
+ *
+ * @details   Every IMUData and RawIMUData carries a vehicle timestamp and is
+ *            stamped with the host time when its END byte was parsed, taken
+ *            from a frame tap on the codec. Transport delays only ever add
+ *            to the arrival time, so the earliest arrival of each block is
+ *            kept and a line is fitted under their lower convex hull: the
+ *            hull edge at the mean vehicle time, which minimizes the summed
+ *            distance to the points. Optional Pings measure the round trip,
+ *            half the minimum of which is subtracted as transport latency.
+ *            The estimate is published through a seqlock, so it can be read
+ *            from any thread without waiting:
+ *
+ *              clock_sync sync(kfly);
+ *
+ *              auto estimate = sync.estimate();
+ *              auto t = estimate.to_host(imu.time_stamp_ns);
+ *
+ * @note      A vehicle clock running backwards, e.g. after a reboot of
+ *            KFly, restarts the estimation.
+ */
+class clock_sync
+{
+public:
+  /**
+   * @brief   Function transmitting an encoded frame, e.g. serial_link::send.
+   */
+  using send_function = std::function< void(const uint8_t *, std::size_t) >;
+
+private:
+  class timestamp_tap;
+
+  /**
+   * @brief   A sample relative to the first one, in ns.
+   */
+  struct point
+  {
+    int64_t vehicle;
+    int64_t host;
+  };
+
+  /** @brief Settings. */
+  const clock_sync_options _options;
+
+  /** @brief The codec the timestamps are taken from. */
+  codec &_codec;
+
+  /** @brief Transmits pings, may be empty. */
+  send_function _send;
+
+  /** @brief The first sample, the points are relative to it. */
+  int64_t _vehicle_base;
+  std::chrono::steady_clock::time_point _host_base;
+
+  /** @brief Latest vehicle time, to detect restarts. */
+  int64_t _last_vehicle;
+
+  /** @brief Finished blocks, oldest first, and the current one. */
+  std::deque< point > _blocks;
+  point _current;
+  bool _current_valid;
+
+  /** @brief Lower convex hull of the blocks, kept to reuse its memory. */
+  std::vector< point > _hull;
+
+  /** @brief Number of samples since the start. */
+  uint64_t _samples;
+
+  /** @brief Host time in ns the outstanding ping was sent, 0 if none. */
+  std::atomic< int64_t > _ping_sent;
+
+  /** @brief The latest round trips in ns. */
+  std::array< int64_t, 16 > _round_trips;
+  std::size_t _round_trip_count;
+
+  /** @brief Minimum of the round trips in ns, written by the parsing
+   *         thread. */
+  std::atomic< int64_t > _min_round_trip;
+
+  /** @brief The published estimate. */
+  seqlock< clock_estimate > _estimate;
+
+  /** @brief Taps the timestamps from the codec. */
+  std::unique_ptr< timestamp_tap > _tap;
+
+  /**
+   * @brief   Adds a vehicle timestamp received at a host time.
+   */
+  void on_sample(int64_t vehicle_ns,
+                 std::chrono::steady_clock::time_point host);
+
+  /**
+   * @brief   Adds the round trip of an answered ping.
+   */
+  void on_ping(std::chrono::steady_clock::time_point host);
+
+  /**
+   * @brief   Fits the line and publishes the estimate.
+   */
+  void update();
+
+public:
+  /**
+   * @brief   Constructor, taps the codec.
+   *
+   * @param[in] c         The codec receiving from KFly, must outlive the
+   *                      clock_sync.
+   * @param[in] send      Transmits pings, may be empty if ping() is unused.
+   * @param[in] options   Settings.
+   */
+  clock_sync(codec &c, send_function send = send_function(),
+             const clock_sync_options &options = clock_sync_options());
+
+  ~clock_sync();
+
+  clock_sync(const clock_sync &) = delete;
+  clock_sync &operator=(const clock_sync &) = delete;
+
+  /**
+   * @brief   Sends a Ping to measure the round trip, unless one is already
+   *          outstanding. Pings lost on the way are replaced after 1 s.
+   */
+  void ping();
+
+  /**
+   * @brief   Minimum of the latest 16 ping round trips, 0 without pings.
+   */
+  std::chrono::nanoseconds min_round_trip() const noexcept;
+
+  /**
+   * @brief   The current estimate, from any thread.
+   */
+  clock_estimate estimate() const noexcept
+  {
+    return _estimate.load();
+  }
+
+  /**
+   * @brief   Converts a vehicle timestamp to host time with the current
+   *          estimate.
+   */
+  std::chrono::steady_clock::time_point to_host(int64_t vehicle_ns) const
+      noexcept
+  {
+    return estimate().to_host(vehicle_ns);
+  }
+
+  /**
+   * @brief   Converts a host time to the vehicle clock with the current
+   *          estimate.
+   */
+  int64_t to_vehicle(std::chrono::steady_clock::time_point host) const
+      noexcept
+  {
+    return estimate().to_vehicle(host);
+  }
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,117 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include "kfly_comm/crc.hpp"
+#include "kfly_comm/slip.hpp"
+#include "kfly_comm/commands.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   A SLIP encoded packet of a command without datagram, as built by
+ *          encode_packet.
+ */
+struct command_frame
+{
+  /** @brief Worst case size: END, command, size, CRC, all escaped, END. */
+  static constexpr std::size_t capacity = slip::max_encoded_size(4);
+
+  /** @brief The encoded bytes. */
+  uint8_t bytes[capacity];
+
+  /** @brief Number of bytes used. */
+  std::size_t size;
+
+  constexpr const uint8_t *begin() const noexcept
+  {
+    return bytes;
+  }
+
+  constexpr const uint8_t *end() const noexcept
+  {
+    return bytes + size;
+  }
+};
+
+namespace details
+{
+/**
+ * @brief   Encodes the frame of a command at compile time.
+ *
+ * @param[in] command   The command, without ack bit.
+ * @param[in] ack       Ack request flag.
+ */
+constexpr command_frame make_command_frame(const uint8_t command,
+                                           const bool ack)
+{
+  command_frame f{{}, 0};
+
+  /* The CRC is on the command without ack bit and the zero size. */
+  const uint16_t crc =
+      CRC16_CCITT::generateCRC(0, CRC16_CCITT::generateCRC(command));
+
+  /* Little endian CRC, as on the wire. */
+  const uint8_t header[4] = {
+      static_cast< uint8_t >(command | (ack ? 0x80 : 0)), 0,
+      static_cast< uint8_t >(crc & 0xff), static_cast< uint8_t >(crc >> 8)};
+
+  f.bytes[f.size++] = slip::END;
+
+  for (const uint8_t b : header)
+    f.size += slip::encode_byte(b, f.bytes + f.size);
+
+  f.bytes[f.size++] = slip::END;
+
+  return f;
+}
+
+/**
+ * @brief   Frames of all commands, indexed by the command with ack bit.
+ */
+template < std::size_t... Is >
+constexpr std::array< command_frame, sizeof...(Is) > make_command_frames(
+    std::index_sequence< Is... >)
+{
+  return {{make_command_frame(Is & 0x7f, (Is & 0x80) != 0)...}};
+}
+
+/**
+ * @brief   Holder of the table, a template so the header can define it.
+ */
+template < typename = void >
+struct command_frame_table
+{
+  static constexpr std::array< command_frame, 256 > frames =
+      make_command_frames(std::make_index_sequence< 256 >{});
+};
+
+template < typename T >
+constexpr std::array< command_frame, 256 > command_frame_table< T >::frames;
+}
+
+/**
+ * @brief   The pre-encoded frame of a command without datagram, e.g. Ping or
+ *          GetIMUCalibration, built at compile time. Sending it is a single
+ *          write of static bytes.
+ *
+ * @param[in] command   The command.
+ * @param[in] ack       If true, then an ack is requested.
+ *
+ * @return  The frame, valid for the lifetime of the program.
+ */
+constexpr const command_frame &command_frame_for(const commands command,
+                                                 const bool ack = false)
+{
+  return details::command_frame_table<>::frames[(
+      static_cast< uint8_t >(command) & 0x7f) | (ack ? 0x80 : 0)];
+}
+
+}  // namespace kfly_comm
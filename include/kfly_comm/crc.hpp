@@ -6,6 +6,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 #include <vector>
 #include <array>
 
@@ -45,29 +46,141 @@ const constexpr std::array< uint16_t, 256 > crc16_table = {
      0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8, 0x6e17, 0x7e36, 0x4e55, 0x5e74,
      0x2e93, 0x3eb2, 0x0ed1, 0x1ef0}};
 
+namespace details
+{
 /**
- * @brief   Calculates the CRC-CCITT of a payload.
+ * @brief   Holder of the slicing-by-8 tables, table[k][b] is the CRC of byte
+ *          b followed by k zero bytes.
+ */
+struct slice_tables
+{
+  uint16_t table[8][256];
+};
+
+/**
+ * @brief   Generates the slicing-by-8 tables from the CRC-CCITT table.
  *
- * @param[in] payload     The payload to be checked.
+ * @return  The slicing-by-8 tables.
+ */
+constexpr slice_tables make_slice_tables()
+{
+  slice_tables tables{};
+
+  for (int b = 0; b < 256; b++)
+    tables.table[0][b] = crc16_table[b];
+
+  for (int k = 1; k < 8; k++)
+  {
+    for (int b = 0; b < 256; b++)
+    {
+      const uint16_t prev = tables.table[k - 1][b];
+      tables.table[k][b] =
+          static_cast< uint16_t >(crc16_table[prev >> 8] ^ (prev << 8));
+    }
+  }
+
+  return tables;
+}
+}
+
+/**
+ * @brief   CRC-CCITT slicing-by-8 tables.
+ */
+const constexpr details::slice_tables crc16_slice_tables =
+    details::make_slice_tables();
+
+/**
+ * @brief   Calculates the CRC-CCITT of a payload one byte at a time.
+ *
+ * @param[in] data        Pointer to the payload to be checked.
+ * @param[in] size        Size of the payload in bytes.
  * @param[in] crc_start   The starting value of the CRC, can be use to chain
  *                        multiple calculations.
  *
  * @return  The calculated CRC-CCITT.
  */
-inline uint16_t generateCRC(const std::vector< uint8_t > &payload,
-                            const uint16_t crc_start = 0xffff)
+constexpr uint16_t generateCRC_bytewise(const uint8_t *data,
+                                        const std::size_t size,
+                                        const uint16_t crc_start = 0xffff)
 {
   uint16_t crc = crc_start;
 
-  for (auto data : payload)
+  for (std::size_t i = 0; i < size; i++)
   {
-    uint8_t tbl_idx = ((crc >> 8) ^ data) & 0xff;
+    uint8_t tbl_idx = ((crc >> 8) ^ data[i]) & 0xff;
     crc             = crc16_table[tbl_idx] ^ (crc << 8);
   }
 
   return crc;
 }
 
+/**
+ * @brief   Calculates the CRC-CCITT of a payload eight bytes at a time, using
+ *          the slicing-by-8 tables.
+ *
+ * @param[in] data        Pointer to the payload to be checked.
+ * @param[in] size        Size of the payload in bytes.
+ * @param[in] crc_start   The starting value of the CRC, can be use to chain
+ *                        multiple calculations.
+ *
+ * @return  The calculated CRC-CCITT.
+ */
+inline uint16_t generateCRC_slice8(const uint8_t *data, std::size_t size,
+                                   const uint16_t crc_start = 0xffff)
+{
+  const auto &t = crc16_slice_tables.table;
+  uint16_t crc  = crc_start;
+
+  while (size >= 8)
+  {
+    crc = t[7][data[0] ^ (crc >> 8)] ^ t[6][data[1] ^ (crc & 0xff)] ^
+          t[5][data[2]] ^ t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^
+          t[1][data[6]] ^ t[0][data[7]];
+
+    data += 8;
+    size -= 8;
+  }
+
+  return generateCRC_bytewise(data, size, crc);
+}
+
+/**
+ * @brief   Calculates the CRC-CCITT of a payload with the fastest engine
+ *          available on the running CPU (carry-less multiply folding on
+ *          x86-64 with PCLMULQDQ, else slicing-by-8), selected at runtime.
+ *
+ * @param[in] data        Pointer to the payload to be checked.
+ * @param[in] size        Size of the payload in bytes.
+ * @param[in] crc_start   The starting value of the CRC, can be use to chain
+ *                        multiple calculations.
+ *
+ * @return  The calculated CRC-CCITT.
+ */
+uint16_t generateCRC(const uint8_t *data, const std::size_t size,
+                     const uint16_t crc_start = 0xffff);
+
+/**
+ * @brief   Checks if the carry-less multiply engine is used on this CPU.
+ *
+ * @return  True if generateCRC uses the PCLMULQDQ engine for large payloads.
+ */
+bool has_clmul_engine();
+
+/**
+ * @brief   Calculates the CRC-CCITT of a payload.
+ *
+ * @param[in] payload     The payload to be checked.
+ * @param[in] crc_start   The starting value of the CRC, can be use to chain
+ *                        multiple calculations.
+ *
+ * @return  The calculated CRC-CCITT.
+ */
+inline uint16_t generateCRC(const std::vector< uint8_t > &payload,
+                            const uint16_t crc_start = 0xffff)
+{
+  return generateCRC(payload.data(), payload.size(), crc_start);
+}
+
 /**
  * @brief   Calculates the CRC-CCITT of a payload.
  *
@@ -83,9 +196,9 @@ constexpr uint16_t generateCRC(const std::array< uint8_t, N > &payload,
 {
   uint16_t crc = crc_start;
 
-  for (auto data : payload)
+  for (std::size_t i = 0; i < N; i++)
   {
-    uint8_t tbl_idx = ((crc >> 8) ^ data) & 0xff;
+    uint8_t tbl_idx = ((crc >> 8) ^ payload[i]) & 0xff;
     crc             = crc16_table[tbl_idx] ^ (crc << 8);
   }
 
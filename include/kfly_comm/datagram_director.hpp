@@ -9,33 +9,87 @@
 #include <algorithm>
 #include <tuple>
 #include <mutex>
-#include <exception>
-#include <functional>
-#include <string>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 
 namespace details
 {
+template < typename Datagram >
+class CallbackList;
+}
+
 /**
- * @brief   A hashing function for method pointers.
+ * @brief   An opaque handle to a registered callback, returned when
+ *          registering and used to release exactly that registration.
+ *
+ * @tparam Datagram   The datagram type of the callback.
  */
-template < typename T, typename R, typename... Args >
-std::size_t method_ptr_hash(R (T::*f)(Args...))
+template < typename Datagram >
+class callback_handle
 {
-  /* The method pointer has not the same size as a void*, make generic. */
-  union {
-    R (T::*pf)(Args...);
-    std::array< char, sizeof(R (T::*)(Args...)) > p;
-  };
+private:
+  friend class details::CallbackList< Datagram >;
 
-  /* Save the pointer. */
-  pf = f;
+  /**
+   * @brief   Registration number, unique within a callback list, 0 if none.
+   */
+  uint64_t _id;
 
-  /* Hash whatever is inside the pointer. */
-  return std::hash< std::string >{}(std::string(p.data(), p.size()));
-}
+  explicit callback_handle(uint64_t id) noexcept : _id(id)
+  {
+  }
+
+public:
+  /**
+   * @brief   Constructor, creates a handle to no registration.
+   */
+  callback_handle() noexcept : _id(0)
+  {
+  }
+
+  /**
+   * @brief   Checks if the handle refers to a registration.
+   */
+  bool valid() const noexcept
+  {
+    return _id != 0;
+  }
+
+  bool operator==(const callback_handle& rhs) const noexcept
+  {
+    return _id == rhs._id;
+  }
+
+  bool operator!=(const callback_handle& rhs) const noexcept
+  {
+    return _id != rhs._id;
+  }
+};
+
+namespace details
+{
+/**
+ * @brief   A class of unknown inheritance, pointers to its methods have the
+ *          largest representation a method pointer can have.
+ */
+class unknown_class;
+
+/**
+ * @brief   Method pointer type used to size the inline callback storage.
+ */
+using generic_method_ptr = void (unknown_class::*)();
 
 /**
- * @brief   A wrapper class for function pointers and method pointers.
+ * @brief   A non-allocating delegate for function pointers and method
+ *          pointers.
+ *
+ * @details The function or method pointer is stored inline together with
+ *          the object pointer, and a trampoline generated for the exact
+ *          callback signature restores and calls it. Invoking the callback
+ *          is a single indirect call which takes the datagram by reference.
  *
  * @tparam Datagram   The datagram type,
  */
@@ -44,15 +98,96 @@ class DatagramCallback
 {
 private:
   /**
-   * @brief   Function object holding the callback.
+   * @brief   Signature of the trampolines.
+   */
+  using trampoline_type = void (*)(const DatagramCallback&, const Datagram&);
+
+  /**
+   * @brief   Inline storage for the function or method pointer.
+   */
+  alignas(generic_method_ptr) unsigned char _storage[sizeof(
+      generic_method_ptr)];
+
+  /**
+   * @brief   Trampoline calling the stored pointer.
    */
-  std::function< void(Datagram) > _callback;
+  trampoline_type _trampoline;
 
   /**
-   * @brief   Void pointer
+   * @brief   Object pointer for methods, nullptr for functions.
    */
   void* _target;
-  std::size_t _method_hash;
+
+  /**
+   * @brief   Saves a function or method pointer in the inline storage.
+   *
+   * @param[in] ptr   The pointer to save.
+   */
+  template < typename Pointer >
+  void store(Pointer ptr) noexcept
+  {
+    static_assert(sizeof(Pointer) <= sizeof(generic_method_ptr),
+                  "Callback does not fit the inline storage.");
+
+    std::memcpy(_storage, &ptr, sizeof(Pointer));
+  }
+
+  /**
+   * @brief   Restores a function or method pointer from the inline storage.
+   *
+   * @return  The saved pointer.
+   */
+  template < typename Pointer >
+  Pointer load() const noexcept
+  {
+    Pointer ptr;
+    std::memcpy(&ptr, _storage, sizeof(Pointer));
+    return ptr;
+  }
+
+  /**
+   * @brief   Trampoline for function pointers.
+   */
+  template < typename Function >
+  static void invoke_function(const DatagramCallback& self, const Datagram& d)
+  {
+    self.load< Function >()(d);
+  }
+
+  /**
+   * @brief   Trampoline for method pointers.
+   */
+  template < typename Object, typename Method >
+  static void invoke_method(const DatagramCallback& self, const Datagram& d)
+  {
+    (static_cast< Object* >(self._target)->*self.load< Method >())(d);
+  }
+
+  /**
+   * @brief   Creates the callback from a method pointer.
+   */
+  template < typename Object, typename Method >
+  void from_method(Object* obj, Method callback)
+  {
+    if (obj == nullptr || callback == nullptr)
+      throw std::invalid_argument("Datagram callback may not be a nullptr.");
+
+    store(callback);
+    _trampoline = &invoke_method< Object, Method >;
+  }
+
+  /**
+   * @brief   Creates the callback from a function pointer.
+   */
+  template < typename Function >
+  void from_function(Function fp)
+  {
+    if (fp == nullptr)
+      throw std::invalid_argument("Datagram callback may not be a nullptr.");
+
+    store(fp);
+    _trampoline = &invoke_function< Function >;
+  }
 
 public:
   /**
@@ -65,12 +200,25 @@ public:
    */
   template < typename Object >
   DatagramCallback(Object* obj, void (Object::*callback)(Datagram))
-      : _target(obj), _method_hash(method_ptr_hash(callback))
+      : _storage{}, _target(obj)
   {
-    if (obj == nullptr)
-      throw std::invalid_argument("Datagram callback may not be a nullptr.");
+    from_method(obj, callback);
+  }
 
-    _callback = std::bind(callback, obj, std::placeholders::_1);
+  /**
+   * @brief   Constructor, creates the callback from a method pointer taking
+   *          the datagram by reference.
+   *
+   * @param[in] obj       Object from which the callback is defined.
+   * @param[in] callback  Method pointer to register.
+   *
+   * @tparam Object       Type of the Object.
+   */
+  template < typename Object >
+  DatagramCallback(Object* obj, void (Object::*callback)(const Datagram&))
+      : _storage{}, _target(obj)
+  {
+    from_method(obj, callback);
   }
 
   /**
@@ -79,25 +227,37 @@ public:
    * @param[in] fp    Function pointer to register.
    */
   DatagramCallback(void (*fp)(Datagram))
-      : _target(reinterpret_cast< void* >(fp)), _method_hash(0)
+      : _storage{}, _target(nullptr)
   {
-    if (fp == nullptr)
-      throw std::invalid_argument("Datagram callback may not be a nullptr.");
+    from_function(fp);
+  }
 
-    _callback = fp;
+  /**
+   * @brief   Constructor, creates the callback from a function pointer
+   *          taking the datagram by reference.
+   *
+   * @param[in] fp    Function pointer to register.
+   */
+  DatagramCallback(void (*fp)(const Datagram&))
+      : _storage{}, _target(nullptr)
+  {
+    from_function(fp);
   }
 
   /**
    * @brief   Equality comparison operator.
    *
+   * @details Two callbacks are the same if they have the same signature (same
+   *          trampoline), the same object and the same pointer
+   *          representation. The unused part of the storage is always zero,
+   *          so comparing all of it is exact.
+   *
    * @param[in] rhs    DatagramCallback to compare with.
    */
-  bool operator==(DatagramCallback& rhs) const noexcept
+  bool operator==(const DatagramCallback& rhs) const noexcept
   {
-    if (_method_hash == 0)  // Function pointer case
-      return (_target == rhs._target);
-    else  // Method pointer case
-      return (_target == rhs._target && _method_hash == rhs._method_hash);
+    return _trampoline == rhs._trampoline && _target == rhs._target &&
+           std::memcmp(_storage, rhs._storage, sizeof(_storage)) == 0;
   }
 
   /**
@@ -105,12 +265,9 @@ public:
    *
    * @param[in] rhs    DatagramCallback to compare with.
    */
-  bool operator!=(DatagramCallback& rhs) const noexcept
+  bool operator!=(const DatagramCallback& rhs) const noexcept
   {
-    if (_method_hash == 0)  // Function pointer case
-      return (_target != rhs._target);
-    else  // Method pointer case
-      return (_target != rhs._target || _method_hash != rhs._method_hash);
+    return !(*this == rhs);
   }
 
   /**
@@ -118,9 +275,229 @@ public:
    *
    * @param[in] d     Datagram to send to the callback.
    */
-  void operator()(Datagram d) const
+  void operator()(const Datagram& d) const
+  {
+    _trampoline(*this, d);
+  }
+};
+
+/**
+ * @brief   A copy-on-write list of callbacks for one datagram type.
+ *
+ * @details Executing reads the currently published snapshot without locking,
+ *          while register/release build a new snapshot under the writer lock
+ *          and publish it atomically. Replaced snapshots are retired and are
+ *          freed once a writer sees no execution in flight.
+ *
+ * @tparam Datagram   The datagram type,
+ */
+template < typename Datagram >
+class CallbackList
+{
+private:
+  /**
+   * @brief   A callback together with its registration number.
+   */
+  struct registration
+  {
+    uint64_t id;
+    DatagramCallback< Datagram > callback;
+  };
+
+  /**
+   * @brief   Alias for an immutable snapshot of callbacks.
+   */
+  using snapshot_type = std::vector< registration >;
+
+  /**
+   * @brief   The currently published snapshot, nullptr if none registered.
+   */
+  std::atomic< const snapshot_type* > _snapshot;
+
+  /**
+   * @brief   Number of executions currently reading a snapshot.
+   */
+  std::atomic< unsigned > _readers;
+
+  /**
+   * @brief   Serializes the writers (register/release).
+   */
+  std::mutex _writer_lock;
+
+  /**
+   * @brief   Snapshots which have been replaced but may still be read.
+   */
+  std::vector< std::unique_ptr< const snapshot_type > > _retired;
+
+  /**
+   * @brief   Registration number of the next callback, guarded by the writer
+   *          lock.
+   */
+  uint64_t _next_id;
+
+  /**
+   * @brief   Number of callbacks in the published snapshot.
+   */
+  std::atomic< std::size_t > _size;
+
+  /**
+   * @brief   RAII guard marking an execution in flight.
+   */
+  struct reader_guard
+  {
+    std::atomic< unsigned >& readers;
+
+    reader_guard(std::atomic< unsigned >& r) : readers(r)
+    {
+      readers.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    ~reader_guard()
+    {
+      readers.fetch_sub(1, std::memory_order_release);
+    }
+  };
+
+  /**
+   * @brief   Publishes a modified copy of the current snapshot, the writer
+   *          lock must be held.
+   *
+   * @param[in] modify    Function modifying the new snapshot in place.
+   */
+  template < typename Modifier >
+  void update(Modifier&& modify)
+  {
+    /* Only writers replace the snapshot, so it is stable under the lock. */
+    const snapshot_type* current = _snapshot.load(std::memory_order_relaxed);
+
+    std::unique_ptr< snapshot_type > next(
+        current != nullptr ? new snapshot_type(*current) : new snapshot_type);
+
+    modify(*next);
+    _size.store(next->size(), std::memory_order_release);
+
+    /* Publish the new snapshot and retire the old one. */
+    _snapshot.store(next.release(), std::memory_order_seq_cst);
+
+    if (current != nullptr)
+      _retired.emplace_back(current);
+
+    /* With no readers in flight every coming reader sees the new snapshot,
+     * so all the retired snapshots can be freed. */
+    if (_readers.load(std::memory_order_seq_cst) == 0)
+      _retired.clear();
+  }
+
+public:
+  CallbackList() : _snapshot(nullptr), _readers(0), _next_id(1), _size(0)
+  {
+  }
+
+  ~CallbackList()
+  {
+    delete _snapshot.load(std::memory_order_relaxed);
+  }
+
+  CallbackList(const CallbackList&) = delete;
+  CallbackList& operator=(const CallbackList&) = delete;
+
+  /**
+   * @brief   Adds a callback.
+   *
+   * @param[in] callback  The callback to add.
+   *
+   * @return  Handle to the registration.
+   */
+  callback_handle< Datagram > add(const DatagramCallback< Datagram >& callback)
+  {
+    std::lock_guard< std::mutex > lock(_writer_lock);
+
+    const uint64_t id = _next_id++;
+
+    update([&](snapshot_type& callbacks) {
+      callbacks.push_back(registration{id, callback});
+    });
+
+    return callback_handle< Datagram >(id);
+  }
+
+  /**
+   * @brief   Removes all registrations of a callback.
+   *
+   * @param[in] callback  The callback to remove.
+   */
+  void remove(const DatagramCallback< Datagram >& callback)
+  {
+    std::lock_guard< std::mutex > lock(_writer_lock);
+
+    update([&](snapshot_type& callbacks) {
+      callbacks.erase(std::remove_if(callbacks.begin(), callbacks.end(),
+                                     [&](const registration& r) {
+                                       return r.callback == callback;
+                                     }),
+                      callbacks.end());
+    });
+  }
+
+  /**
+   * @brief   Removes the registration of a handle.
+   *
+   * @param[in] handle    Handle returned when the callback was added.
+   *
+   * @return  True if the registration existed and was removed.
+   */
+  bool remove(const callback_handle< Datagram > handle)
+  {
+    std::lock_guard< std::mutex > lock(_writer_lock);
+
+    /* Registrations are appended with increasing numbers and removal keeps
+     * the order, so the snapshot is sorted on the number. */
+    const auto find = [&](const snapshot_type& callbacks) {
+      return std::lower_bound(
+          callbacks.begin(), callbacks.end(), handle._id,
+          [](const registration& r, uint64_t id) { return r.id < id; });
+    };
+
+    const snapshot_type* current = _snapshot.load(std::memory_order_relaxed);
+
+    if (!handle.valid() || current == nullptr)
+      return false;
+
+    const auto it = find(*current);
+
+    if (it == current->end() || it->id != handle._id)
+      return false;
+
+    update([&](snapshot_type& callbacks) { callbacks.erase(find(callbacks)); });
+
+    return true;
+  }
+
+  /**
+   * @brief   Checks if any callback is registered.
+   */
+  bool empty() const noexcept
   {
-    _callback(d);
+    return _size.load(std::memory_order_acquire) == 0;
+  }
+
+  /**
+   * @brief   Executes all callbacks in the current snapshot.
+   *
+   * @param[in] data     Datagram to send to the callbacks.
+   */
+  void execute(const Datagram& data)
+  {
+    reader_guard guard(_readers);
+
+    const snapshot_type* callbacks =
+        _snapshot.load(std::memory_order_seq_cst);
+
+    if (callbacks == nullptr)
+      return;
+
+    for (const auto& r : *callbacks)
+      r.callback(data);
   }
 };
 }
@@ -130,15 +507,16 @@ public:
  *            types.
  *
  * @details   The datagram director is based on that each registered datagram
- *            type gets its own callback vector (through a little meta
- *            programming, which makes it all happen at compile time), so each
- *            callback vector has its own mutex to only lock it and not the
- *            other callbacks. So in conclusion the data structure looks like
- *            this:
+ *            type gets its own callback list (through a little meta
+ *            programming, which makes it all happen at compile time). Each
+ *            list is copy-on-write: registering and releasing publish a new
+ *            immutable snapshot, while executing the callbacks reads the
+ *            current snapshot without taking a lock or copying callbacks. So
+ *            in conclusion the data structure looks like this:
  *
- *            element = pair<
- *                            vector of callbacks for specific datagram,
- *                            access mutex to the vector
+ *            element = CallbackList<
+ *                            atomic pointer to the callback snapshot,
+ *                            writer mutex and retired snapshots
  *                          >
  *
  *            callback_list = tuple<
@@ -148,8 +526,8 @@ public:
  *                                   element< Datagram N >
  *                                 >
  *
- * @note      The class is thread safe, each callback vector is protected with
- *            a mutex.
+ * @note      The class is thread safe, callbacks may be registered and
+ *            released while they are being executed.
  *
  * @tparam Datagrams    Datagram types to be registered in the datagram
  *                      director for callback handling.
@@ -202,6 +580,23 @@ private:
   template < typename Object, typename Datagram >
   using method_ptr = void (Object::*)(Datagram);
 
+  /**
+   * @brief   Function pointer alias, datagram by reference.
+   *
+   * @tparam Datagram  Type of the datagram.
+   */
+  template < typename Datagram >
+  using function_cref_ptr = void (*)(const Datagram&);
+
+  /**
+   * @brief   Method pointer alias, datagram by reference.
+   *
+   * @tparam Object    Type of the object.
+   * @tparam Datagram  Type of the datagram.
+   */
+  template < typename Object, typename Datagram >
+  using method_cref_ptr = void (Object::*)(const Datagram&);
+
   /**
    * @brief   Alias for the callback wrapper.
    *
@@ -213,19 +608,16 @@ private:
   /**
    * @brief   Helper alias to define the callback tuple elements.
    *
-   * @details Each tuple element consists of a list of function pointers to
-   *          functions which takes a specific datagram as argument, and each
-   *          list has a corresponding mutex to make it thread safe.
+   * @details Each tuple element consists of a copy-on-write list of
+   *          callbacks which takes a specific datagram as argument.
    *
    * @tparam Datagram   Type of the datagram for this tuple element.
    */
   template < typename Datagram >
-  using make_element =
-      std::pair< std::vector< callback_wrapper< Datagram > >, std::mutex >;
+  using make_element = details::CallbackList< Datagram >;
 
   /**
-   * @brief   The tuple which contains the lists of function pointers and
-   *          mutexes.
+   * @brief   The tuple which contains the callback lists.
    */
   std::tuple< make_element< Datagrams >... > _callbacks;
 
@@ -235,23 +627,20 @@ private:
    *
    * @param[in] cw      The callback wrapper to register.
    *
+   * @return  Handle to the registration.
+   *
    * @tparam Datagram   Type of the datagram for this tuple element.
    */
   template < typename Datagram >
-  void register_callback(callback_wrapper< Datagram >&& callback)
+  callback_handle< Datagram > register_callback(
+      const callback_wrapper< Datagram >& cw)
   {
     /* Check to the Datagram exists in the tuple. */
     static_assert(exists< Datagram, Datagrams... >::value == true,
                   "The provided datagram is not registered.");
 
-    /* Do a nullptr check. */
-    /* Get the corresponding datagram's mutex and lock it. */
-    std::lock_guard< std::mutex > lock(
-        std::get< make_element< Datagram > >(_callbacks).second);
-
-    /* Emplace the callback in the corresponding callback vector. */
-    std::get< make_element< Datagram > >(_callbacks)
-        .first.emplace_back(std::move(callback));
+    /* Publish a new snapshot with the callback appended. */
+    return std::get< make_element< Datagram > >(_callbacks).add(cw);
   }
 
   /**
@@ -263,24 +652,14 @@ private:
    * @tparam Datagram   Type of the datagram for this tuple element.
    */
   template < typename Datagram >
-  void release_callback(callback_wrapper< Datagram > cw)
+  void release_callback(const callback_wrapper< Datagram >& cw)
   {
     /* Check to the Datagram exists in the tuple. */
     static_assert(exists< Datagram, Datagrams... >::value == true,
                   "The provided datagram is not registered.");
 
-    /* Get the corresponding datagram's mutex and lock it. */
-    std::lock_guard< std::mutex > lock(
-        std::get< make_element< Datagram > >(_callbacks).second);
-
-    /* Get the callback list, and delete the requested callback. */
-    auto& callbacks = std::get< make_element< Datagram > >(_callbacks).first;
-
-    callbacks.erase(std::remove_if(callbacks.begin(), callbacks.end(),
-                                   [&](callback_wrapper< Datagram > l_cb) {
-                                     return cw == l_cb;
-                                   }),
-                    callbacks.end());
+    /* Publish a new snapshot without the requested callback. */
+    std::get< make_element< Datagram > >(_callbacks).remove(cw);
   }
 
 public:
@@ -290,12 +669,15 @@ public:
    *
    * @param[in] fun   The function pointer to register.
    *
+   * @return  Handle to the registration.
+   *
    * @tparam Datagram   Type of the datagram.
    */
   template < typename Datagram >
-  void register_callback(function_ptr< Datagram > fun)
+  callback_handle< Datagram > register_callback(
+      function_ptr< Datagram > fun)
   {
-    register_callback(callback_wrapper< Datagram >(fun));
+    return register_callback(callback_wrapper< Datagram >(fun));
   }
 
   /**
@@ -305,13 +687,52 @@ public:
    * @param[in] obj   The object pointer to register.
    * @param[in] mf    The method pointer to register.
    *
+   * @return  Handle to the registration.
+   *
+   * @tparam Obejct     Type of the object in which the callback exists.
+   * @tparam Datagram   Type of the datagram.
+   */
+  template < typename Object, typename Datagram >
+  callback_handle< Datagram > register_callback(
+      Object* obj, method_ptr< Object, Datagram > mf)
+  {
+    return register_callback(callback_wrapper< Datagram >(obj, mf));
+  }
+
+  /**
+   * @brief   Registers a function pointer, taking the datagram by reference,
+   *          to its corresponding datagram callback.
+   *
+   * @param[in] fun   The function pointer to register.
+   *
+   * @return  Handle to the registration.
+   *
+   * @tparam Datagram   Type of the datagram.
+   */
+  template < typename Datagram >
+  callback_handle< Datagram > register_callback(
+      function_cref_ptr< Datagram > fun)
+  {
+    return register_callback(callback_wrapper< Datagram >(fun));
+  }
+
+  /**
+   * @brief   Registers a method pointer, taking the datagram by reference,
+   *          to its corresponding datagram callback.
+   *
+   * @param[in] obj   The object pointer to register.
+   * @param[in] mf    The method pointer to register.
+   *
+   * @return  Handle to the registration.
+   *
    * @tparam Obejct     Type of the object in which the callback exists.
    * @tparam Datagram   Type of the datagram.
    */
   template < typename Object, typename Datagram >
-  void register_callback(Object* obj, method_ptr< Object, Datagram > mf)
+  callback_handle< Datagram > register_callback(
+      Object* obj, method_cref_ptr< Object, Datagram > mf)
   {
-    register_callback(callback_wrapper< Datagram >(obj, mf));
+    return register_callback(callback_wrapper< Datagram >(obj, mf));
   }
 
   /**
@@ -344,6 +765,70 @@ public:
     release_callback(callback_wrapper< Datagram >(obj, mf));
   }
 
+  /**
+   * @brief   Releases a function pointer, taking the datagram by reference,
+   *          from its corresponding datagram callback.
+   *
+   * @param[in] cw      The function pointer to release.
+   *
+   * @tparam Datagram   Type of the datagram.
+   */
+  template < typename Datagram >
+  void release_callback(function_cref_ptr< Datagram > fun)
+  {
+    release_callback(callback_wrapper< Datagram >(fun));
+  }
+
+  /**
+   * @brief   Releases a method pointer, taking the datagram by reference,
+   *          from its corresponding datagram callback.
+   *
+   * @param[in] obj   The object pointer to register.
+   * @param[in] mf    The method pointer to register.
+   *
+   * @tparam Obejct     Type of the object in which the callback exists.
+   * @tparam Datagram   Type of the datagram.
+   */
+  template < typename Object, typename Datagram >
+  void release_callback(Object* obj, method_cref_ptr< Object, Datagram > mf)
+  {
+    release_callback(callback_wrapper< Datagram >(obj, mf));
+  }
+
+  /**
+   * @brief   Releases the registration of a handle.
+   *
+   * @param[in] handle  Handle returned when the callback was registered.
+   *
+   * @return  True if the registration existed and was released.
+   *
+   * @tparam Datagram   Type of the datagram.
+   */
+  template < typename Datagram >
+  bool release_callback(callback_handle< Datagram > handle)
+  {
+    /* Check to the Datagram exists in the tuple. */
+    static_assert(exists< Datagram, Datagrams... >::value == true,
+                  "The provided datagram is not registered.");
+
+    return std::get< make_element< Datagram > >(_callbacks).remove(handle);
+  }
+
+  /**
+   * @brief   Checks if any callback is registered for a datagram.
+   *
+   * @tparam Datagram   Type of the datagram.
+   */
+  template < typename Datagram >
+  bool has_callbacks() const noexcept
+  {
+    /* Check to the Datagram exists in the tuple. */
+    static_assert(exists< Datagram, Datagrams... >::value == true,
+                  "The provided datagram is not registered.");
+
+    return !std::get< make_element< Datagram > >(_callbacks).empty();
+  }
+
   /**
    * @brief   Executes the callbacks related to a specific datagram.
    *
@@ -354,12 +839,11 @@ public:
   template < typename Datagram >
   void execute_callback(const Datagram& data)
   {
-    /* Get the corresponding datagram's mutex and lock it. */
-    std::lock_guard< std::mutex > lock(
-        std::get< make_element< Datagram > >(_callbacks).second);
+    /* Check to the Datagram exists in the tuple. */
+    static_assert(exists< Datagram, Datagrams... >::value == true,
+                  "The provided datagram is not registered.");
 
-    /* Call each callback. */
-    for (auto callback : std::get< make_element< Datagram > >(_callbacks).first)
-      callback(data);
+    /* Call each callback in the current snapshot, without locking. */
+    std::get< make_element< Datagram > >(_callbacks).execute(data);
   }
 };
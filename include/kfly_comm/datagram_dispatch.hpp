@@ -0,0 +1,201 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include "kfly_comm/commands.hpp"
+#include "kfly_comm/datagrams.hpp"
+#include "kfly_comm/datagram_traits.hpp"
+#include "kfly_comm/datagram_director.hpp"
+#include "kfly_comm/serializable_datagram.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   Datagram director with all the datagrams KFly can send or receive.
+ */
+using kfly_datagram_director = datagram_director<
+    datagrams::Ack, datagrams::Ping, datagrams::RunningMode,
+    datagrams::ManageSubscription, datagrams::SystemStrings,
+    datagrams::SystemStatus, datagrams::SetDeviceStrings,
+    datagrams::MotorOverride, datagrams::ControlSignals,
+    datagrams::ControllerReferences, datagrams::ControllerLimits,
+    datagrams::ArmSettings, datagrams::RateControllerData,
+    datagrams::AttitudeControllerData, datagrams::ChannelMix,
+    datagrams::RCInputSettings, datagrams::RCOutputSettings,
+    datagrams::RCValues, datagrams::IMUData, datagrams::RawIMUData,
+    datagrams::IMUCalibration, datagrams::EstimationAttitude,
+    datagrams::ControlFilterSettings, datagrams::ComputerControlReference,
+    datagrams::MotionCaptureFrame >;
+
+namespace details
+{
+/**
+ * @brief   Decodes a payload into a datagram and hands it to the sink.
+ *
+ * @tparam Sink       Type receiving the datagram, needs an
+ *                    execute_callback(const Datagram &) member.
+ * @tparam Datagram   The datagram to decode, void if the command carries none.
+ */
+template < typename Sink, typename Datagram >
+struct datagram_decoder
+{
+  /**
+   * @brief   Empty datagrams (Ack, Ping) carry no payload, it is ignored.
+   */
+  static void decode(Sink &sink, const uint8_t *, const std::size_t,
+                     std::true_type)
+  {
+    sink.execute_callback(Datagram{});
+  }
+
+  /**
+   * @brief   Non-empty datagrams are copied from the payload (may throw).
+   */
+  static void decode(Sink &sink, const uint8_t *payload,
+                     const std::size_t size, std::false_type)
+  {
+    sink.execute_callback(
+        serializable_datagram< Datagram >(payload, size).datagram);
+  }
+
+  /**
+   * @brief   Entry point of the dispatch table.
+   *
+   * @param[in] sink      Receiver of the decoded datagram.
+   * @param[in] payload   Pointer to the payload, without header and CRC.
+   * @param[in] size      Size of the payload in bytes.
+   */
+  static void decode(Sink &sink, const uint8_t *payload,
+                     const std::size_t size)
+  {
+    decode(sink, payload, size, std::is_empty< Datagram >{});
+  }
+
+  /**
+   * @brief   The function to place in the dispatch table.
+   */
+  static constexpr void (*value)(Sink &, const uint8_t *, const std::size_t) =
+      &decode;
+};
+
+/**
+ * @brief   Commands without a datagram get no entry in the dispatch table.
+ */
+template < typename Sink >
+struct datagram_decoder< Sink, void >
+{
+  static constexpr void (*value)(Sink &, const uint8_t *, const std::size_t) =
+      nullptr;
+};
+
+template < typename Sink, typename Datagram >
+constexpr void (*datagram_decoder< Sink, Datagram >::value)(
+    Sink &, const uint8_t *, const std::size_t);
+
+template < typename Sink >
+constexpr void (*datagram_decoder< Sink, void >::value)(Sink &,
+                                                        const uint8_t *,
+                                                        const std::size_t);
+
+/**
+ * @brief   Alias for the datagram type of a raw command byte.
+ */
+template < std::size_t Command >
+using command_datagram_t = typename command_traits::get_command_datagram<
+    static_cast< commands >(Command) >::type;
+
+/**
+ * @brief   Checks if a datagram is received by any of the 256 commands.
+ */
+template < typename Datagram, std::size_t... Commands >
+constexpr bool is_received(std::index_sequence< Commands... >)
+{
+  const bool received[] = {
+      std::is_same< Datagram, command_datagram_t< Commands > >::value...};
+
+  for (auto r : received)
+    if (r)
+      return true;
+
+  return false;
+}
+
+/**
+ * @brief   Meta function to check that every datagram registered in a
+ *          datagram director can be received by some command.
+ */
+template < typename Director >
+struct receives_all_datagrams;
+
+template < typename... Datagrams >
+struct receives_all_datagrams< datagram_director< Datagrams... > >
+{
+  static constexpr bool check()
+  {
+    const bool received[] = {
+        is_received< Datagrams >(std::make_index_sequence< 256 >{})...};
+
+    for (auto r : received)
+      if (!r)
+        return false;
+
+    return true;
+  }
+
+  static constexpr bool value = check();
+};
+}
+
+/**
+ * @brief   Compile time generated table from command byte to the decoder of
+ *          the corresponding datagram, built from
+ *          command_traits::get_command_datagram. Decoding a payload is a
+ *          single indexed indirect call, commands without a datagram have a
+ *          nullptr entry.
+ *
+ * @tparam Sink   Type receiving the decoded datagrams.
+ */
+template < typename Sink >
+struct datagram_dispatch
+{
+  /**
+   * @brief   Signature of the decoders in the table.
+   */
+  using decoder = void (*)(Sink &, const uint8_t *, const std::size_t);
+
+  template < std::size_t... Commands >
+  static constexpr std::array< decoder, 256 > make_table(
+      std::index_sequence< Commands... >)
+  {
+    return {{details::datagram_decoder<
+        Sink, details::command_datagram_t< Commands > >::value...}};
+  }
+
+  /**
+   * @brief   The dispatch table, indexed by the command byte.
+   */
+  static constexpr std::array< decoder, 256 > table =
+      make_table(std::make_index_sequence< 256 >{});
+};
+
+template < typename Sink >
+constexpr std::array< typename datagram_dispatch< Sink >::decoder, 256 >
+    datagram_dispatch< Sink >::table;
+
+/**
+ * @brief   Every registered datagram needs a command it is received through,
+ *          the opposite is checked by the datagram director when the
+ *          dispatch table is instantiated.
+ */
+static_assert(details::receives_all_datagrams< kfly_datagram_director >::value,
+              "A registered datagram has no receiving command, add it to "
+              "command_traits::get_command_datagram.");
+}
@@ -132,5 +132,350 @@ struct get_packet_command< datagrams::MotionCaptureFrame >
 {
 };
 
+/**
+ * @brief   Type traits to extract the datagram carried by a received command,
+ *          the datagram type is available in ::type. Commands which carry no
+ *          datagram have void as type.
+ *
+ * @tparam  Command     The command to get the datagram for.
+ */
+template < commands Command >
+struct get_command_datagram
+{
+  using type = void;
+};
+
+template <>
+struct get_command_datagram< commands::ACK >
+{
+  using type = datagrams::Ack;
+};
+
+template <>
+struct get_command_datagram< commands::Ping >
+{
+  using type = datagrams::Ping;
+};
+
+template <>
+struct get_command_datagram< commands::GetRunningMode >
+{
+  using type = datagrams::RunningMode;
+};
+
+template <>
+struct get_command_datagram< commands::ManageSubscriptions >
+{
+  using type = datagrams::ManageSubscription;
+};
+
+template <>
+struct get_command_datagram< commands::GetSystemStrings >
+{
+  using type = datagrams::SystemStrings;
+};
+
+template <>
+struct get_command_datagram< commands::GetSystemStatus >
+{
+  using type = datagrams::SystemStatus;
+};
+
+template <>
+struct get_command_datagram< commands::SetDeviceStrings >
+{
+  using type = datagrams::SetDeviceStrings;
+};
+
+template <>
+struct get_command_datagram< commands::MotorOverride >
+{
+  using type = datagrams::MotorOverride;
+};
+
+template <>
+struct get_command_datagram< commands::GetControllerReferences >
+{
+  using type = datagrams::ControllerReferences;
+};
+
+template <>
+struct get_command_datagram< commands::GetControlSignals >
+{
+  using type = datagrams::ControlSignals;
+};
+
+template <>
+struct get_command_datagram< commands::GetControllerLimits >
+{
+  using type = datagrams::ControllerLimits;
+};
+
+template <>
+struct get_command_datagram< commands::SetControllerLimits >
+{
+  using type = datagrams::ControllerLimits;
+};
+
+template <>
+struct get_command_datagram< commands::GetArmSettings >
+{
+  using type = datagrams::ArmSettings;
+};
+
+template <>
+struct get_command_datagram< commands::SetArmSettings >
+{
+  using type = datagrams::ArmSettings;
+};
+
+template <>
+struct get_command_datagram< commands::GetRateControllerData >
+{
+  using type = datagrams::RateControllerData;
+};
+
+template <>
+struct get_command_datagram< commands::SetRateControllerData >
+{
+  using type = datagrams::RateControllerData;
+};
+
+template <>
+struct get_command_datagram< commands::GetAttitudeControllerData >
+{
+  using type = datagrams::AttitudeControllerData;
+};
+
+template <>
+struct get_command_datagram< commands::SetAttitudeControllerData >
+{
+  using type = datagrams::AttitudeControllerData;
+};
+
+template <>
+struct get_command_datagram< commands::GetChannelMix >
+{
+  using type = datagrams::ChannelMix;
+};
+
+template <>
+struct get_command_datagram< commands::SetChannelMix >
+{
+  using type = datagrams::ChannelMix;
+};
+
+template <>
+struct get_command_datagram< commands::GetRCInputSettings >
+{
+  using type = datagrams::RCInputSettings;
+};
+
+template <>
+struct get_command_datagram< commands::SetRCInputSettings >
+{
+  using type = datagrams::RCInputSettings;
+};
+
+template <>
+struct get_command_datagram< commands::GetRCOutputSettings >
+{
+  using type = datagrams::RCOutputSettings;
+};
+
+template <>
+struct get_command_datagram< commands::SetRCOutputSettings >
+{
+  using type = datagrams::RCOutputSettings;
+};
+
+template <>
+struct get_command_datagram< commands::GetRCValues >
+{
+  using type = datagrams::RCValues;
+};
+
+template <>
+struct get_command_datagram< commands::GetIMUData >
+{
+  using type = datagrams::IMUData;
+};
+
+template <>
+struct get_command_datagram< commands::GetRawIMUData >
+{
+  using type = datagrams::RawIMUData;
+};
+
+template <>
+struct get_command_datagram< commands::GetIMUCalibration >
+{
+  using type = datagrams::IMUCalibration;
+};
+
+template <>
+struct get_command_datagram< commands::SetIMUCalibration >
+{
+  using type = datagrams::IMUCalibration;
+};
+
+template <>
+struct get_command_datagram< commands::GetEstimationAttitude >
+{
+  using type = datagrams::EstimationAttitude;
+};
+
+template <>
+struct get_command_datagram< commands::GetControlFilters >
+{
+  using type = datagrams::ControlFilterSettings;
+};
+
+template <>
+struct get_command_datagram< commands::SetControlFilters >
+{
+  using type = datagrams::ControlFilterSettings;
+};
+
+template <>
+struct get_command_datagram< commands::ComputerControlReference >
+{
+  using type = datagrams::ComputerControlReference;
+};
+
+template <>
+struct get_command_datagram< commands::MotionCaptureMeasurement >
+{
+  using type = datagrams::MotionCaptureFrame;
+};
+
+/**
+ * @brief   Type traits to extract the command which requests a datagram from
+ *          KFly, the command is available in ::value. KFly replies with the
+ *          datagram under the same command.
+ *
+ * @tparam  Datagram    The datagram to get the request command for.
+ */
+template < typename Datagram >
+struct get_request_command
+{
+  static_assert(always_false< Datagram >::value,
+                "This datagram cannot be requested from KFly.");
+};
+
+template <>
+struct get_request_command< datagrams::Ping >
+    : std::integral_constant< commands, commands::Ping >
+{
+};
+
+template <>
+struct get_request_command< datagrams::RunningMode >
+    : std::integral_constant< commands, commands::GetRunningMode >
+{
+};
+
+template <>
+struct get_request_command< datagrams::SystemStrings >
+    : std::integral_constant< commands, commands::GetSystemStrings >
+{
+};
+
+template <>
+struct get_request_command< datagrams::SystemStatus >
+    : std::integral_constant< commands, commands::GetSystemStatus >
+{
+};
+
+template <>
+struct get_request_command< datagrams::ControllerReferences >
+    : std::integral_constant< commands, commands::GetControllerReferences >
+{
+};
+
+template <>
+struct get_request_command< datagrams::ControlSignals >
+    : std::integral_constant< commands, commands::GetControlSignals >
+{
+};
+
+template <>
+struct get_request_command< datagrams::ControllerLimits >
+    : std::integral_constant< commands, commands::GetControllerLimits >
+{
+};
+
+template <>
+struct get_request_command< datagrams::ArmSettings >
+    : std::integral_constant< commands, commands::GetArmSettings >
+{
+};
+
+template <>
+struct get_request_command< datagrams::RateControllerData >
+    : std::integral_constant< commands, commands::GetRateControllerData >
+{
+};
+
+template <>
+struct get_request_command< datagrams::AttitudeControllerData >
+    : std::integral_constant< commands, commands::GetAttitudeControllerData >
+{
+};
+
+template <>
+struct get_request_command< datagrams::ChannelMix >
+    : std::integral_constant< commands, commands::GetChannelMix >
+{
+};
+
+template <>
+struct get_request_command< datagrams::RCInputSettings >
+    : std::integral_constant< commands, commands::GetRCInputSettings >
+{
+};
+
+template <>
+struct get_request_command< datagrams::RCOutputSettings >
+    : std::integral_constant< commands, commands::GetRCOutputSettings >
+{
+};
+
+template <>
+struct get_request_command< datagrams::RCValues >
+    : std::integral_constant< commands, commands::GetRCValues >
+{
+};
+
+template <>
+struct get_request_command< datagrams::IMUData >
+    : std::integral_constant< commands, commands::GetIMUData >
+{
+};
+
+template <>
+struct get_request_command< datagrams::RawIMUData >
+    : std::integral_constant< commands, commands::GetRawIMUData >
+{
+};
+
+template <>
+struct get_request_command< datagrams::IMUCalibration >
+    : std::integral_constant< commands, commands::GetIMUCalibration >
+{
+};
+
+template <>
+struct get_request_command< datagrams::EstimationAttitude >
+    : std::integral_constant< commands, commands::GetEstimationAttitude >
+{
+};
+
+template <>
+struct get_request_command< datagrams::ControlFilterSettings >
+    : std::integral_constant< commands, commands::GetControlFilters >
+{
+};
+
 } /* END command_traits*/
 }
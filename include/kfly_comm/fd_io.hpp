@@ -0,0 +1,207 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/types.h>
+
+namespace kfly_comm
+{
+class link_statistics;
+
+/**
+ * @brief   File descriptor helpers shared by the Linux I/O engines,
+ *          serial_link, link_manager, tx_scheduler and the simulator.
+ */
+namespace details
+{
+/**
+ * @brief   Throws the current errno as a std::system_error.
+ */
+[[noreturn]] void throw_errno(const char *what);
+
+/**
+ * @brief   Makes a file descriptor non-blocking.
+ *
+ * @note    Throws std::system_error on failure, the descriptor is left
+ *          open.
+ */
+void set_nonblocking(int fd);
+
+/**
+ * @brief   An eventfd used to wake an I/O thread out of its poll.
+ */
+class wake_event
+{
+private:
+  int _fd;
+
+public:
+  /**
+   * @brief   Creates the non-blocking eventfd.
+   *
+   * @note    Throws std::system_error on failure.
+   */
+  wake_event();
+
+  ~wake_event();
+
+  wake_event(const wake_event &) = delete;
+  wake_event &operator=(const wake_event &) = delete;
+
+  /**
+   * @brief   Wakes the thread polling the event.
+   */
+  void signal() noexcept;
+
+  /**
+   * @brief   Resets the event after a wake up.
+   */
+  void clear() noexcept;
+
+  /**
+   * @brief   The file descriptor to poll for POLLIN.
+   */
+  int native_handle() const noexcept
+  {
+    return _fd;
+  }
+};
+
+/**
+ * @brief   Result of read_available.
+ */
+enum class read_status
+{
+  /** @brief All available bytes were read. */
+  drained,
+
+  /** @brief Closed by the other side. */
+  closed,
+
+  /** @brief Failed, errno holds the error. */
+  failed
+};
+
+/**
+ * @brief   Reads a non-blocking file descriptor until it is drained.
+ *
+ * @param[in] fd        The file descriptor.
+ * @param[in] buffer    Buffer to read chunks into.
+ * @param[in] consume   Called with each chunk read.
+ */
+template < typename Consume >
+read_status read_available(int fd, std::vector< uint8_t > &buffer,
+                           Consume &&consume)
+{
+  while (true)
+  {
+    const ssize_t n = read(fd, buffer.data(), buffer.size());
+
+    if (n > 0)
+    {
+      consume(buffer.data(), static_cast< std::size_t >(n));
+
+      /* A short read means the descriptor is drained. */
+      if (static_cast< std::size_t >(n) < buffer.size())
+        return read_status::drained;
+    }
+    else if (n == 0)
+    {
+      return read_status::closed;
+    }
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+      return read_status::drained;
+    }
+    else if (errno != EINTR)
+    {
+      return read_status::failed;
+    }
+  }
+}
+
+/**
+ * @brief   Messages waiting to be written to a non-blocking file
+ *          descriptor, gathered into writev calls. Each message holds
+ *          whole SLIP frames, counted as transmitted once written.
+ *
+ * @note    Not thread safe, the owner guards it.
+ */
+class tx_queue
+{
+private:
+  /** @brief The messages, in order. */
+  std::deque< std::vector< uint8_t > > _messages;
+
+  /** @brief Bytes of the first message already written. */
+  std::size_t _offset;
+
+  /** @brief Counters of the written frames, nullptr for none. */
+  link_statistics *const _statistics;
+
+public:
+  /**
+   * @brief   Constructor.
+   *
+   * @param[in] statistics  Counters the written frames are recorded in,
+   *                        e.g. the statistics() of the link's codec.
+   */
+  explicit tx_queue(link_statistics *statistics = nullptr)
+      : _offset(0), _statistics(statistics)
+  {
+  }
+
+  /**
+   * @brief   Queues a message.
+   */
+  void push(std::vector< uint8_t > message)
+  {
+    _messages.emplace_back(std::move(message));
+  }
+
+  /**
+   * @brief   Checks if all messages have been written.
+   */
+  bool empty() const noexcept
+  {
+    return _messages.empty();
+  }
+
+  /**
+   * @brief   Writes as much of the queue as the file descriptor accepts.
+   *
+   * @param[in] fd    The file descriptor.
+   *
+   * @return  The number of bytes written, or -1 with errno set if the
+   *          descriptor failed.
+   */
+  ssize_t flush(int fd);
+};
+
+/**
+ * @brief   Enables or disables EPOLLOUT of a descriptor watched for
+ *          EPOLLIN, so a thread only wakes on writability while it has
+ *          data pending.
+ *
+ * @param[in] epoll_fd    The epoll instance.
+ * @param[in] fd          The watched descriptor.
+ * @param[in] data        The epoll data of the descriptor.
+ * @param[in] pending     If data is pending.
+ * @param[in,out] waiting If EPOLLOUT is enabled, updated.
+ */
+void watch_writable(int epoll_fd, int fd, uint64_t data, bool pending,
+                    bool &waiting);
+}  // namespace details
+}  // namespace kfly_comm
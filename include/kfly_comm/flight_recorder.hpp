@@ -0,0 +1,383 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Threading includes */
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/* KFly includes */
+#include "kfly_comm/kfly_comm.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   On-disk layout of flight recordings.
+ *
+ * @details A recording is a file_header followed by records. Each record is
+ *          a record_header followed by length bytes: a raw KFly frame
+ *          (command, size, payload and CRC) for received and transmitted
+ *          frames, or an index_block. An index block is appended whenever
+ *          index_interval bytes have been written since the previous one and
+ *          summarizes the records in between, so a reader can seek by time
+ *          or skip parts without a command of interest. All fields are in
+ *          host byte order.
+ */
+namespace recording
+{
+/** @brief Magic at the start of a recording. */
+constexpr char magic[8] = {'K', 'F', 'L', 'Y', 'R', 'E', 'C', '1'};
+
+/** @brief Format version. */
+constexpr uint32_t version = 1;
+
+/**
+ * @brief   Direction of a record.
+ */
+enum class direction : uint8_t
+{
+  rx    = 0,
+  tx    = 1,
+  index = 0xff
+};
+
+#pragma pack(push, 1)
+
+/**
+ * @brief   Header at the start of the file.
+ */
+struct file_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+
+  /** @brief Bytes between the index blocks. */
+  uint64_t index_interval;
+
+  /** @brief steady_clock time when the recording started, in ns. */
+  int64_t start_steady_ns;
+
+  /** @brief system_clock time when the recording started, in ns. */
+  int64_t start_system_ns;
+
+  uint8_t reserved[24];
+};
+
+/**
+ * @brief   Header of each record.
+ */
+struct record_header
+{
+  /** @brief steady_clock time of the record, in ns. */
+  int64_t timestamp_ns;
+
+  /** @brief Source (vehicle) the frame belongs to. */
+  uint16_t source;
+
+  /** @brief A recording::direction. */
+  uint8_t direction;
+
+  uint8_t reserved;
+
+  /** @brief Number of bytes following the header. */
+  uint16_t length;
+
+  uint16_t reserved2;
+};
+
+/**
+ * @brief   Summary of the records since the previous index block.
+ */
+struct index_block
+{
+  /** @brief File offset of the first summarized record. */
+  uint64_t first_offset;
+
+  /** @brief Timestamp of the first and last summarized record, in ns. */
+  int64_t first_timestamp_ns;
+  int64_t last_timestamp_ns;
+
+  /** @brief Number of summarized records. */
+  uint64_t records;
+
+  /** @brief Bit n is set if command n is in the summarized records. */
+  uint8_t commands[32];
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(file_header) == 64, "Unexpected file header size.");
+static_assert(sizeof(record_header) == 16, "Unexpected record header size.");
+}
+
+/**
+ * @brief   Settings of a flight_recorder.
+ */
+struct flight_recorder_options
+{
+  /** @brief Size of each write buffer, a multiple of 4096. */
+  std::size_t buffer_size = 1 << 20;
+
+  /** @brief Number of write buffers. */
+  std::size_t buffer_count = 4;
+
+  /** @brief Bytes between the index blocks. */
+  std::size_t index_interval = 4 << 20;
+
+  /** @brief Write with O_DIRECT, bypassing the page cache. */
+  bool direct_io = false;
+};
+
+/**
+ * @brief   Counters of a flight_recorder.
+ */
+struct flight_recorder_stats
+{
+  /** @brief Records written, not counting the index blocks. */
+  uint64_t records;
+
+  /** @brief Bytes written to the file. */
+  uint64_t bytes;
+
+  /** @brief Records dropped as all buffers were waiting to be written, or
+   *         as they were larger than a buffer. */
+  uint64_t dropped;
+
+  /** @brief Index blocks written. */
+  uint64_t index_blocks;
+};
+
+/**
+ * @brief     Records the frames crossing one or more links to an append-only
+ *            file.
+ *
+ * @details   Frames are copied into a large buffer, which is handed to a
+ *            background thread for writing when full. Recording a frame is
+ *            a short copy under a lock and never waits for the disk; if all
+ *            buffers are waiting to be written the frame is dropped and
+ *            counted. Received frames are tapped from attached codecs,
+ *            transmitted frames are recorded with record_tx.
+ *
+ * @note      Linux only. Throws std::system_error if the file cannot be
+ *            created.
+ */
+class flight_recorder
+{
+private:
+  class source_tap;
+
+  /** @brief Settings. */
+  const flight_recorder_options _options;
+
+  /** @brief The file. */
+  int _fd;
+
+  /** @brief Guards the buffers, queue, offsets and the index. */
+  std::mutex _lock;
+  std::condition_variable _cv;
+
+  /**
+   * @brief   A write buffer, aligned for O_DIRECT.
+   */
+  struct buffer
+  {
+    std::unique_ptr< uint8_t, void (*)(void *) > data;
+    std::size_t size;
+  };
+
+  /** @brief The buffer being filled. */
+  buffer _active;
+
+  /** @brief Buffers free to be filled. */
+  std::vector< buffer > _free;
+
+  /** @brief Buffers waiting to be written. */
+  std::deque< buffer > _queue;
+
+  /** @brief Logical file size including the active buffer. */
+  uint64_t _offset;
+
+  /** @brief Offset of the end of the previous index block. */
+  uint64_t _index_start;
+
+  /** @brief Index of the records since the previous index block. */
+  recording::index_block _index;
+
+  /** @brief Attached codecs, guarded by their own lock. */
+  std::vector< std::unique_ptr< source_tap > > _taps;
+  std::mutex _taps_lock;
+
+  /** @brief Counters. */
+  std::atomic< uint64_t > _records;
+  std::atomic< uint64_t > _bytes;
+  std::atomic< uint64_t > _dropped;
+  std::atomic< uint64_t > _index_blocks;
+
+  /** @brief The writer thread. */
+  std::thread _thread;
+  bool _running;
+
+  /** @brief Error of the writer, 0 if none. */
+  std::atomic< int > _error;
+
+  /**
+   * @brief   Checks if bytes can be appended without waiting, lock held.
+   */
+  bool reserve(std::size_t size) const noexcept;
+
+  /**
+   * @brief   Appends reserved bytes to the active buffer, lock held.
+   */
+  void append(const void *data, std::size_t size);
+
+  /**
+   * @brief   Appends an index block, lock held.
+   */
+  void append_index();
+
+  /**
+   * @brief   Hands the active buffer to the writer, lock held. A free buffer
+   *          must be available.
+   */
+  void hand_off();
+
+  /**
+   * @brief   The writer thread.
+   */
+  void run();
+
+  /**
+   * @brief   Records a frame with room for the CRC at the end, the CRC is
+   *          computed over the command without the ack bit.
+   */
+  bool record_tx_frame(uint8_t *frame, std::size_t size, bool ack,
+                       uint16_t source);
+
+public:
+  /**
+   * @brief   Constructor, creates the file and starts the writer.
+   *
+   * @param[in] file      Path of the recording, truncated if it exists.
+   * @param[in] options   Settings.
+   */
+  explicit flight_recorder(
+      const std::string &file,
+      const flight_recorder_options &options = flight_recorder_options());
+
+  /**
+   * @brief   Destructor, detaches the codecs and writes all records.
+   */
+  ~flight_recorder();
+
+  flight_recorder(const flight_recorder &) = delete;
+  flight_recorder &operator=(const flight_recorder &) = delete;
+
+  /**
+   * @brief   Records the frames received by a codec.
+   *
+   * @param[in] c       The codec, must outlive the recorder or be detached.
+   * @param[in] source  Source number stored with its records.
+   */
+  void attach(codec &c, uint16_t source = 0);
+
+  /**
+   * @brief   Stops recording the frames received by a codec.
+   *
+   * @param[in] c       The codec.
+   */
+  void detach(codec &c);
+
+  /**
+   * @brief   Records a raw frame.
+   *
+   * @param[in] dir         Direction of the frame.
+   * @param[in] source      Source number of the frame.
+   * @param[in] frame       The frame, command, size, payload and CRC.
+   * @param[in] size        Size of the frame in bytes.
+   * @param[in] timestamp   Time the frame crossed the link.
+   *
+   * @return  False if the frame was dropped, frames larger than a buffer
+   *          are always dropped.
+   */
+  bool record(recording::direction dir, uint16_t source, const uint8_t *frame,
+              std::size_t size,
+              std::chrono::steady_clock::time_point timestamp =
+                  std::chrono::steady_clock::now());
+
+  /**
+   * @brief   Records a transmitted datagram, as framed by generate_packet.
+   *
+   * @param[in] datagram  The datagram sent.
+   * @param[in] ack       If an ack was requested.
+   * @param[in] source    Source number of the frame.
+   *
+   * @return  False if the frame was dropped.
+   */
+  template < typename Datagram >
+  bool record_tx(const Datagram &datagram, bool ack = false,
+                 uint16_t source = 0)
+  {
+    static_assert(sizeof(Datagram) <= 255, "Datagram too large.");
+
+    const uint8_t cmd = static_cast< uint8_t >(
+        command_traits::get_packet_command< Datagram >::value);
+
+    uint8_t frame[sizeof(Datagram) + 4];
+    frame[0] = cmd;
+    frame[1] = sizeof(Datagram);
+    std::memcpy(frame + 2, &datagram, sizeof(Datagram));
+
+    return record_tx_frame(frame, sizeof(frame), ack, source);
+  }
+
+  /**
+   * @brief   Records a transmitted command, as framed by generate_command.
+   *
+   * @param[in] command   The command sent.
+   * @param[in] ack       If an ack was requested.
+   * @param[in] source    Source number of the frame.
+   *
+   * @return  False if the frame was dropped.
+   */
+  bool record_tx_command(commands command, bool ack = false,
+                         uint16_t source = 0);
+
+  /**
+   * @brief   Hands the buffered records to the writer thread.
+   *
+   * @note    With O_DIRECT only whole 4096 byte blocks are written, the
+   *          rest waits for more records or the destructor.
+   */
+  void flush();
+
+  /**
+   * @brief   Reads the counters.
+   */
+  flight_recorder_stats stats() const noexcept;
+
+  /**
+   * @brief   The error of the writer (an errno value), 0 if none.
+   */
+  int error() const noexcept
+  {
+    return _error.load(std::memory_order_relaxed);
+  }
+};
+
+}  // namespace kfly_comm
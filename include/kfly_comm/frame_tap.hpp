@@ -0,0 +1,42 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace kfly_comm
+{
+/**
+ * @brief   Interface for observing the raw frames a codec receives.
+ *
+ * @details A tap sees every frame which passed the length and CRC checks,
+ *          SLIP decoded and including header and CRC, before it is decoded
+ *          into a datagram. This includes commands without a datagram.
+ *
+ * @note    on_frame is called from the parsing thread with the parser lock
+ *          held, it should only copy the frame.
+ */
+class frame_tap
+{
+public:
+  virtual ~frame_tap()
+  {
+  }
+
+  /**
+   * @brief   Called for each verified frame.
+   *
+   * @param[in] frame       Pointer to the frame.
+   * @param[in] size        Size of the frame in bytes.
+   * @param[in] timestamp   Time the frame was received.
+   */
+  virtual void on_frame(const uint8_t *frame, const std::size_t size,
+                        std::chrono::steady_clock::time_point timestamp) = 0;
+};
+
+}  // namespace kfly_comm
@@ -7,16 +7,17 @@
 
 /* Data includes */
 #include <vector>
+#include <algorithm>
 #include <cstdint>
+#include <cstddef>
 #include <map>
 #include <memory>
+#include <chrono>
 
 /* Threading includes */
 #include <mutex>
 
 /* Library includes */
-#include "cppSLIP/slip.h"
-//#include "cobs/cobs.h"
 #include "kfly_comm/datagram_director.hpp"
 #include "kfly_comm/serializable_datagram.hpp"
 
@@ -25,12 +26,41 @@
 #include "kfly_comm/datagrams.hpp"
 #include "kfly_comm/crc.hpp"
 #include "kfly_comm/packet.hpp"
+#include "kfly_comm/command_frames.hpp"
 #include "kfly_comm/datagram_traits.hpp"
+#include "kfly_comm/datagram_dispatch.hpp"
+#include "kfly_comm/tx_buffer.hpp"
+#include "kfly_comm/rx_consumer.hpp"
+#include "kfly_comm/latest_cache.hpp"
+#include "kfly_comm/frame_tap.hpp"
+#include "kfly_comm/link_statistics.hpp"
+#include "kfly_comm/trace.hpp"
 
 namespace kfly_comm
 {
 /** @brief Definition of the parser type. */
-using kfly_parser = SLIP::SLIP;
+using kfly_parser = slip::decoder< max_frame_size >;
+
+/**
+ * @brief   Summary of a parse call.
+ */
+struct parse_result
+{
+  /** @brief Packets which passed the size and CRC checks. */
+  std::size_t packets;
+
+  /** @brief Packets dropped due to a CRC mismatch. */
+  std::size_t crc_errors;
+
+  /** @brief Packets dropped due to a wrong length or payload size. */
+  std::size_t size_errors;
+
+  /**
+   * @brief Bytes up to and including the end of the last complete packet,
+   *        the rest is kept by the parser as a partial packet.
+   */
+  std::size_t bytes_consumed;
+};
 
 class codec
 {
@@ -44,37 +74,89 @@ private:
   /** @brief Lock for the parser. */
   std::mutex _parser_lock;
 
+  /** @brief Summary of the current parse call, protected by the parser lock. */
+  parse_result _parse_result;
+
   /** @brief Datagram director for the callbacks and registered datagrams. */
-  datagram_director<
-      datagrams::Ack, datagrams::Ping, datagrams::RunningMode,
-      datagrams::ManageSubscription, datagrams::SystemStrings,
-      datagrams::SystemStatus, datagrams::SetDeviceStrings,
-      datagrams::MotorOverride, datagrams::ControlSignals,
-      datagrams::ControllerReferences, datagrams::ControllerLimits,
-      datagrams::ArmSettings, datagrams::RateControllerData,
-      datagrams::AttitudeControllerData, datagrams::ChannelMix,
-      datagrams::RCInputSettings, datagrams::RCOutputSettings,
-      datagrams::RCValues, datagrams::IMUData, datagrams::RawIMUData,
-      datagrams::IMUCalibration, datagrams::EstimationAttitude,
-      datagrams::ControlFilterSettings, datagrams::ComputerControlReference,
-      datagrams::MotionCaptureFrame >
-      _callbacks;
-
-  /**
-   * @brief   Parses a payload and, if correct, runs executeCallbacks.
+  kfly_datagram_director _callbacks;
+
+  /** @brief Latest value of each datagram, written by the parser. */
+  details::latest_cache< kfly_datagram_director > _latest;
+
+  /** @brief Receive time of the packet being decoded. */
+  std::chrono::steady_clock::time_point _rx_timestamp;
+
+  /** @brief Consumers receiving through rings, protected by the parser lock. */
+  std::vector< rx_consumer * > _consumers;
+
+  /** @brief Observers of the verified frames, protected by the parser lock. */
+  std::vector< frame_tap * > _taps;
+
+  /** @brief Counters of the link, written by the parser and transmitters. */
+  link_statistics _statistics;
+
+  /** @brief Frames until the next callback time sample. */
+  uint32_t _callback_sample_countdown;
+
+  /** @brief The decoders need access to execute_callback. */
+  template < typename, typename >
+  friend struct details::datagram_decoder;
+
+  /** @brief Consumers attach and detach themselves. */
+  friend class rx_consumer;
+
+  /**
+   * @brief   Updates the latest value of a decoded datagram, executes its
+   *          callbacks and queues it to the attached consumers.
    *
-   * @param[in] payload   The payload to be parsed.
+   * @param[in] datagram  The received datagram.
+   */
+  template < typename Datagram >
+  void execute_callback(const Datagram &datagram)
+  {
+    KFLY_COMM_TRACE_SCOPE(trace::stage::callback);
+
+    _latest.store(datagram, _rx_timestamp);
+    _callbacks.execute_callback(datagram);
+
+    for (auto consumer : _consumers)
+      consumer->push(datagram);
+  }
+
+  /**
+   * @brief   Attaches a consumer, it is fed from the parser from now on.
+   *
+   * @param[in] consumer  The consumer to attach.
+   */
+  void attach(rx_consumer &consumer);
+
+  /**
+   * @brief   Detaches a consumer.
+   *
+   * @param[in] consumer  The consumer to detach.
+   */
+  void detach(rx_consumer &consumer);
+
+  /**
+   * @brief   Parses a SLIP decoded frame and, if correct, runs
+   *          executeCallbacks. Works directly on the parser's output buffer,
+   *          no copies are made of the frame.
+   *
+   * @param[in] frame     Pointer to the frame to be parsed.
+   * @param[in] size      Size of the frame in bytes, including header and CRC.
    */
-  void parse_packet(const std::vector< uint8_t > &payload);
+  void parse_packet(const uint8_t *frame, const std::size_t size);
 
   /**
-   * @brief   Checks the command to apply the proper structure.
+   * @brief   Decodes the payload through the dispatch table, commands
+   *          without a datagram are dropped and counted as unknown.
    *
    * @param[in] cmd       Command byte from the packet.
-   * @param[in] payload   The payload to be parsed, without header and CRC.
+   * @param[in] payload   Pointer to the payload, without header and CRC.
+   * @param[in] size      Size of the payload in bytes.
    */
-  void transmit_datagram(const uint8_t cmd,
-                         const std::vector< uint8_t > &payload);
+  void transmit_datagram(const uint8_t cmd, const uint8_t *payload,
+                         const std::size_t size);
 
 public:
   codec();
@@ -86,12 +168,50 @@ public:
    *
    * @param[in] callback  The function to register.
    *
-   * @note    Shall be of the form void(kfly_comm::datagrams::xxx).
+   * @return  Handle to the registration, for release_callback.
+   *
+   * @note    Shall be of the form void(const kfly_comm::datagrams::xxx &), or
+   *          void(kfly_comm::datagrams::xxx) which copies the datagram.
+   */
+  template < typename Datagram >
+  callback_handle< Datagram > register_callback(
+      void (*callback)(Datagram))
+  {
+    return _callbacks.register_callback(callback);
+  }
+
+  /**
+   * @brief   Register a callback.
+   *
+   * @param[in] callback  The function to register.
+   *
+   * @return  Handle to the registration, for release_callback.
+   *
+   * @note    Shall be of the form void(const kfly_comm::datagrams::xxx &).
    */
   template < typename Datagram >
-  void register_callback(void (*callback)(Datagram))
+  callback_handle< Datagram > register_callback(
+      void (*callback)(const Datagram &))
+  {
+    return _callbacks.register_callback(callback);
+  }
+
+  /**
+   * @brief   Register a callback.
+   *
+   * @param[in] object    The object owning the method.
+   * @param[in] callback  The method to register.
+   *
+   * @return  Handle to the registration, for release_callback.
+   *
+   * @note    Shall be of the form void(const kfly_comm::datagrams::xxx &), or
+   *          void(kfly_comm::datagrams::xxx) which copies the datagram.
+   */
+  template < class Object, typename Datagram >
+  callback_handle< Datagram > register_callback(
+      Object *obj, void (Object::*callback)(Datagram))
   {
-    _callbacks.register_callback(callback);
+    return _callbacks.register_callback(obj, callback);
   }
 
   /**
@@ -100,12 +220,15 @@ public:
    * @param[in] object    The object owning the method.
    * @param[in] callback  The method to register.
    *
-   * @note    Shall be of the form void(kfly_comm::datagrams::xxx).
+   * @return  Handle to the registration, for release_callback.
+   *
+   * @note    Shall be of the form void(const kfly_comm::datagrams::xxx &).
    */
   template < class Object, typename Datagram >
-  void register_callback(Object *obj, void (Object::*callback)(Datagram))
+  callback_handle< Datagram > register_callback(
+      Object *obj, void (Object::*callback)(const Datagram &))
   {
-    _callbacks.register_callback(obj, callback);
+    return _callbacks.register_callback(obj, callback);
   }
 
   /**
@@ -119,6 +242,17 @@ public:
     _callbacks.release_callback(callback);
   }
 
+  /**
+   * @brief   Unregister a callback from the queue.
+   *
+   * @param[in] callback  The function to release.
+   */
+  template < typename Datagram >
+  void release_callback(void (*callback)(const Datagram &))
+  {
+    _callbacks.release_callback(callback);
+  }
+
   /**
    * @brief   Unregister a callback from the queue.
    *
@@ -131,19 +265,111 @@ public:
     _callbacks.release_callback(obj, callback);
   }
 
+  /**
+   * @brief   Unregister a callback from the queue.
+   *
+   * @param[in] object    The object owning the method.
+   * @param[in] callback  The method to release.
+   */
+  template < class Object, typename Datagram >
+  void release_callback(Object *obj,
+                        void (Object::*callback)(const Datagram &))
+  {
+    _callbacks.release_callback(obj, callback);
+  }
+
+  /**
+   * @brief   Unregister the callback of a registration.
+   *
+   * @param[in] handle    Handle returned by register_callback.
+   *
+   * @return  True if the registration existed and was released.
+   */
+  template < typename Datagram >
+  bool release_callback(callback_handle< Datagram > handle)
+  {
+    return _callbacks.release_callback(handle);
+  }
+
+  /**
+   * @brief   The counters of the link. Received frames are counted by the
+   *          parser, transmitted frames by whoever writes them (serial_link,
+   *          link_manager and tx_scheduler do, once written) through
+   *          link_statistics::tx_encoded.
+   */
+  link_statistics &statistics() noexcept
+  {
+    return _statistics;
+  }
+
+  /**
+   * @brief   Copies the counters of the link, lock-free.
+   */
+  link_snapshot statistics_snapshot() const noexcept
+  {
+    return _statistics.snapshot();
+  }
+
+  /**
+   * @brief   Adds an observer of the raw verified frames.
+   *
+   * @param[in] tap   The tap, must be removed before it is destroyed.
+   */
+  void add_frame_tap(frame_tap &tap);
+
+  /**
+   * @brief   Removes an observer of the raw verified frames.
+   *
+   * @param[in] tap   The tap to remove.
+   */
+  void remove_frame_tap(frame_tap &tap);
+
+  /**
+   * @brief   The most recently received value of a datagram.
+   *
+   * @details Reads a seqlock protected copy kept by the parser, it never
+   *          blocks the parser and takes no lock, so it can be polled from
+   *          a control loop running at any rate.
+   *
+   * @return  The datagram, how many have been received and when the last
+   *          one was received.
+   */
+  template < typename Datagram >
+  latest_value< Datagram > latest() const noexcept
+  {
+    return _latest.load< Datagram >();
+  }
+
   /**
    * @brief   Input function for a KFly message, goes to the SLIP parser.
    *
-   * @param[in] payload   The payload to be parsed.
+   * @param[in] data      The byte to be parsed.
+   *
+   * @return  Summary of the packets completed by the byte.
    */
-  void parse(const uint8_t data);
+  parse_result parse(const uint8_t data);
 
   /**
    * @brief   Input function for a KFly message, goes to the SLIP parser.
    *
    * @param[in] payload   The payload to be parsed.
+   *
+   * @return  Summary of the packets decoded from the payload.
    */
-  void parse(const std::vector< uint8_t > &payload);
+  parse_result parse(const std::vector< uint8_t > &payload);
+
+  /**
+   * @brief   Input function for a buffer of KFly messages, e.g. a whole
+   *          read() from the serial port. All complete packets are framed,
+   *          verified and dispatched under a single lock acquisition,
+   *          without allocations.
+   *
+   * @param[in] data      Pointer to the bytes to be parsed.
+   * @param[in] size      Number of bytes to be parsed.
+   *
+   * @return  Summary of the packets decoded from the buffer.
+   */
+  parse_result parse(const uint8_t *data, const std::size_t size);
 
   /**
    * @brief   Converts a Datagram to a byte message for transmission.
@@ -161,11 +387,60 @@ public:
         command_traits::get_packet_command< Datagram >::value, datagram, ack);
 
     std::vector< uint8_t > out;
-    kfly_parser::encode(packet.payload, out);
+    slip::encode_frame(packet.payload, out);
 
     return out;
   }
 
+  /**
+   * @brief   Converts a Datagram to a byte message for transmission, encoded
+   *          straight into a caller provided buffer without allocations.
+   *
+   * @param[in]  datagram  The Datagram payload to be converted.
+   * @param[out] out       The output buffer.
+   * @param[in]  capacity  Size of the output buffer, needs to be at least
+   *                       max_encoded_size< Datagram >::value (may throw).
+   * @param[in]  ack       If true, then an ack is requested.
+   *
+   * @return The number of bytes written.
+   */
+  template < typename Datagram >
+  static std::size_t generate_packet_into(const Datagram &datagram,
+                                          uint8_t *out,
+                                          const std::size_t capacity,
+                                          bool ack = false)
+  {
+    return encode_packet(
+        command_traits::get_packet_command< Datagram >::value, datagram, ack,
+        out, capacity);
+  }
+
+  /**
+   * @brief   Converts a command (no datagram) to a byte message for
+   *          transmission, encoded straight into a caller provided buffer.
+   *
+   * @param[in]  command   The command to send.
+   * @param[out] out       The output buffer.
+   * @param[in]  capacity  Size of the output buffer, needs to be at least
+   *                       max_encoded_size< datagrams::Ack, false >::value
+   *                       (may throw).
+   * @param[in]  ack       If true, then an ack is requested.
+   *
+   * @return The number of bytes written.
+   */
+  static std::size_t generate_command_into(commands command, uint8_t *out,
+                                           const std::size_t capacity,
+                                           bool ack = false)
+  {
+    if (capacity < max_encoded_size< datagrams::Ack, false >::value)
+      throw std::invalid_argument("Buffer is too small for the packet.");
+
+    const auto &frame = command_frame_for(command, ack);
+    std::copy(frame.begin(), frame.end(), out);
+
+    return frame.size;
+  }
+
   /**
    * @brief   Generate a subscription for KFly.
    *
@@ -222,9 +497,17 @@ public:
    * @param[in] ack       If true, then an ack is requested.
    *
    * @return A vector that holds the generated message.
+   *
+   * @note    Copies the pre-encoded frame, command_frame_for gives the same
+   *          bytes without the copy.
    */
   static std::vector< uint8_t > generate_command(commands command,
-                                                 bool ack = false);
+                                                 bool ack = false)
+  {
+    const auto &frame = command_frame_for(command, ack);
+
+    return std::vector< uint8_t >(frame.begin(), frame.end());
+  }
 };
 
 }  // namespace KFlyTelemetry
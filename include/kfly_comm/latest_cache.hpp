@@ -0,0 +1,106 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include "kfly_comm/datagram_director.hpp"
+#include "kfly_comm/seqlock.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   The most recently received value of a datagram.
+ *
+ * @tparam Datagram   Type of the datagram.
+ */
+template < typename Datagram >
+struct latest_value
+{
+  /** @brief The datagram, value initialized if none has been received. */
+  Datagram datagram;
+
+  /** @brief Number of datagrams of the type received, 0 if none. */
+  uint64_t sequence;
+
+  /** @brief Time the packet was received. */
+  std::chrono::steady_clock::time_point timestamp;
+
+  /**
+   * @brief   Checks if any datagram has been received.
+   */
+  bool received() const noexcept
+  {
+    return sequence != 0;
+  }
+};
+
+namespace details
+{
+/**
+ * @brief   The data kept in the seqlock of a datagram.
+ */
+template < typename Datagram >
+struct latest_entry
+{
+  Datagram datagram;
+  std::chrono::steady_clock::rep timestamp;
+};
+
+/**
+ * @brief   Seqlock protected latest value of every datagram in a datagram
+ *          director's type list.
+ */
+template < typename Director >
+class latest_cache;
+
+template < typename... Datagrams >
+class latest_cache< datagram_director< Datagrams... > >
+{
+private:
+  /** @brief One seqlock per datagram type. */
+  std::tuple< seqlock< latest_entry< Datagrams > >... > _values;
+
+public:
+  /**
+   * @brief   Stores a received datagram, wait-free.
+   *
+   * @param[in] datagram    The received datagram.
+   * @param[in] timestamp   Time the packet was received.
+   *
+   * @note    Only one thread may store at a time.
+   */
+  template < typename Datagram >
+  void store(const Datagram &datagram,
+             std::chrono::steady_clock::time_point timestamp) noexcept
+  {
+    std::get< seqlock< latest_entry< Datagram > > >(_values)
+        .store(latest_entry< Datagram >{datagram,
+                                        timestamp.time_since_epoch().count()});
+  }
+
+  /**
+   * @brief   Reads the latest value of a datagram, never blocks the writer.
+   */
+  template < typename Datagram >
+  latest_value< Datagram > load() const noexcept
+  {
+    uint64_t sequence;
+    const latest_entry< Datagram > entry =
+        std::get< seqlock< latest_entry< Datagram > > >(_values).load(
+            sequence);
+
+    return latest_value< Datagram >{
+        entry.datagram, sequence,
+        std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(entry.timestamp))};
+  }
+};
+}
+
+}  // namespace kfly_comm
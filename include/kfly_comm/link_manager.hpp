@@ -0,0 +1,255 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+/* Threading includes */
+#include <mutex>
+
+/* KFly includes */
+#include "kfly_comm/kfly_comm.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   Identifier of a link in a link_manager, never reused.
+ */
+using link_id = uint32_t;
+
+/**
+ * @brief   Settings of a link_manager.
+ */
+struct link_manager_options
+{
+  /** @brief Number of I/O worker threads, 0 for one per core. */
+  std::size_t workers = 0;
+
+  /** @brief Pins worker i to core i modulo the number of cores. */
+  bool pin_workers = false;
+
+  /** @brief Size of the chunks to read. */
+  std::size_t rx_buffer_size = 4096;
+};
+
+namespace details
+{
+/**
+ * @brief   Forwards the datagrams of one link's codec, tagged with the link.
+ */
+template < typename Datagram >
+struct tagged_forwarder
+{
+  link_id id;
+  std::function< void(link_id, const Datagram &) > callback;
+
+  void on_datagram(const Datagram &datagram)
+  {
+    callback(id, datagram);
+  }
+};
+}
+
+/**
+ * @brief     Runs the links to many vehicles on a fixed pool of I/O threads.
+ *
+ * @details   Each link owns a codec and is assigned to the worker with the
+ *            fewest links. A worker waits in one epoll loop on all of its
+ *            links, reads in chunks into a shared buffer and parses them;
+ *            transmissions are queued and written from the same loop, like
+ *            serial_link does for a single link. Callbacks registered on
+ *            the manager receive the datagrams of every link, tagged with
+ *            the link id:
+ *
+ *              link_manager swarm;
+ *
+ *              swarm.register_callback< datagrams::IMUData >(
+ *                  [](link_id id, const datagrams::IMUData &imu) {
+ *                    ...
+ *                  });
+ *
+ *              for (const auto &port : ports)
+ *                ids.push_back(swarm.add_link(port, 115200));
+ *
+ * @note      Linux only. Callbacks of links on different workers run
+ *            concurrently, they must be thread safe. Callbacks may use the
+ *            manager, e.g. add links or remove their own; workers apply
+ *            added and removed links themselves between events, so no
+ *            call waits on a worker running callbacks.
+ */
+class link_manager
+{
+private:
+  class worker;
+  struct link;
+
+  /**
+   * @brief   Registers a callback on a link's codec, returning the object
+   *          the codec calls.
+   */
+  using attach_function =
+      std::function< std::shared_ptr< void >(codec &, link_id) >;
+
+  /** @brief Settings. */
+  const link_manager_options _options;
+
+  /** @brief The I/O workers. */
+  std::vector< std::unique_ptr< worker > > _workers;
+
+  /** @brief Guards the links and the callbacks. */
+  mutable std::mutex _lock;
+
+  /** @brief The links. */
+  std::unordered_map< link_id, std::unique_ptr< link > > _links;
+
+  /** @brief Callbacks attached to every link, present and future. */
+  std::vector< attach_function > _callbacks;
+
+  /** @brief The id of the next link. */
+  link_id _next_id;
+
+  /**
+   * @brief   Looks a link up, lock held.
+   */
+  link &find(link_id id) const;
+
+  /**
+   * @brief   Attaches a callback to all links.
+   */
+  void add_callback(attach_function attach);
+
+public:
+  /**
+   * @brief   Constructor, starts the workers.
+   *
+   * @param[in] options   Settings.
+   */
+  explicit link_manager(
+      const link_manager_options &options = link_manager_options());
+
+  /**
+   * @brief   Destructor, stops the workers and closes all links.
+   */
+  ~link_manager();
+
+  link_manager(const link_manager &) = delete;
+  link_manager &operator=(const link_manager &) = delete;
+
+  /**
+   * @brief   Opens and configures a serial port and adds it as a link.
+   *
+   * @param[in] device    Path to the serial device.
+   * @param[in] baudrate  The baudrate to configure.
+   *
+   * @return  The id of the link.
+   */
+  link_id add_link(const std::string &device, unsigned baudrate);
+
+  /**
+   * @brief   Adds an already opened file descriptor as a link, it is owned
+   *          and closed by the manager.
+   *
+   * @param[in] fd    The file descriptor, made non-blocking.
+   *
+   * @return  The id of the link.
+   */
+  link_id add_link(int fd);
+
+  /**
+   * @brief   Removes a link and closes its file descriptor, waiting for its
+   *          worker to finish with it. Called from a callback it does not
+   *          wait, the link stops after the bytes being parsed and is
+   *          closed by its worker.
+   *
+   * @param[in] id    The link.
+   */
+  void remove_link(link_id id);
+
+  /**
+   * @brief   The codec of a link, e.g. for latest() or its statistics.
+   *
+   * @param[in] id    The link.
+   *
+   * @note    Valid until the link is removed.
+   */
+  codec &link_codec(link_id id);
+
+  /**
+   * @brief   Queues a message for transmission on a link.
+   *
+   * @param[in] id        The link.
+   * @param[in] message   The message, e.g. from codec::generate_packet.
+   */
+  void send(link_id id, std::vector< uint8_t > message);
+
+  /**
+   * @brief   Queues a message for transmission on a link.
+   *
+   * @param[in] id    The link.
+   * @param[in] data  Pointer to the message.
+   * @param[in] size  Size of the message in bytes.
+   */
+  void send(link_id id, const uint8_t *data, const std::size_t size);
+
+  /**
+   * @brief   Checks if a link is running.
+   *
+   * @return  False if the link has been closed by the other side or failed.
+   */
+  bool is_running(link_id id) const;
+
+  /**
+   * @brief   The errno which stopped a link, 0 if none.
+   */
+  int error(link_id id) const;
+
+  /**
+   * @brief   The worker a link is assigned to.
+   */
+  std::size_t worker_of(link_id id) const;
+
+  /**
+   * @brief   Number of links.
+   */
+  std::size_t link_count() const;
+
+  /**
+   * @brief   Number of I/O workers.
+   */
+  std::size_t worker_count() const noexcept
+  {
+    return _workers.size();
+  }
+
+  /**
+   * @brief   Registers a callback for a datagram from any link.
+   *
+   * @param[in] callback  Called with the link and the datagram, from the
+   *                      link's worker.
+   */
+  template < typename Datagram >
+  void register_callback(
+      std::function< void(link_id, const Datagram &) > callback)
+  {
+    add_callback([callback](codec &c, link_id id) {
+      using forwarder = details::tagged_forwarder< Datagram >;
+
+      auto f = std::make_shared< forwarder >(forwarder{id, callback});
+      c.register_callback(f.get(), &forwarder::on_datagram);
+
+      return std::shared_ptr< void >(f);
+    });
+  }
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,274 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/* Threading includes */
+#include <atomic>
+
+namespace kfly_comm
+{
+/**
+ * @brief   Number of command values, the ack bit excluded.
+ */
+constexpr std::size_t command_count = 128;
+
+/**
+ * @brief   Frame and byte counters of one direction, per command.
+ */
+struct direction_counters
+{
+  /** @brief Frames per command. */
+  std::array< uint64_t, command_count > frames;
+
+  /** @brief Frame bytes (header, payload and CRC) per command. */
+  std::array< uint64_t, command_count > bytes;
+
+  /** @brief Sum of frames over all commands. */
+  uint64_t total_frames() const noexcept;
+
+  /** @brief Sum of bytes over all commands. */
+  uint64_t total_bytes() const noexcept;
+};
+
+/**
+ * @brief   A copy of the counters of a link at one point in time.
+ */
+struct link_snapshot
+{
+  /** @brief Time the snapshot was taken. */
+  std::chrono::steady_clock::time_point time;
+
+  /** @brief Frames received and decoded, frames rejected for their CRC,
+   *         length or payload size are only counted as errors. */
+  direction_counters rx;
+
+  /** @brief Frames written to the link. */
+  direction_counters tx;
+
+  /** @brief Raw bytes received, before SLIP decoding. */
+  uint64_t rx_raw_bytes;
+
+  /** @brief Frames dropped due to a CRC mismatch. */
+  uint64_t crc_errors;
+
+  /** @brief Frames dropped as the header size did not match the frame. */
+  uint64_t length_errors;
+
+  /** @brief Frames whose payload size did not match the datagram. */
+  uint64_t payload_errors;
+
+  /** @brief Verified frames with a command KFly should not send. */
+  uint64_t unknown_commands;
+
+  /** @brief Frames dropped as they were longer than max_frame_size. */
+  uint64_t oversized_frames;
+
+  /** @brief ESC bytes followed by neither ESC_END nor ESC_ESC. */
+  uint64_t framing_errors;
+
+  /**
+   * @brief Time spent decoding and in the callbacks, in ns. Estimated from
+   *        one in link_statistics::callback_sample_interval frames.
+   */
+  uint64_t callback_ns;
+
+  /** @brief Longest time spent in the callbacks of a sampled frame, in ns. */
+  uint64_t callback_max_ns;
+
+  /**
+   * @brief   Sum of all error counters.
+   */
+  uint64_t errors() const noexcept
+  {
+    return crc_errors + length_errors + payload_errors + unknown_commands +
+           oversized_frames + framing_errors;
+  }
+};
+
+/**
+ * @brief   Rates between two snapshots, per second.
+ */
+struct link_rates
+{
+  /** @brief Seconds between the snapshots. */
+  double seconds;
+
+  double rx_frames;
+  double rx_bytes;
+  double rx_raw_bytes;
+  double tx_frames;
+  double tx_bytes;
+
+  /** @brief All errors per second. */
+  double errors;
+
+  double crc_errors;
+  double length_errors;
+  double framing_errors;
+
+  /** @brief Errors per received frame, 0 to 1. */
+  double error_ratio;
+
+  /** @brief Share of the time spent in the callbacks, 0 to 1. */
+  double callback_load;
+};
+
+/**
+ * @brief   Computes the rates between two snapshots.
+ *
+ * @param[in] before  The earlier snapshot.
+ * @param[in] after   The later snapshot.
+ *
+ * @return  The rates, all zero if no time passed. A counter reset between
+ *          the snapshots has a rate of zero.
+ */
+link_rates rates(const link_snapshot &before, const link_snapshot &after);
+
+/**
+ * @brief     Lock-free counters of a link.
+ *
+ * @details   All counters are relaxed atomic additions, so a reset from
+ *            another thread is never overwritten by a parser holding the
+ *            old value. Receive counters are written by the parsing thread
+ *            only, transmit counters from any thread. Any thread may take a
+ *            snapshot or reset at any time, the counters are individually
+ *            consistent.
+ */
+class link_statistics
+{
+private:
+  using counter = std::atomic< uint64_t >;
+
+  std::array< counter, command_count > _rx_frames;
+  std::array< counter, command_count > _rx_bytes;
+  std::array< counter, command_count > _tx_frames;
+  std::array< counter, command_count > _tx_bytes;
+
+  counter _rx_raw_bytes;
+  counter _crc_errors;
+  counter _length_errors;
+  counter _payload_errors;
+  counter _unknown_commands;
+  counter _oversized_frames;
+  counter _framing_errors;
+  counter _callback_ns;
+  counter _callback_max_ns;
+
+  /**
+   * @brief   Adds to a counter, atomically so a concurrent reset is kept.
+   */
+  static void add(counter &c, uint64_t n) noexcept
+  {
+    c.fetch_add(n, std::memory_order_relaxed);
+  }
+
+public:
+  /**
+   * @brief   Timing every frame costs about as much as decoding it, so one
+   *          in this many frames is timed.
+   */
+  static constexpr uint32_t callback_sample_interval = 16;
+
+  link_statistics() noexcept;
+
+  link_statistics(const link_statistics &) = delete;
+  link_statistics &operator=(const link_statistics &) = delete;
+
+  /**
+   * @brief   Counts a verified received frame, parsing thread only.
+   */
+  void rx_frame(const uint8_t command, const std::size_t size) noexcept
+  {
+    add(_rx_frames[command & 0x7f], 1);
+    add(_rx_bytes[command & 0x7f], size);
+  }
+
+  /** @brief Counts raw received bytes, parsing thread only. */
+  void rx_raw(std::size_t size) noexcept
+  {
+    add(_rx_raw_bytes, size);
+  }
+
+  /** @brief Counts a CRC error, parsing thread only. */
+  void crc_error() noexcept
+  {
+    add(_crc_errors, 1);
+  }
+
+  /** @brief Counts a length error, parsing thread only. */
+  void length_error() noexcept
+  {
+    add(_length_errors, 1);
+  }
+
+  /** @brief Counts a payload size error, parsing thread only. */
+  void payload_error() noexcept
+  {
+    add(_payload_errors, 1);
+  }
+
+  /** @brief Counts an unknown command, parsing thread only. */
+  void unknown_command() noexcept
+  {
+    add(_unknown_commands, 1);
+  }
+
+  /** @brief Counts an oversized frame, parsing thread only. */
+  void oversized_frame() noexcept
+  {
+    add(_oversized_frames, 1);
+  }
+
+  /** @brief Counts SLIP framing errors, parsing thread only. */
+  void framing_errors(uint64_t n) noexcept
+  {
+    add(_framing_errors, n);
+  }
+
+  /**
+   * @brief   Counts the time spent in the callbacks of a sampled frame,
+   *          parsing thread only.
+   */
+  void callback_sample(std::chrono::nanoseconds t) noexcept
+  {
+    const uint64_t ns = static_cast< uint64_t >(t.count());
+
+    add(_callback_ns, ns * callback_sample_interval);
+
+    uint64_t max = _callback_max_ns.load(std::memory_order_relaxed);
+
+    while (ns > max && !_callback_max_ns.compare_exchange_weak(
+                           max, ns, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  /**
+   * @brief   Counts transmitted frames, from any thread.
+   *
+   * @param[in] data  SLIP encoded bytes holding one or more whole frames.
+   * @param[in] size  Number of bytes.
+   */
+  void tx_encoded(const uint8_t *data, std::size_t size) noexcept;
+
+  /**
+   * @brief   Copies the counters.
+   */
+  link_snapshot snapshot() const noexcept;
+
+  /**
+   * @brief   Zeroes the counters.
+   */
+  void reset() noexcept;
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,168 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/* Threading includes */
+#include <thread>
+
+/* KFly includes */
+#include "kfly_comm/kfly_comm.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   Format of a capture.
+ */
+enum class capture_format
+{
+  /** @brief Raw SLIP encoded bytes as read from the link. */
+  slip,
+
+  /** @brief A flight_recorder file. */
+  recording
+};
+
+/**
+ * @brief   Order in which replayed datagrams are delivered.
+ */
+enum class replay_order
+{
+  /** @brief In the order of the capture, from the thread calling run(). */
+  ordered,
+
+  /** @brief As soon as decoded, concurrently from the worker threads. */
+  unordered
+};
+
+/**
+ * @brief   Settings of a log_replay.
+ */
+struct log_replay_options
+{
+  /** @brief Number of decoding threads, 0 for one per core. */
+  std::size_t threads = 0;
+
+  /** @brief Delivery order. */
+  replay_order order = replay_order::ordered;
+
+  /**
+   * @brief Pacing relative to the recorded time, e.g. 1 for real time and
+   *        10 for ten times faster. 0 replays as fast as possible. Only
+   *        recordings carry timestamps and only ordered replays are paced.
+   */
+  double speed = 0;
+
+  /** @brief Approximate size of the parts decoded by each thread. */
+  std::size_t chunk_size = 1 << 20;
+
+  /** @brief Also replay the transmitted frames of a recording. */
+  bool include_tx = false;
+};
+
+/**
+ * @brief   Summary of a replay.
+ */
+struct replay_stats
+{
+  /** @brief Frames which passed the length and CRC checks. */
+  uint64_t frames;
+
+  /** @brief Datagrams delivered to the callbacks. */
+  uint64_t datagrams;
+
+  /** @brief Frames dropped due to a CRC mismatch. */
+  uint64_t crc_errors;
+
+  /** @brief Frames dropped due to a wrong or too large size. */
+  uint64_t size_errors;
+
+  /** @brief Size of the capture in bytes. */
+  uint64_t bytes;
+
+  /** @brief Wall-clock duration of the replay. */
+  double seconds;
+};
+
+/**
+ * @brief     Replays a capture through datagram callbacks using all cores.
+ *
+ * @details   The capture is memory mapped and split into chunks at frame
+ *            boundaries (SLIP END bytes or recorder records). Worker threads
+ *            SLIP decode, check and decode the chunks in parallel. Ordered
+ *            replays deliver the datagrams chunk by chunk in capture order
+ *            from the thread calling run(), with at most two chunks per
+ *            worker decoded ahead; unordered replays deliver straight from
+ *            the workers and scale with the number of cores.
+ *
+ * @note      Linux only. Throws std::system_error if the capture cannot be
+ *            mapped, and std::invalid_argument if a recording has a
+ *            truncated header, an unsupported version or a bad header size.
+ *            In unordered replays callbacks run concurrently.
+ */
+class log_replay
+{
+private:
+  /** @brief The callbacks receiving the replayed datagrams. */
+  kfly_datagram_director _callbacks;
+
+  /** @brief The mapped capture. */
+  const uint8_t *_data;
+  std::size_t _size;
+
+  /** @brief Format of the capture. */
+  capture_format _format;
+
+  /** @brief Settings. */
+  log_replay_options _options;
+
+public:
+  /**
+   * @brief   Constructor, maps the capture and detects its format.
+   *
+   * @param[in] file      Path of the capture.
+   * @param[in] options   Settings.
+   */
+  explicit log_replay(
+      const std::string &file,
+      const log_replay_options &options = log_replay_options());
+
+  /**
+   * @brief   Destructor, unmaps the capture.
+   */
+  ~log_replay();
+
+  log_replay(const log_replay &) = delete;
+  log_replay &operator=(const log_replay &) = delete;
+
+  /**
+   * @brief   The callbacks receiving the replayed datagrams.
+   */
+  kfly_datagram_director &callbacks() noexcept
+  {
+    return _callbacks;
+  }
+
+  /**
+   * @brief   Format of the capture.
+   */
+  capture_format format() const noexcept
+  {
+    return _format;
+  }
+
+  /**
+   * @brief   Replays the whole capture, returns when all datagrams have been
+   *          delivered. May be called again to replay once more.
+   */
+  replay_stats run();
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,134 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+
+namespace kfly_comm
+{
+/**
+ * @brief   Link of an element in an mpsc_queue, derive the element from it.
+ */
+struct mpsc_node
+{
+  std::atomic< mpsc_node * > next;
+};
+
+/**
+ * @brief     An unbounded intrusive queue with many producers and one
+ *            consumer (Vyukov).
+ *
+ * @details   A push is one exchange of the head and one store, producers
+ *            never wait for each other or the consumer. The consumer
+ *            follows the links from the tail; a stub node keeps the list
+ *            non-empty, so the last element can be taken while producers
+ *            push behind it. A producer preempted between its exchange and
+ *            its store hides the elements behind it until it resumes,
+ *            try_pop returns nullptr in that window although empty() is
+ *            false.
+ *
+ * @tparam Node   Element type, derived from mpsc_node. The queue does not own
+ *                the elements.
+ */
+template < typename Node >
+class mpsc_queue
+{
+private:
+  /** @brief Last pushed node, exchanged by the producers. */
+  alignas(64) std::atomic< mpsc_node * > _head;
+
+  /** @brief Oldest node, consumer only. */
+  alignas(64) mpsc_node *_tail;
+
+  /** @brief Placeholder keeping the list non-empty. */
+  mpsc_node _stub;
+
+  void push_node(mpsc_node *n) noexcept
+  {
+    n->next.store(nullptr, std::memory_order_relaxed);
+
+    /* Sequentially consistent, so a consumer checking empty() before it
+     * sleeps and a producer checking for a sleeper after its push cannot
+     * miss each other. */
+    mpsc_node *prev = _head.exchange(n, std::memory_order_seq_cst);
+    prev->next.store(n, std::memory_order_release);
+  }
+
+public:
+  mpsc_queue() noexcept : _head(&_stub), _tail(&_stub)
+  {
+    _stub.next.store(nullptr, std::memory_order_relaxed);
+  }
+
+  mpsc_queue(const mpsc_queue &) = delete;
+  mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+  /**
+   * @brief   Appends an element, from any thread.
+   */
+  void push(Node *n) noexcept
+  {
+    push_node(n);
+  }
+
+  /**
+   * @brief   Removes the oldest element (consumer only).
+   *
+   * @return  The element, nullptr if the queue is empty or a producer is in
+   *          the middle of linking the next one.
+   */
+  Node *try_pop() noexcept
+  {
+    mpsc_node *tail = _tail;
+    mpsc_node *next = tail->next.load(std::memory_order_acquire);
+
+    /* Skip the stub. */
+    if (tail == &_stub)
+    {
+      if (next == nullptr)
+        return nullptr;
+
+      _tail = next;
+      tail  = next;
+      next  = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next != nullptr)
+    {
+      _tail = next;
+      return static_cast< Node * >(tail);
+    }
+
+    /* The tail is the last node unless a producer is still linking. */
+    if (tail != _head.load(std::memory_order_acquire))
+      return nullptr;
+
+    /* Put the stub behind the last node so it can be taken. */
+    push_node(&_stub);
+
+    next = tail->next.load(std::memory_order_acquire);
+
+    if (next != nullptr)
+    {
+      _tail = next;
+      return static_cast< Node * >(tail);
+    }
+
+    return nullptr;
+  }
+
+  /**
+   * @brief   Checks if nothing was pushed since the last element was taken
+   *          (consumer only).
+   */
+  bool empty() const noexcept
+  {
+    return _tail == &_stub &&
+           _head.load(std::memory_order_seq_cst) == &_stub;
+  }
+};
+
+}  // namespace kfly_comm
@@ -6,8 +6,12 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 #include <vector>
+#include <stdexcept>
+#include <type_traits>
 #include "kfly_comm/crc.hpp"
+#include "kfly_comm/slip.hpp"
 #include "kfly_comm/serializable_datagram.hpp"
 #include "kfly_comm/commands.hpp"
 
@@ -72,5 +76,132 @@ struct kfly_packet
               back_inserter(payload));
   }
 };
+
+/**
+ * @brief   Size of the largest frame, header, 255 bytes of payload and CRC.
+ */
+constexpr std::size_t max_frame_size = 4 + 255;
+
+/**
+ * @brief   Result of checking a received frame.
+ */
+enum class frame_status
+{
+  ok,
+  size_error,
+  crc_error
+};
+
+/**
+ * @brief   Checks the length and CRC of a received, SLIP decoded, frame.
+ *
+ * @param[in] frame   Pointer to the frame, header, payload and CRC.
+ * @param[in] size    Size of the frame in bytes.
+ *
+ * @return  frame_status::ok if the payload may be decoded.
+ */
+inline frame_status check_frame(const uint8_t *frame, const std::size_t size)
+{
+  /* Check size, the header byte must match the payload. */
+  if (size < 4 || static_cast< std::size_t >(frame[1]) + 4 != size)
+    return frame_status::size_error;
+
+  /* Extract the CRC. */
+  union {
+    uint8_t b[2];
+    uint16_t u16;
+  } crc;
+
+  crc.b[0] = frame[size - 2];
+  crc.b[1] = frame[size - 1];
+
+  /* Calculate CRC in place, over header and payload. As when encoding,
+   * the command is without ack bit. */
+  const uint16_t expected = CRC16_CCITT::generateCRC(
+      frame + 1, size - 3,
+      CRC16_CCITT::generateCRC(static_cast< uint8_t >(frame[0] & 0x7f)));
+
+  if (expected != crc.u16)
+    return frame_status::crc_error;
+
+  return frame_status::ok;
 }
 
+/**
+ * @brief   Worst case size of an encoded packet, header, datagram and CRC
+ *          with every byte escaped plus the SLIP delimiters.
+ *
+ * @tparam  Datagram      The datagram.
+ * @tparam  HasDatagram   If true, then the datagram is included in the packet.
+ */
+template < typename Datagram, bool HasDatagram = true >
+struct max_encoded_size
+    : std::integral_constant< std::size_t,
+                              slip::max_encoded_size(
+                                  4 + (HasDatagram ? sizeof(Datagram) : 0)) >
+{
+};
+
+/**
+ * @brief   Encodes a packet straight into a buffer, header, datagram, CRC and
+ *          SLIP escaping are generated in a single pass without allocations.
+ *
+ * @param[in]  command    The command.
+ * @param[in]  datagram   Datagram to use.
+ * @param[in]  ack        Ack request flag.
+ * @param[out] out        The output buffer.
+ * @param[in]  capacity   Size of the output buffer, needs to be at least
+ *                        max_encoded_size< Datagram, HasDatagram >::value.
+ *
+ * @return  The number of bytes written.
+ *
+ * @tparam  Datagram      The datagram.
+ * @tparam  HasDatagram   If true, then the datagram will be included in the
+ *                        message.
+ */
+template < typename Datagram, bool HasDatagram = true >
+std::size_t encode_packet(commands command, const Datagram &datagram, bool ack,
+                          uint8_t *out, const std::size_t capacity)
+{
+  static_assert(std::is_trivially_copyable< Datagram >::value == true,
+                "Datagram need to be trivially copyable.");
+
+  if (capacity < max_encoded_size< Datagram, HasDatagram >::value)
+    throw std::invalid_argument("Buffer is too small for the packet.");
+
+  /* Set correct datagram size. */
+  const uint8_t size = (HasDatagram == true) ? sizeof(Datagram) : 0;
+
+  /* Set ack bit if needed. */
+  const uint8_t ack_bit = (ack == true) ? 0x80 : 0;
+
+  union {
+    uint16_t value;
+    uint8_t data[sizeof(value)];
+  } crc;
+
+  const uint8_t *bytes = reinterpret_cast< const uint8_t * >(&datagram);
+
+  std::size_t n = 0;
+  out[n++]      = slip::END;
+
+  /* Emplace command and size, the CRC is on the command without ack bit. */
+  const uint8_t header[2] = {
+      static_cast< uint8_t >(static_cast< uint8_t >(command) | ack_bit), size};
+
+  crc.value = CRC16_CCITT::generateCRC(static_cast< uint8_t >(command));
+  crc.value = CRC16_CCITT::generateCRC(size, crc.value);
+  n += slip::encode(header, sizeof(header), out + n);
+
+  /* Emplace datagram, clean runs are copied in bulk. */
+  crc.value = CRC16_CCITT::generateCRC(bytes, size, crc.value);
+  n += slip::encode(bytes, size, out + n);
+
+  /* Emplace CRC. */
+  n += slip::encode(crc.data, sizeof(crc.data), out + n);
+
+  out[n++] = slip::END;
+
+  return n;
+}
+}
@@ -0,0 +1,430 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+/* Threading includes */
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/* KFly includes */
+#include "kfly_comm/kfly_comm.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   Settings of a request_engine.
+ */
+struct request_options
+{
+  /** @brief Maximum number of requests sent but not yet answered. */
+  std::size_t window = 8;
+
+  /** @brief Time to wait for the answer before retransmitting. */
+  std::chrono::milliseconds timeout = std::chrono::milliseconds(100);
+
+  /** @brief Number of retransmissions before a request fails. */
+  unsigned retries = 3;
+
+  /** @brief Baudrate of the link, the timeout then starts when the frame has
+   *         left the wire behind the frames sent before it. 0 starts it
+   *         when the frame is handed to the send function. */
+  unsigned baudrate = 0;
+};
+
+/**
+ * @brief   Counters of a request_engine.
+ */
+struct request_stats
+{
+  /** @brief Requests transmitted for the first time. */
+  uint64_t sent;
+
+  /** @brief Retransmissions after a timeout. */
+  uint64_t retransmits;
+
+  /** @brief Requests answered. */
+  uint64_t completed;
+
+  /** @brief Requests failed after all retries. */
+  uint64_t timeouts;
+
+  /** @brief Answers to earlier transmissions of a completed request. */
+  uint64_t duplicates;
+};
+
+/**
+ * @brief     Keeps a window of requests to KFly in flight and matches the
+ *            answers to them.
+ *
+ * @details   Set requests are sent with the ack bit and are answered by an
+ *            ACK, get requests are answered by the requested datagram under
+ *            the same command. Answers are taken from a frame tap on the
+ *            codec and matched to the oldest transmission expecting that
+ *            command; up to options.window requests are in flight and
+ *            the rest wait in order. Unanswered requests are retransmitted
+ *            after options.timeout and fail with std::errc::timed_out after
+ *            options.retries retransmissions. Every transmission of a
+ *            request is owed an answer, so the answers to a retransmitted
+ *            request are absorbed by it and never complete a later one.
+ *            Set options.baudrate on slow links so that frames queued
+ *            behind others do not time out before they are sent. Results
+ *            are delivered through futures or completion callbacks:
+ *
+ *              request_engine engine(kfly, [&](const uint8_t *d,
+ *                                              std::size_t n) {
+ *                link.send(d, n);
+ *              });
+ *
+ *              auto limits = engine.set(controller_limits);
+ *              auto mix    = engine.get< datagrams::ChannelMix >();
+ *              limits.get();
+ *              mix.get();
+ *
+ * @note      ACKs carry no identifier, so they are matched in order of
+ *            transmission. KFly handles commands in order, which makes this
+ *            exact unless a request is lost while later ones are in flight;
+ *            use a window of 1 where that must be ruled out.
+ *
+ * @warning   Answers to get requests are matched by command alone, and a
+ *            stream subscribed with codec::generate_subscribe arrives under
+ *            the same command as the answer to a get of that datagram. The
+ *            engine does not see subscriptions, so do not get a datagram
+ *            while it is streamed: the next streamed sample completes the
+ *            request in place of the answer. Read a streamed datagram with
+ *            codec::latest instead.
+ */
+class request_engine
+{
+public:
+  /**
+   * @brief   Function transmitting an encoded frame, e.g. serial_link::send.
+   */
+  using send_function = std::function< void(const uint8_t *, std::size_t) >;
+
+  /**
+   * @brief   Completion callback of a set request.
+   */
+  using set_callback = std::function< void(std::error_code) >;
+
+  /**
+   * @brief   Completion callback of a get request, the datagram is value
+   *          initialized on error.
+   */
+  template < typename Datagram >
+  using get_callback =
+      std::function< void(const Datagram &, std::error_code) >;
+
+private:
+  class answer_tap;
+
+  /**
+   * @brief   Completion of a request, called with the payload of the answer
+   *          or an error.
+   */
+  using completion = std::function< void(const uint8_t *, std::size_t,
+                                         std::error_code) >;
+
+  /**
+   * @brief   A request waiting to be sent or in flight.
+   */
+  struct request
+  {
+    uint64_t id;
+    std::vector< uint8_t > frame;
+    uint8_t answer;
+    completion done;
+    std::chrono::steady_clock::time_point deadline;
+    unsigned attempts;
+  };
+
+  /**
+   * @brief   A transmission waiting for its answer, kept until answered or
+   *          a timeout after the deadline of the request.
+   */
+  struct transmission
+  {
+    uint64_t id;
+    uint8_t answer;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  /** @brief Settings. */
+  const request_options _options;
+
+  /** @brief The codec the answers are taken from. */
+  codec &_codec;
+
+  /** @brief Transmits frames. */
+  send_function _send;
+
+  /** @brief Guards the queues. */
+  std::mutex _lock;
+  std::condition_variable _cv;
+
+  /** @brief Requests waiting for room in the window. */
+  std::deque< request > _waiting;
+
+  /** @brief Requests in flight, in order of first transmission. */
+  std::deque< request > _in_flight;
+
+  /** @brief Transmissions owed an answer, in order of transmission. */
+  std::deque< transmission > _transmissions;
+
+  /** @brief Identifier of the next request. */
+  uint64_t _next_id;
+
+  /** @brief When the frames sent so far have left the wire. */
+  std::chrono::steady_clock::time_point _wire_free;
+
+  /** @brief Number of answers expected, read without the lock. */
+  std::atomic< std::size_t > _expected_count;
+
+  /** @brief Counters. */
+  std::atomic< uint64_t > _sent;
+  std::atomic< uint64_t > _retransmits;
+  std::atomic< uint64_t > _completed;
+  std::atomic< uint64_t > _timeouts;
+  std::atomic< uint64_t > _duplicates;
+
+  /** @brief Taps the answers from the codec. */
+  std::unique_ptr< answer_tap > _tap;
+
+  /** @brief The timeout thread. */
+  std::thread _thread;
+  bool _running;
+
+  /**
+   * @brief   (Re)transmits a request, lock held. Sets its deadline and
+   *          records the transmission.
+   *
+   * @param[out] frames   The frames to send once the lock is released.
+   */
+  void transmit(request &r, std::chrono::steady_clock::time_point now,
+                std::vector< std::vector< uint8_t > > &frames);
+
+  /**
+   * @brief   Drops the transmissions no longer waited for, lock held.
+   */
+  void expire_transmissions(std::chrono::steady_clock::time_point now);
+
+  /**
+   * @brief   Moves waiting requests into the window, lock held.
+   *
+   * @param[out] frames   The frames to send once the lock is released.
+   */
+  void fill_window(std::vector< std::vector< uint8_t > > &frames);
+
+  /**
+   * @brief   Sends frames, lock not held.
+   */
+  void send_frames(const std::vector< std::vector< uint8_t > > &frames);
+
+  /**
+   * @brief   Queues a request and sends it if the window has room.
+   */
+  void submit(std::vector< uint8_t > frame, commands answer, completion done);
+
+  /**
+   * @brief   Matches a received frame to the oldest transmission expecting
+   *          it.
+   */
+  void on_answer(const uint8_t *frame, std::size_t size);
+
+  /**
+   * @brief   The timeout thread.
+   */
+  void run();
+
+  /**
+   * @brief   Decodes the answer to a get request.
+   */
+  template < typename Datagram >
+  static Datagram decode(const uint8_t *, std::size_t, std::true_type)
+  {
+    return Datagram{};
+  }
+
+  template < typename Datagram >
+  static Datagram decode(const uint8_t *payload, std::size_t size,
+                         std::false_type)
+  {
+    return serializable_datagram< Datagram >(payload, size).datagram;
+  }
+
+public:
+  /**
+   * @brief   Constructor, taps the codec and starts the timeout thread.
+   *
+   * @param[in] c         The codec receiving from KFly, must outlive the
+   *                      engine.
+   * @param[in] send      Transmits the encoded requests.
+   * @param[in] options   Settings.
+   */
+  request_engine(codec &c, send_function send,
+                 const request_options &options = request_options());
+
+  /**
+   * @brief   Destructor, fails the unanswered requests with
+   *          std::errc::operation_canceled.
+   */
+  ~request_engine();
+
+  request_engine(const request_engine &) = delete;
+  request_engine &operator=(const request_engine &) = delete;
+
+  /**
+   * @brief   Sends a datagram to KFly and waits for its ACK.
+   *
+   * @param[in] datagram  The datagram to send.
+   * @param[in] done      Called with the result, from the parsing or the
+   *                      timeout thread.
+   */
+  template < typename Datagram >
+  void set(const Datagram &datagram, set_callback done)
+  {
+    submit(codec::generate_packet(datagram, true), commands::ACK,
+           [done](const uint8_t *, std::size_t, std::error_code ec) {
+             done(ec);
+           });
+  }
+
+  /**
+   * @brief   Sends a datagram to KFly and waits for its ACK.
+   *
+   * @param[in] datagram  The datagram to send.
+   *
+   * @return  Future ready when acknowledged, holds a std::system_error on
+   *          failure.
+   */
+  template < typename Datagram >
+  std::future< void > set(const Datagram &datagram)
+  {
+    auto promise = std::make_shared< std::promise< void > >();
+
+    set(datagram, [promise](std::error_code ec) {
+      if (ec)
+        promise->set_exception(std::make_exception_ptr(
+            std::system_error(ec, "Set request failed")));
+      else
+        promise->set_value();
+    });
+
+    return promise->get_future();
+  }
+
+  /**
+   * @brief   Sends a command without datagram to KFly and waits for its
+   *          ACK, e.g. commands::SaveToFlash.
+   *
+   * @param[in] command   The command to send.
+   * @param[in] done      Called with the result.
+   */
+  void command(commands command, set_callback done);
+
+  /**
+   * @brief   Sends a command without datagram to KFly and waits for its
+   *          ACK.
+   *
+   * @param[in] command   The command to send.
+   *
+   * @return  Future ready when acknowledged, holds a std::system_error on
+   *          failure.
+   */
+  std::future< void > command(commands command);
+
+  /**
+   * @brief   Requests a datagram from KFly.
+   *
+   * @param[in] done      Called with the datagram or an error.
+   *
+   * @tparam Datagram     The datagram, needs
+   *                      command_traits::get_request_command.
+   *
+   * @note    Must not be used while the datagram is subscribed, see the
+   *          class description.
+   */
+  template < typename Datagram >
+  void get(get_callback< Datagram > done)
+  {
+    constexpr commands cmd =
+        command_traits::get_request_command< Datagram >::value;
+
+    submit(codec::generate_command(cmd), cmd,
+           [done](const uint8_t *payload, std::size_t size,
+                  std::error_code ec) {
+             Datagram datagram{};
+
+             if (!ec)
+             {
+               try
+               {
+                 datagram = decode< Datagram >(payload, size,
+                                               std::is_empty< Datagram >{});
+               }
+               catch (const std::invalid_argument &)
+               {
+                 ec = std::make_error_code(std::errc::bad_message);
+               }
+             }
+
+             done(datagram, ec);
+           });
+  }
+
+  /**
+   * @brief   Requests a datagram from KFly.
+   *
+   * @return  Future holding the datagram, or a std::system_error on
+   *          failure.
+   *
+   * @tparam Datagram     The datagram, needs
+   *                      command_traits::get_request_command.
+   *
+   * @note    Must not be used while the datagram is subscribed, see the
+   *          class description.
+   */
+  template < typename Datagram >
+  std::future< Datagram > get()
+  {
+    auto promise = std::make_shared< std::promise< Datagram > >();
+
+    get< Datagram >([promise](const Datagram &datagram, std::error_code ec) {
+      if (ec)
+        promise->set_exception(std::make_exception_ptr(
+            std::system_error(ec, "Get request failed")));
+      else
+        promise->set_value(datagram);
+    });
+
+    return promise->get_future();
+  }
+
+  /**
+   * @brief   Number of requests waiting or in flight.
+   */
+  std::size_t pending();
+
+  /**
+   * @brief   Reads the counters.
+   */
+  request_stats stats() const noexcept;
+};
+
+}  // namespace kfly_comm
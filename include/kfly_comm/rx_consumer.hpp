@@ -0,0 +1,325 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+/* Threading includes */
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/* KFly includes */
+#include "kfly_comm/datagram_director.hpp"
+#include "kfly_comm/datagram_dispatch.hpp"
+#include "kfly_comm/spsc_ring.hpp"
+
+namespace kfly_comm
+{
+class codec;
+
+/**
+ * @brief   What an rx_consumer does when its ring is full.
+ */
+enum class overflow_policy
+{
+  /** @brief Discard the oldest queued datagram, for telemetry. */
+  drop_oldest,
+
+  /** @brief Stall the parser until there is room, for replies. */
+  block
+};
+
+/**
+ * @brief   Counters of an rx_consumer.
+ */
+struct rx_consumer_stats
+{
+  /** @brief Datagrams queued by the parser. */
+  uint64_t queued;
+
+  /** @brief Datagrams delivered to the callbacks. */
+  uint64_t delivered;
+
+  /** @brief Datagrams discarded due to a full ring. */
+  uint64_t overflows;
+
+  /** @brief Largest number of queued datagrams seen. */
+  std::size_t high_water;
+
+  /** @brief Number of slots in the ring. */
+  std::size_t capacity;
+};
+
+namespace details
+{
+/**
+ * @brief   Fixed-size slot layout and delivery table for the datagrams of a
+ *          datagram director.
+ */
+template < typename Director >
+struct datagram_slots;
+
+template < typename... Datagrams >
+struct datagram_slots< datagram_director< Datagrams... > >
+{
+  using director = datagram_director< Datagrams... >;
+
+  static constexpr std::size_t max_size()
+  {
+    const std::size_t sizes[] = {sizeof(Datagrams)...};
+    std::size_t max           = 0;
+
+    for (auto s : sizes)
+      max = (s > max) ? s : max;
+
+    return max;
+  }
+
+  /**
+   * @brief   A decoded datagram and its index in the director's type list.
+   */
+  struct slot
+  {
+    uint8_t index;
+    uint8_t data[max_size()];
+  };
+
+  static_assert(sizeof...(Datagrams) <= 256, "Too many datagram types.");
+
+  /**
+   * @brief   Index of a datagram in the director's type list.
+   */
+  template < typename Datagram >
+  static constexpr uint8_t index_of()
+  {
+    const bool same[] = {std::is_same< Datagram, Datagrams >::value...};
+
+    for (std::size_t i = 0; i < sizeof...(Datagrams); i++)
+      if (same[i])
+        return static_cast< uint8_t >(i);
+
+    return 0;
+  }
+
+  /**
+   * @brief   Copies a datagram into a slot.
+   */
+  template < typename Datagram >
+  static void store(slot &s, const Datagram &datagram)
+  {
+    s.index = index_of< Datagram >();
+    std::memcpy(s.data, &datagram, sizeof(Datagram));
+  }
+
+  /**
+   * @brief   Restores the datagram of a slot and executes its callbacks.
+   */
+  template < typename Datagram >
+  static void deliver(director &callbacks, const slot &s)
+  {
+    Datagram datagram;
+    std::memcpy(&datagram, s.data, sizeof(Datagram));
+    callbacks.execute_callback(datagram);
+  }
+
+  using deliver_function = void (*)(director &, const slot &);
+
+  /**
+   * @brief   Delivery functions, indexed by the slot's datagram index.
+   */
+  static constexpr std::array< deliver_function, sizeof...(Datagrams) >
+      table = {{&deliver< Datagrams >...}};
+};
+
+template < typename... Datagrams >
+constexpr std::array<
+    typename datagram_slots< datagram_director< Datagrams... > >::
+        deliver_function,
+    sizeof...(Datagrams) >
+    datagram_slots< datagram_director< Datagrams... > >::table;
+}
+
+/**
+ * @brief     A consumer of received datagrams running decoupled from the
+ *            parser.
+ *
+ * @details   The codec copies each decoded datagram, which the consumer has
+ *            callbacks for, into a fixed-size slot of the consumer's
+ *            lock-free ring instead of calling the callbacks while parsing.
+ *            The consumer's own thread (start()), or the user through
+ *            poll(), drains the ring and executes the callbacks. A slow
+ *            consumer so never stalls byte ingestion, unless it asks to with
+ *            overflow_policy::block.
+ *
+ * @note      Callbacks are registered on callbacks(), not on the codec. The
+ *            consumer attaches to the codec on construction and detaches on
+ *            destruction.
+ */
+class rx_consumer
+{
+private:
+  using slots = details::datagram_slots< kfly_datagram_director >;
+
+  /** @brief The codec feeding the consumer. */
+  codec &_codec;
+
+  /** @brief Policy when the ring is full. */
+  const overflow_policy _policy;
+
+  /** @brief The callbacks executed by the consumer. */
+  kfly_datagram_director _callbacks;
+
+  /** @brief The ring of decoded datagrams. */
+  spsc_ring< slots::slot > _ring;
+
+  /** @brief Counters, written by the parser. */
+  std::atomic< uint64_t > _queued;
+  std::atomic< uint64_t > _overflows;
+  std::atomic< std::size_t > _high_water;
+
+  /** @brief Counter written by the consumer. */
+  std::atomic< uint64_t > _delivered;
+
+  /** @brief Wake up of a waiting consumer or blocked parser. */
+  std::mutex _wait_lock;
+  std::condition_variable _wait_cv;
+  std::atomic< bool > _consumer_waiting;
+  std::atomic< bool > _producer_waiting;
+
+  /** @brief False once stopping, the parser does not block any more. */
+  std::atomic< bool > _accepting;
+
+  /** @brief The consumer thread, if started. */
+  std::thread _thread;
+  std::atomic< bool > _running;
+
+  /**
+   * @brief   Wakes the consumer if it waits for data.
+   */
+  void notify_consumer();
+
+  /**
+   * @brief   Blocks the parser until the ring has room or the consumer
+   *          stops.
+   */
+  void wait_for_space();
+
+  /**
+   * @brief   The consumer thread.
+   */
+  void run();
+
+public:
+  /**
+   * @brief   Constructor, attaches the consumer to a codec.
+   *
+   * @param[in] c           The codec to receive datagrams from.
+   * @param[in] capacity    Number of slots, rounded up to a power of two.
+   * @param[in] policy      What to do when the ring is full.
+   */
+  rx_consumer(codec &c, std::size_t capacity,
+              overflow_policy policy = overflow_policy::drop_oldest);
+
+  /**
+   * @brief   Destructor, stops the thread and detaches from the codec.
+   */
+  ~rx_consumer();
+
+  rx_consumer(const rx_consumer &) = delete;
+  rx_consumer &operator=(const rx_consumer &) = delete;
+
+  /**
+   * @brief   The callbacks executed by this consumer.
+   */
+  kfly_datagram_director &callbacks() noexcept
+  {
+    return _callbacks;
+  }
+
+  /**
+   * @brief   Queues a decoded datagram, called by the codec's parser.
+   *
+   * @param[in] datagram  The received datagram.
+   */
+  template < typename Datagram >
+  void push(const Datagram &datagram)
+  {
+    /* Only queue what someone listens to. */
+    if (!_callbacks.has_callbacks< Datagram >())
+      return;
+
+    const auto writer = [&](slots::slot &s) { slots::store(s, datagram); };
+
+    bool queued = _ring.try_emplace(writer);
+
+    /* Wait for room as long as the consumer accepts datagrams. */
+    while (!queued && _policy == overflow_policy::block &&
+           _accepting.load(std::memory_order_acquire))
+    {
+      wait_for_space();
+      queued = _ring.try_emplace(writer);
+    }
+
+    if (!queued)
+    {
+      /* Make room by discarding the oldest. If the consumer holds the slot
+       * at this moment, the new datagram is discarded instead. */
+      if (_ring.drop_oldest())
+        _overflows.fetch_add(1, std::memory_order_relaxed);
+
+      if (!_ring.try_emplace(writer))
+      {
+        _overflows.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    _queued.fetch_add(1, std::memory_order_relaxed);
+
+    const std::size_t size = _ring.size();
+    if (size > _high_water.load(std::memory_order_relaxed))
+      _high_water.store(size, std::memory_order_relaxed);
+
+    notify_consumer();
+  }
+
+  /**
+   * @brief   Executes the callbacks of the queued datagrams.
+   *
+   * @param[in] max   Maximum number of datagrams to deliver.
+   *
+   * @return  The number of delivered datagrams.
+   *
+   * @note    Only one thread may poll, and not while started.
+   */
+  std::size_t poll(
+      std::size_t max = std::numeric_limits< std::size_t >::max());
+
+  /**
+   * @brief   Starts a thread which drains the ring.
+   */
+  void start();
+
+  /**
+   * @brief   Stops the thread, queued datagrams are kept.
+   */
+  void stop();
+
+  /**
+   * @brief   Reads the counters.
+   */
+  rx_consumer_stats stats() const noexcept;
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,154 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace kfly_comm
+{
+/**
+ * @brief     A single writer, multiple reader sequence lock over a value.
+ *
+ * @details   The writer never waits: it makes the sequence odd, writes the
+ *            value and makes the sequence even again. Readers copy the value
+ *            and retry if the sequence was odd or changed meanwhile, so they
+ *            never block the writer. The value is kept in relaxed atomic
+ *            words, a reader overlapping a write sees a torn copy which is
+ *            then discarded, without any data race.
+ *
+ * @note      Only one thread may store at a time.
+ *
+ * @tparam T    Type of the value, must be trivially copyable.
+ */
+template < typename T >
+class seqlock
+{
+private:
+  static_assert(std::is_trivially_copyable< T >::value,
+                "The seqlock value must be trivially copyable.");
+
+  /** @brief Number of words holding the value. */
+  static constexpr std::size_t num_words = (sizeof(T) + 7) / 8;
+
+  /** @brief Sequence number, odd while a write is in progress. */
+  std::atomic< uint64_t > _sequence;
+
+  /** @brief The value. */
+  std::atomic< uint64_t > _words[num_words];
+
+public:
+  /**
+   * @brief   Constructor, the value is value initialized.
+   */
+  seqlock() noexcept : _sequence(0)
+  {
+    for (auto &w : _words)
+      w.store(0, std::memory_order_relaxed);
+
+    store_words(T());
+  }
+
+  seqlock(const seqlock &) = delete;
+  seqlock &operator=(const seqlock &) = delete;
+
+  /**
+   * @brief   Stores a new value, wait-free.
+   *
+   * @param[in] value   The value to store.
+   */
+  void store(const T &value) noexcept
+  {
+    const uint64_t sequence = _sequence.load(std::memory_order_relaxed);
+
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    store_words(value);
+
+    _sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  /**
+   * @brief   Tries to read the value once.
+   *
+   * @param[out] value      The value, only valid if true is returned.
+   * @param[out] sequence   Number of stores done before the value.
+   *
+   * @return  False if a write overlapped the read.
+   */
+  bool try_load(T &value, uint64_t &sequence) const noexcept
+  {
+    const uint64_t before = _sequence.load(std::memory_order_acquire);
+
+    if (before & 1)
+      return false;
+
+    uint64_t words[num_words];
+    for (std::size_t i = 0; i < num_words; i++)
+      words[i] = _words[i].load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (_sequence.load(std::memory_order_relaxed) != before)
+      return false;
+
+    std::memcpy(&value, words, sizeof(T));
+    sequence = before / 2;
+
+    return true;
+  }
+
+  /**
+   * @brief   Reads the value, retrying while writes overlap.
+   *
+   * @param[out] sequence   Number of stores done before the value.
+   *
+   * @return  The value.
+   */
+  T load(uint64_t &sequence) const noexcept
+  {
+    T value;
+
+    while (!try_load(value, sequence))
+    {
+    }
+
+    return value;
+  }
+
+  /**
+   * @brief   Reads the value, retrying while writes overlap.
+   */
+  T load() const noexcept
+  {
+    uint64_t sequence;
+    return load(sequence);
+  }
+
+  /**
+   * @brief   Number of stores done so far.
+   */
+  uint64_t sequence() const noexcept
+  {
+    return _sequence.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  void store_words(const T &value) noexcept
+  {
+    uint64_t words[num_words] = {};
+    std::memcpy(words, &value, sizeof(T));
+
+    for (std::size_t i = 0; i < num_words; i++)
+      _words[i].store(words[i], std::memory_order_relaxed);
+  }
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,202 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/* Threading includes */
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/* KFly includes */
+#include "kfly_comm/kfly_comm.hpp"
+#include "kfly_comm/fd_io.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   Opens a serial port in raw 8N1 mode without flow control.
+ *
+ * @param[in] device    Path to the serial device, e.g. /dev/ttyACM0.
+ * @param[in] baudrate  The baudrate to configure.
+ *
+ * @return  The non-blocking file descriptor of the port.
+ *
+ * @note    Throws std::invalid_argument for unsupported baudrates and
+ *          std::system_error if the port cannot be opened or configured.
+ */
+int open_serial_port(const std::string &device, unsigned baudrate);
+
+/**
+ * @brief     An I/O engine connecting a file descriptor to a codec.
+ *
+ * @details   A dedicated thread waits in an epoll loop on the file
+ *            descriptor, reads in large chunks into a reusable buffer and
+ *            feeds the codec's batch parser. Outgoing messages are queued and
+ *            written with writev from the same thread, so callers never
+ *            block on the port.
+ *
+ * @note      Linux only. Any file descriptor works, e.g. a pty or a
+ *            socketpair for testing, it is owned and closed by the link.
+ */
+class serial_link
+{
+private:
+  /** @brief The codec receiving the parsed bytes. */
+  codec &_codec;
+
+  /** @brief The file descriptor of the link. */
+  int _fd;
+
+  /** @brief The epoll instance of the I/O thread. */
+  int _epoll_fd;
+
+  /** @brief Event used to wake the I/O thread for transmission and stop. */
+  std::unique_ptr< details::wake_event > _wake;
+
+  /** @brief Reusable receive buffer. */
+  std::vector< uint8_t > _rx_buffer;
+
+  /** @brief Lock for the transmit queue. */
+  std::mutex _tx_lock;
+
+  /** @brief Messages waiting for transmission. */
+  details::tx_queue _tx_queue;
+
+  /** @brief Flag for if EPOLLOUT is enabled on the file descriptor. */
+  bool _tx_waiting;
+
+  /** @brief Run flag for the I/O thread. */
+  std::atomic< bool > _running;
+
+  /** @brief The errno which stopped the I/O thread, 0 if none. */
+  std::atomic< int > _error;
+
+  /** @brief Byte counters. */
+  std::atomic< uint64_t > _rx_bytes, _tx_bytes;
+
+  /** @brief The I/O thread. */
+  std::thread _thread;
+
+  /**
+   * @brief   The I/O thread's epoll loop.
+   */
+  void run();
+
+  /**
+   * @brief   Reads until the file descriptor is drained.
+   *
+   * @return  False if the link was closed or failed.
+   */
+  bool receive();
+
+  /**
+   * @brief   Writes as much of the transmit queue as the port accepts.
+   *
+   * @return  False if the link failed.
+   */
+  bool transmit();
+
+  /**
+   * @brief   Sets up the epoll instance and starts the I/O thread.
+   */
+  void start();
+
+public:
+  /**
+   * @brief   Opens and configures a serial port and starts the link.
+   *
+   * @param[in] c               The codec to feed.
+   * @param[in] device          Path to the serial device.
+   * @param[in] baudrate        The baudrate to configure.
+   * @param[in] rx_buffer_size  Size of the chunks to read.
+   */
+  serial_link(codec &c, const std::string &device, unsigned baudrate,
+              std::size_t rx_buffer_size = 4096);
+
+  /**
+   * @brief   Takes ownership of an already opened file descriptor and starts
+   *          the link, the descriptor is made non-blocking. The descriptor
+   *          is closed if the constructor throws.
+   *
+   * @param[in] c               The codec to feed.
+   * @param[in] fd              The file descriptor.
+   * @param[in] rx_buffer_size  Size of the chunks to read.
+   */
+  serial_link(codec &c, int fd, std::size_t rx_buffer_size = 4096);
+
+  ~serial_link();
+
+  serial_link(const serial_link &) = delete;
+  serial_link &operator=(const serial_link &) = delete;
+
+  /**
+   * @brief   Queues a message for transmission.
+   *
+   * @param[in] message   The message, e.g. from codec::generate_packet.
+   */
+  void send(std::vector< uint8_t > message);
+
+  /**
+   * @brief   Queues a message for transmission.
+   *
+   * @param[in] data      Pointer to the message.
+   * @param[in] size      Size of the message in bytes.
+   */
+  void send(const uint8_t *data, const std::size_t size);
+
+  /**
+   * @brief   Checks if the I/O thread is running.
+   *
+   * @return  False if the link has been closed by the other side or failed.
+   */
+  bool is_running() const noexcept
+  {
+    return _running.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief   The error which stopped the link.
+   *
+   * @return  The errno value, 0 if none.
+   */
+  int error() const noexcept
+  {
+    return _error.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief   Number of bytes received.
+   */
+  uint64_t rx_bytes() const noexcept
+  {
+    return _rx_bytes.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief   Number of bytes transmitted.
+   */
+  uint64_t tx_bytes() const noexcept
+  {
+    return _tx_bytes.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief   The file descriptor of the link.
+   */
+  int native_handle() const noexcept
+  {
+    return _fd;
+  }
+};
+
+}  // namespace kfly_comm
@@ -91,6 +91,22 @@ struct serializable_datagram
           "Vector size is not the same as the datagram.");
   }
 
+  /**
+   * @brief   Constructor from a raw byte view (may throw), copies straight
+   *          from the view without intermediate buffers.
+   *
+   * @param[in] data  Pointer to the serialized data.
+   * @param[in] size  Size of the serialized data in bytes.
+   */
+  serializable_datagram(const uint8_t *data, const std::size_t size)
+  {
+    if (size == sizeof(Datagram))
+      std::memcpy(&datagram, data, sizeof(Datagram));
+    else
+      throw std::invalid_argument(
+          "Data size is not the same as the datagram.");
+  }
+
   /**
    * @brief   Serializes the datagram and returns the array.
    *
@@ -0,0 +1,322 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace kfly_comm
+{
+namespace slip
+{
+/** @brief Frame delimiter. */
+constexpr uint8_t END = 0xC0;
+
+/** @brief Escape character. */
+constexpr uint8_t ESC = 0xDB;
+
+/** @brief Escaped frame delimiter, follows ESC. */
+constexpr uint8_t ESC_END = 0xDC;
+
+/** @brief Escaped escape character, follows ESC. */
+constexpr uint8_t ESC_ESC = 0xDD;
+
+/**
+ * @brief   Worst case size of an encoded frame, every byte escaped plus the
+ *          leading and trailing delimiters.
+ *
+ * @param[in] size    Size of the unencoded frame in bytes.
+ *
+ * @return  The worst case encoded size.
+ */
+constexpr std::size_t max_encoded_size(const std::size_t size)
+{
+  return 2 * size + 2;
+}
+
+/**
+ * @brief   Writes a byte, escaped if needed.
+ *
+ * @param[in]  data   The byte to encode.
+ * @param[out] out    Output pointer, needs room for two bytes.
+ *
+ * @return  The number of bytes written.
+ */
+constexpr std::size_t encode_byte(const uint8_t data, uint8_t *out)
+{
+  if (data == END)
+  {
+    out[0] = ESC;
+    out[1] = ESC_END;
+    return 2;
+  }
+  else if (data == ESC)
+  {
+    out[0] = ESC;
+    out[1] = ESC_ESC;
+    return 2;
+  }
+  else
+  {
+    out[0] = data;
+    return 1;
+  }
+}
+
+/**
+ * @brief   Size of a byte after encoding.
+ *
+ * @param[in] data    The byte to encode.
+ *
+ * @return  2 if the byte needs escaping, else 1.
+ */
+constexpr std::size_t encoded_byte_size(const uint8_t data)
+{
+  return (data == END || data == ESC) ? 2 : 1;
+}
+
+/**
+ * @brief   Checks if a byte needs escaping.
+ */
+constexpr bool is_special(const uint8_t data)
+{
+  return data == END || data == ESC;
+}
+
+/**
+ * @brief   Kernels used to scan for END and ESC bytes.
+ */
+enum class engine
+{
+  /** @brief One byte at a time. */
+  scalar,
+
+  /** @brief 16 bytes at a time with SSE2. */
+  sse2,
+
+  /** @brief 32 bytes at a time with AVX2. */
+  avx2
+};
+
+/**
+ * @brief   The kernel in use, the fastest one supported by the running CPU
+ *          unless changed with select_engine.
+ */
+engine active_engine() noexcept;
+
+/**
+ * @brief   Selects the kernel, e.g. to compare them in benchmarks.
+ *
+ * @param[in] e   The kernel.
+ *
+ * @return  False if the running CPU does not support the kernel.
+ */
+bool select_engine(engine e) noexcept;
+
+/**
+ * @brief   Finds the first END or ESC byte.
+ *
+ * @param[in] begin   Start of the bytes to scan.
+ * @param[in] end     End of the bytes to scan.
+ *
+ * @return  Pointer to the first END or ESC byte, end if there is none.
+ */
+const uint8_t *find_special(const uint8_t *begin, const uint8_t *end) noexcept;
+
+/**
+ * @brief   Escapes bytes, runs without END and ESC bytes are copied in bulk.
+ *
+ * @param[in]  data   The bytes to encode.
+ * @param[in]  size   Number of bytes to encode.
+ * @param[out] out    Output buffer, needs room for 2 * size bytes.
+ *
+ * @return  The number of bytes written.
+ */
+std::size_t encode(const uint8_t *data, std::size_t size,
+                   uint8_t *out) noexcept;
+
+/**
+ * @brief   Encodes a frame, the escaped bytes between two END delimiters.
+ *
+ * @param[in]  data   The frame to encode.
+ * @param[in]  size   Size of the frame in bytes.
+ * @param[out] out    Output buffer, needs room for max_encoded_size(size).
+ *
+ * @return  The number of bytes written.
+ */
+inline std::size_t encode_frame(const uint8_t *data, std::size_t size,
+                                uint8_t *out) noexcept
+{
+  out[0]        = END;
+  std::size_t n = 1 + encode(data, size, out + 1);
+  out[n++]      = END;
+
+  return n;
+}
+
+/**
+ * @brief   Encodes a frame, the escaped bytes between two END delimiters.
+ *
+ * @param[in]  frame  The frame to encode.
+ * @param[out] out    The encoded frame, replaces the contents.
+ */
+inline void encode_frame(const std::vector< uint8_t > &frame,
+                         std::vector< uint8_t > &out)
+{
+  out.resize(max_encoded_size(frame.size()));
+  out.resize(encode_frame(frame.data(), frame.size(), out.data()));
+}
+
+/**
+ * @brief     Streaming SLIP decoder with a fixed size frame buffer.
+ *
+ * @details   Bytes are scanned for END and ESC with find_special and the runs
+ *            between them are copied in bulk. Empty frames are ignored and
+ *            frames longer than the buffer are dropped and reported.
+ *
+ * @tparam MaxFrame   Size of the largest frame in bytes.
+ */
+template < std::size_t MaxFrame >
+class decoder
+{
+private:
+  /** @brief The frame being decoded. */
+  uint8_t _frame[MaxFrame];
+  std::size_t _size;
+
+  /** @brief If the previous byte was ESC. */
+  bool _escaped;
+
+  /** @brief If the frame being decoded did not fit. */
+  bool _overflow;
+
+  /** @brief ESC bytes followed by neither ESC_END nor ESC_ESC. */
+  uint64_t _framing_errors;
+
+  /**
+   * @brief   Appends decoded bytes to the frame.
+   */
+  void append(const uint8_t *data, std::size_t size) noexcept
+  {
+    if (_overflow || size > MaxFrame - _size)
+    {
+      _overflow = true;
+      return;
+    }
+
+    std::memcpy(_frame + _size, data, size);
+    _size += size;
+  }
+
+public:
+  decoder() noexcept
+      : _size(0), _escaped(false), _overflow(false), _framing_errors(0)
+  {
+  }
+
+  /**
+   * @brief   Number of ESC bytes followed by neither ESC_END nor ESC_ESC,
+   *          the byte is kept as is.
+   */
+  uint64_t framing_errors() const noexcept
+  {
+    return _framing_errors;
+  }
+
+  /**
+   * @brief   Discards the partial frame.
+   */
+  void reset() noexcept
+  {
+    _size     = 0;
+    _escaped  = false;
+    _overflow = false;
+  }
+
+  /**
+   * @brief   Decodes bytes, calling on_frame for each completed frame.
+   *
+   * @param[in] data          The bytes to decode.
+   * @param[in] size          Number of bytes to decode.
+   * @param[in] on_frame      Called as on_frame(frame, size, consumed) with
+   *                          the decoded frame and the number of bytes of
+   *                          data up to and including its END byte.
+   * @param[in] on_oversize   Called as on_oversize(consumed) for frames
+   *                          longer than MaxFrame.
+   */
+  template < typename OnFrame, typename OnOversize >
+  void parse(const uint8_t *data, const std::size_t size, OnFrame &&on_frame,
+             OnOversize &&on_oversize)
+  {
+    const uint8_t *p   = data;
+    const uint8_t *end = data + size;
+
+    while (p < end)
+    {
+      /* The byte after ESC, an END still ends the frame. */
+      if (_escaped && *p != END)
+      {
+        const uint8_t b =
+            (*p == ESC_END) ? END : (*p == ESC_ESC) ? ESC : *p;
+
+        if (b == *p)
+          _framing_errors++;
+
+        if (_size < MaxFrame)
+          _frame[_size++] = b;
+        else
+          _overflow = true;
+
+        _escaped = false;
+        p++;
+        continue;
+      }
+
+      _escaped = false;
+
+      /* Copy the run up to the next END or ESC in one go, short inputs are
+       * not worth a kernel call. */
+      const uint8_t *special = p;
+
+      if (end - p < 16)
+      {
+        while (special < end && !is_special(*special))
+          special++;
+      }
+      else if (!is_special(*p))
+      {
+        special = find_special(p, end);
+      }
+
+      if (special != p)
+        append(p, special - p);
+
+      if (special == end)
+        break;
+
+      p = special + 1;
+
+      if (*special == ESC)
+      {
+        _escaped = true;
+        continue;
+      }
+
+      if (_overflow)
+        on_oversize(static_cast< std::size_t >(p - data));
+      else if (_size > 0)
+        on_frame(_frame, _size, static_cast< std::size_t >(p - data));
+
+      _size     = 0;
+      _overflow = false;
+    }
+  }
+};
+
+}  // namespace slip
+}  // namespace kfly_comm
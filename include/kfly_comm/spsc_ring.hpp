@@ -0,0 +1,233 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace kfly_comm
+{
+/**
+ * @brief     A bounded lock-free ring with one producer and one consumer,
+ *            where the producer may also discard the oldest element.
+ *
+ * @details   Each slot carries a sequence number telling whose turn it is:
+ *            the producer may write slot position p when its sequence is p,
+ *            and the element is readable when the sequence is p + 1. Taking
+ *            the oldest element is a compare-and-swap of the head, which both
+ *            the consumer (pop) and the producer (drop_oldest) do, so the one
+ *            winning the head owns the slot until it hands it back. No slot
+ *            is ever read and written at the same time.
+ *
+ * @tparam T    Element type, must be trivially copyable.
+ */
+template < typename T >
+class spsc_ring
+{
+private:
+  static_assert(std::is_trivially_copyable< T >::value,
+                "The ring elements must be trivially copyable.");
+
+  /**
+   * @brief   A slot, the sequence number and the element.
+   */
+  struct slot
+  {
+    std::atomic< uint64_t > sequence;
+    T value;
+  };
+
+  /** @brief Storage for the slots. */
+  std::unique_ptr< slot[] > _slots;
+
+  /** @brief Number of slots, a power of two. */
+  const std::size_t _capacity;
+
+  /** @brief Mask from a position to the slot index. */
+  const std::size_t _mask;
+
+  /** @brief Position of the oldest element, advanced by pop and drop. */
+  alignas(64) std::atomic< uint64_t > _head;
+
+  /** @brief Position of the next write, only advanced by the producer. */
+  alignas(64) std::atomic< uint64_t > _tail;
+
+  /**
+   * @brief   Claims the oldest element.
+   *
+   * @param[out] position   Position of the claimed element.
+   *
+   * @return  Pointer to the claimed slot, nullptr if the ring is empty.
+   */
+  slot *claim_oldest(uint64_t &position) noexcept
+  {
+    uint64_t head = _head.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+      slot &s = _slots[head & _mask];
+      const uint64_t sequence = s.sequence.load(std::memory_order_acquire);
+
+      if (sequence == head + 1)
+      {
+        if (_head.compare_exchange_weak(head, head + 1,
+                                        std::memory_order_acq_rel,
+                                        std::memory_order_relaxed))
+        {
+          position = head;
+          return &s;
+        }
+      }
+      else if (sequence <= head)
+      {
+        /* Not written yet, empty. */
+        return nullptr;
+      }
+      else
+      {
+        /* Taken by the other side, look at the new head. */
+        head = _head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief   Hands a claimed slot back to the producer.
+   */
+  void release(slot &s, const uint64_t position) noexcept
+  {
+    s.sequence.store(position + _capacity, std::memory_order_release);
+  }
+
+public:
+  /**
+   * @brief   Constructor, allocates the slots.
+   *
+   * @param[in] capacity    Number of elements, rounded up to a power of two.
+   */
+  explicit spsc_ring(std::size_t capacity)
+      : _capacity(round_up(capacity)), _mask(_capacity - 1), _head(0),
+        _tail(0)
+  {
+    _slots.reset(new slot[_capacity]);
+
+    for (std::size_t i = 0; i < _capacity; i++)
+      _slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  spsc_ring(const spsc_ring &) = delete;
+  spsc_ring &operator=(const spsc_ring &) = delete;
+
+  /**
+   * @brief   Rounds a capacity up to a power of two.
+   */
+  static std::size_t round_up(std::size_t capacity)
+  {
+    if (capacity == 0)
+      throw std::invalid_argument("The ring capacity may not be zero.");
+
+    std::size_t n = 1;
+    while (n < capacity)
+      n <<= 1;
+
+    return n;
+  }
+
+  /**
+   * @brief   Writes an element in place (producer only).
+   *
+   * @param[in] writer    Function filling the element, void(T &).
+   *
+   * @return  False if the ring is full, nothing is written then.
+   */
+  template < typename Writer >
+  bool try_emplace(Writer &&writer)
+  {
+    const uint64_t tail = _tail.load(std::memory_order_relaxed);
+    slot &s             = _slots[tail & _mask];
+
+    if (s.sequence.load(std::memory_order_acquire) != tail)
+      return false;
+
+    writer(s.value);
+
+    s.sequence.store(tail + 1, std::memory_order_release);
+    _tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  /**
+   * @brief   Discards the oldest element (producer only).
+   *
+   * @return  False if there was nothing to discard.
+   */
+  bool drop_oldest() noexcept
+  {
+    uint64_t position;
+    slot *s = claim_oldest(position);
+
+    if (s == nullptr)
+      return false;
+
+    release(*s, position);
+    return true;
+  }
+
+  /**
+   * @brief   Copies out and removes the oldest element (consumer only).
+   *
+   * @param[out] value    The element.
+   *
+   * @return  False if the ring is empty.
+   */
+  bool try_pop(T &value) noexcept
+  {
+    uint64_t position;
+    slot *s = claim_oldest(position);
+
+    if (s == nullptr)
+      return false;
+
+    value = s->value;
+    release(*s, position);
+
+    return true;
+  }
+
+  /**
+   * @brief   Number of elements, approximate while the ring is in use.
+   */
+  std::size_t size() const noexcept
+  {
+    const uint64_t head = _head.load(std::memory_order_acquire);
+    const uint64_t tail = _tail.load(std::memory_order_acquire);
+
+    return tail > head ? static_cast< std::size_t >(tail - head) : 0;
+  }
+
+  /**
+   * @brief   Checks if the ring is empty, approximate while in use.
+   */
+  bool empty() const noexcept
+  {
+    return size() == 0;
+  }
+
+  /**
+   * @brief   Maximum number of elements.
+   */
+  std::size_t capacity() const noexcept
+  {
+    return _capacity;
+  }
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,565 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/* KFly includes */
+#include "kfly_comm/datagrams.hpp"
+#include "kfly_comm/datagram_traits.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   Element type of a telemetry column.
+ */
+enum class scalar_type : uint8_t
+{
+  int8,
+  uint8,
+  int16,
+  uint16,
+  int32,
+  uint32,
+  int64,
+  uint64,
+  float32,
+  float64,
+  boolean
+};
+
+/**
+ * @brief   Description of one column of a telemetry_table, a scalar field of
+ *          the datagram.
+ */
+struct column_info
+{
+  /** @brief Name, e.g. "accelerometer[2]" or "q.w". */
+  std::string name;
+
+  /** @brief Byte offset of the field in the datagram. */
+  std::size_t offset;
+
+  /** @brief Element type. */
+  scalar_type type;
+
+  /** @brief Element size in bytes. */
+  std::size_t size;
+};
+
+/**
+ * @brief   A read-only view of contiguous elements.
+ *
+ * @tparam T    Element type.
+ */
+template < typename T >
+class span
+{
+private:
+  T *_data;
+  std::size_t _size;
+
+public:
+  constexpr span() noexcept : _data(nullptr), _size(0)
+  {
+  }
+
+  constexpr span(T *data, std::size_t size) noexcept : _data(data), _size(size)
+  {
+  }
+
+  constexpr T *data() const noexcept
+  {
+    return _data;
+  }
+
+  constexpr std::size_t size() const noexcept
+  {
+    return _size;
+  }
+
+  constexpr bool empty() const noexcept
+  {
+    return _size == 0;
+  }
+
+  constexpr T *begin() const noexcept
+  {
+    return _data;
+  }
+
+  constexpr T *end() const noexcept
+  {
+    return _data + _size;
+  }
+
+  constexpr T &operator[](std::size_t i) const noexcept
+  {
+    return _data[i];
+  }
+};
+
+namespace details
+{
+/**
+ * @brief   Maps a C++ type to its scalar_type, enums map to their underlying
+ *          type.
+ */
+template < typename T, typename = void >
+struct scalar_type_of;
+
+#define KFLY_COMM_SCALAR_TYPE(T, value)                         \
+  template <>                                                   \
+  struct scalar_type_of< T >                                    \
+      : std::integral_constant< scalar_type, scalar_type::value > \
+  {                                                             \
+  }
+
+KFLY_COMM_SCALAR_TYPE(int8_t, int8);
+KFLY_COMM_SCALAR_TYPE(uint8_t, uint8);
+KFLY_COMM_SCALAR_TYPE(int16_t, int16);
+KFLY_COMM_SCALAR_TYPE(uint16_t, uint16);
+KFLY_COMM_SCALAR_TYPE(int32_t, int32);
+KFLY_COMM_SCALAR_TYPE(uint32_t, uint32);
+KFLY_COMM_SCALAR_TYPE(int64_t, int64);
+KFLY_COMM_SCALAR_TYPE(uint64_t, uint64);
+KFLY_COMM_SCALAR_TYPE(float, float32);
+KFLY_COMM_SCALAR_TYPE(double, float64);
+KFLY_COMM_SCALAR_TYPE(bool, boolean);
+
+#undef KFLY_COMM_SCALAR_TYPE
+
+template < typename T >
+struct scalar_type_of<
+    T, typename std::enable_if< std::is_enum< T >::value >::type >
+    : scalar_type_of< typename std::underlying_type< T >::type >
+{
+};
+
+/**
+ * @brief   Flattens a field into scalar columns: scalars give one column,
+ *          arrays one per element and vectors/quaternions one per component.
+ */
+template < typename T >
+void flatten(std::vector< column_info > &columns, const std::string &name,
+             std::size_t offset, T *)
+{
+  columns.push_back(column_info{name, offset, scalar_type_of< T >::value,
+                                sizeof(T)});
+}
+
+template < typename T, std::size_t N >
+void flatten(std::vector< column_info > &columns, const std::string &name,
+             std::size_t offset, T (*)[N])
+{
+  for (std::size_t i = 0; i < N; i++)
+    flatten(columns, name + "[" + std::to_string(i) + "]",
+            offset + i * sizeof(T), static_cast< T * >(nullptr));
+}
+
+inline void flatten(std::vector< column_info > &columns,
+                    const std::string &name, std::size_t offset,
+                    datagrams::vector3f_t *)
+{
+  using V = datagrams::vector3f_t;
+
+  flatten(columns, name + ".x", offset + offsetof(V, x),
+          static_cast< float * >(nullptr));
+  flatten(columns, name + ".y", offset + offsetof(V, y),
+          static_cast< float * >(nullptr));
+  flatten(columns, name + ".z", offset + offsetof(V, z),
+          static_cast< float * >(nullptr));
+}
+
+inline void flatten(std::vector< column_info > &columns,
+                    const std::string &name, std::size_t offset,
+                    datagrams::quaternion_t *)
+{
+  using Q = datagrams::quaternion_t;
+
+  flatten(columns, name + ".w", offset + offsetof(Q, w),
+          static_cast< float * >(nullptr));
+  flatten(columns, name + ".x", offset + offsetof(Q, x),
+          static_cast< float * >(nullptr));
+  flatten(columns, name + ".y", offset + offsetof(Q, y),
+          static_cast< float * >(nullptr));
+  flatten(columns, name + ".z", offset + offsetof(Q, z),
+          static_cast< float * >(nullptr));
+}
+}
+
+/**
+ * @brief   Type traits listing the fields of a datagram, ::add() appends
+ *          its flattened columns.
+ *
+ * @tparam  Datagram    The datagram to list the fields of.
+ */
+template < typename Datagram >
+struct telemetry_fields
+{
+  static_assert(always_false< Datagram >::value,
+                "This datagram has no telemetry fields.");
+};
+
+#define KFLY_COMM_TELEMETRY_FIELD(D, member)                   \
+  details::flatten(c, #member, offsetof(D, member),           \
+                   static_cast< decltype(D::member) * >(nullptr))
+
+template <>
+struct telemetry_fields< datagrams::IMUData >
+{
+  static void add(std::vector< column_info > &c)
+  {
+    using D = datagrams::IMUData;
+
+    KFLY_COMM_TELEMETRY_FIELD(D, accelerometer);
+    KFLY_COMM_TELEMETRY_FIELD(D, gyroscope);
+    KFLY_COMM_TELEMETRY_FIELD(D, magnetometer);
+    KFLY_COMM_TELEMETRY_FIELD(D, temperature);
+    KFLY_COMM_TELEMETRY_FIELD(D, pressure);
+    KFLY_COMM_TELEMETRY_FIELD(D, time_stamp_ns);
+  }
+};
+
+template <>
+struct telemetry_fields< datagrams::RawIMUData >
+{
+  static void add(std::vector< column_info > &c)
+  {
+    using D = datagrams::RawIMUData;
+
+    KFLY_COMM_TELEMETRY_FIELD(D, accelerometer);
+    KFLY_COMM_TELEMETRY_FIELD(D, gyroscope);
+    KFLY_COMM_TELEMETRY_FIELD(D, magnetometer);
+    KFLY_COMM_TELEMETRY_FIELD(D, temperature);
+    KFLY_COMM_TELEMETRY_FIELD(D, pressure);
+    KFLY_COMM_TELEMETRY_FIELD(D, time_stamp_ns);
+  }
+};
+
+template <>
+struct telemetry_fields< datagrams::EstimationAttitude >
+{
+  static void add(std::vector< column_info > &c)
+  {
+    using D = datagrams::EstimationAttitude;
+
+    KFLY_COMM_TELEMETRY_FIELD(D, q);
+    KFLY_COMM_TELEMETRY_FIELD(D, angular_rate);
+    KFLY_COMM_TELEMETRY_FIELD(D, rate_bias);
+  }
+};
+
+template <>
+struct telemetry_fields< datagrams::ControlSignals >
+{
+  static void add(std::vector< column_info > &c)
+  {
+    using D = datagrams::ControlSignals;
+
+    KFLY_COMM_TELEMETRY_FIELD(D, throttle);
+    KFLY_COMM_TELEMETRY_FIELD(D, torque);
+    KFLY_COMM_TELEMETRY_FIELD(D, motor_command);
+  }
+};
+
+template <>
+struct telemetry_fields< datagrams::RCValues >
+{
+  static void add(std::vector< column_info > &c)
+  {
+    using D = datagrams::RCValues;
+
+    KFLY_COMM_TELEMETRY_FIELD(D, calibrated_value);
+    KFLY_COMM_TELEMETRY_FIELD(D, switches);
+    KFLY_COMM_TELEMETRY_FIELD(D, active_connection);
+    KFLY_COMM_TELEMETRY_FIELD(D, num_connections);
+    KFLY_COMM_TELEMETRY_FIELD(D, channel_value);
+    KFLY_COMM_TELEMETRY_FIELD(D, rssi);
+    KFLY_COMM_TELEMETRY_FIELD(D, rssi_frequency);
+    KFLY_COMM_TELEMETRY_FIELD(D, mode);
+  }
+};
+
+#undef KFLY_COMM_TELEMETRY_FIELD
+
+namespace details
+{
+/**
+ * @brief   The flattened columns of a datagram, built on first use.
+ */
+template < typename Datagram >
+const std::vector< column_info > &telemetry_columns()
+{
+  static const std::vector< column_info > columns = [] {
+    std::vector< column_info > c;
+    telemetry_fields< Datagram >::add(c);
+    return c;
+  }();
+
+  return columns;
+}
+
+/**
+ * @brief     Type erased column storage of a telemetry_table.
+ *
+ * @details   Rows are stored in chunks of a fixed number of rows. A chunk is
+ *            one 64 byte aligned allocation holding every column of its rows
+ *            back to back, each column starting on a 64 byte boundary.
+ */
+class column_store
+{
+private:
+  /** @brief The columns. */
+  const std::vector< column_info > &_columns;
+
+  /** @brief Offset of each column in a chunk. */
+  std::vector< std::size_t > _column_offsets;
+
+  /** @brief Rows and bytes per chunk. */
+  std::size_t _chunk_rows;
+  std::size_t _chunk_bytes;
+
+  /** @brief The chunks. */
+  std::vector< std::unique_ptr< uint8_t, void (*)(void *) > > _chunks;
+
+  /** @brief Number of rows stored. */
+  std::size_t _rows;
+
+  /**
+   * @brief   Allocates one more chunk.
+   */
+  void grow();
+
+public:
+  /**
+   * @brief   Constructor.
+   *
+   * @param[in] columns     The columns, must outlive the store.
+   * @param[in] chunk_rows  Rows per chunk, a multiple of 64.
+   */
+  column_store(const std::vector< column_info > &columns,
+               std::size_t chunk_rows);
+
+  /**
+   * @brief   Appends a row, copying each column from its offset in row.
+   */
+  void append(const uint8_t *row);
+
+  /**
+   * @brief   Allocates chunks for at least rows rows.
+   */
+  void reserve(std::size_t rows);
+
+  /**
+   * @brief   Removes all rows, keeping the chunks.
+   */
+  void clear() noexcept
+  {
+    _rows = 0;
+  }
+
+  std::size_t rows() const noexcept
+  {
+    return _rows;
+  }
+
+  std::size_t chunk_rows() const noexcept
+  {
+    return _chunk_rows;
+  }
+
+  /**
+   * @brief   Number of chunks holding rows.
+   */
+  std::size_t chunk_count() const noexcept
+  {
+    return (_rows + _chunk_rows - 1) / _chunk_rows;
+  }
+
+  /**
+   * @brief   Number of rows in a chunk.
+   */
+  std::size_t rows_in_chunk(std::size_t chunk) const noexcept
+  {
+    const std::size_t first = chunk * _chunk_rows;
+    return (first >= _rows) ? 0 : std::min(_chunk_rows, _rows - first);
+  }
+
+  /**
+   * @brief   Start of a column in a chunk.
+   */
+  const uint8_t *column_data(std::size_t column, std::size_t chunk) const
+      noexcept
+  {
+    return _chunks[chunk].get() + _column_offsets[column];
+  }
+};
+}
+
+/**
+ * @brief     Columnar (struct of arrays) store of received datagrams.
+ *
+ * @details   Each scalar field of the datagram, after flattening arrays,
+ *            vectors and quaternions, is stored in its own column. Columns
+ *            are contiguous and 64 byte aligned within chunks of
+ *            chunk_rows() rows, which are exposed as spans for vectorized
+ *            processing. Register append() as a callback to fill the table:
+ *
+ *              telemetry_table< datagrams::IMUData > imu;
+ *              kfly.register_callback(&imu,
+ *                  &telemetry_table< datagrams::IMUData >::append);
+ *
+ * @note      Not thread-safe, read the columns from the appending thread or
+ *            synchronize externally. Spans stay valid until clear().
+ *
+ * @tparam Datagram   Type of the datagram, must have telemetry_fields.
+ */
+template < typename Datagram >
+class telemetry_table
+{
+private:
+  details::column_store _store;
+
+public:
+  /**
+   * @brief   Constructor.
+   *
+   * @param[in] chunk_rows  Rows per chunk, a multiple of 64.
+   */
+  explicit telemetry_table(std::size_t chunk_rows = 4096)
+      : _store(details::telemetry_columns< Datagram >(), chunk_rows)
+  {
+  }
+
+  /**
+   * @brief   Appends a datagram as a new row.
+   */
+  void append(const Datagram &datagram)
+  {
+    _store.append(reinterpret_cast< const uint8_t * >(&datagram));
+  }
+
+  /**
+   * @brief   Allocates room for at least rows rows.
+   */
+  void reserve(std::size_t rows)
+  {
+    _store.reserve(rows);
+  }
+
+  /**
+   * @brief   Removes all rows, keeping the allocated chunks.
+   */
+  void clear() noexcept
+  {
+    _store.clear();
+  }
+
+  /**
+   * @brief   Number of rows.
+   */
+  std::size_t rows() const noexcept
+  {
+    return _store.rows();
+  }
+
+  /**
+   * @brief   Rows per chunk.
+   */
+  std::size_t chunk_rows() const noexcept
+  {
+    return _store.chunk_rows();
+  }
+
+  /**
+   * @brief   Number of chunks holding rows.
+   */
+  std::size_t chunk_count() const noexcept
+  {
+    return _store.chunk_count();
+  }
+
+  /**
+   * @brief   The columns of the datagram.
+   */
+  static const std::vector< column_info > &columns()
+  {
+    return details::telemetry_columns< Datagram >();
+  }
+
+  /**
+   * @brief   Finds a column by name.
+   *
+   * @param[in] name    Name of the column, e.g. "gyroscope[0]".
+   * @return  Index of the column.
+   */
+  static std::size_t column_index(const std::string &name)
+  {
+    const auto &c = columns();
+
+    for (std::size_t i = 0; i < c.size(); i++)
+    {
+      if (c[i].name == name)
+        return i;
+    }
+
+    throw std::invalid_argument("No column named " + name + ".");
+  }
+
+  /**
+   * @brief   The elements of a column in one chunk.
+   *
+   * @param[in] column  Index of the column.
+   * @param[in] chunk   Index of the chunk.
+   *
+   * @tparam T  Element type, must match the column's type.
+   */
+  template < typename T >
+  span< const T > column(std::size_t column, std::size_t chunk) const
+  {
+    if (column >= columns().size() ||
+        columns()[column].type != details::scalar_type_of< T >::value)
+      throw std::invalid_argument("Column type mismatch.");
+
+    if (chunk >= chunk_count())
+      throw std::invalid_argument("No such chunk.");
+
+    return span< const T >(
+        reinterpret_cast< const T * >(_store.column_data(column, chunk)),
+        _store.rows_in_chunk(chunk));
+  }
+
+  /**
+   * @brief   Copies a whole column into contiguous memory.
+   *
+   * @param[in]  column  Index of the column.
+   * @param[out] out     Destination with room for rows() elements.
+   *
+   * @tparam T  Element type, must match the column's type.
+   */
+  template < typename T >
+  void copy_column(std::size_t column, T *out) const
+  {
+    for (std::size_t i = 0; i < chunk_count(); i++)
+    {
+      const auto s = this->template column< T >(column, i);
+      std::memcpy(out, s.data(), s.size() * sizeof(T));
+      out += s.size();
+    }
+  }
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,274 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+/* Threading includes */
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace kfly_comm
+{
+namespace trace
+{
+/**
+ * @brief   Stages of the receive path.
+ */
+enum class stage : uint8_t
+{
+  /** @brief A codec::parse call, SLIP decoding and all frames. */
+  parse,
+
+  /** @brief One frame, from the SLIP decoder to the end of its callbacks. */
+  frame,
+
+  /** @brief Length and CRC check of a frame. */
+  check_frame,
+
+  /** @brief The frame taps. */
+  frame_taps,
+
+  /** @brief Deserialization of the payload and the callbacks. */
+  decode,
+
+  /** @brief The latest cache, callbacks and consumers of a datagram. */
+  callback
+};
+
+/**
+ * @brief   Name of a stage, as shown in the trace viewer.
+ */
+const char *stage_name(stage s) noexcept;
+
+/**
+ * @brief   A finished trace event.
+ */
+struct event
+{
+  /** @brief Start time, in ticks(). */
+  uint64_t begin;
+
+  /** @brief Duration, in ticks(). */
+  uint64_t duration;
+
+  /** @brief The traced stage. */
+  stage what;
+
+  /** @brief The command of the frame, 0 if not frame specific. */
+  uint8_t command;
+};
+
+/**
+ * @brief     A single writer ring of the latest events of one thread.
+ *
+ * @details   The owning thread claims a slot, writes it and publishes it,
+ *            all relaxed except two fences. Readers copy the published
+ *            events and drop the ones the writer may have overwritten
+ *            meanwhile, so neither side ever waits.
+ */
+class event_ring
+{
+public:
+  /** @brief Number of events kept, the oldest are overwritten. */
+  static constexpr std::size_t capacity = 1 << 14;
+
+private:
+  struct slot
+  {
+    std::atomic< uint64_t > begin;
+    std::atomic< uint64_t > info;
+  };
+
+  /** @brief Index of the next event to be written. */
+  std::atomic< uint64_t > _claimed;
+
+  /** @brief Events before this index are completely written. */
+  std::atomic< uint64_t > _published;
+
+  /** @brief Events before this index were cleared. */
+  std::atomic< uint64_t > _start;
+
+  /** @brief Thread number shown in the trace viewer. */
+  const uint32_t _thread_id;
+
+  slot _slots[capacity];
+
+public:
+  explicit event_ring(uint32_t thread_id) noexcept;
+
+  event_ring(const event_ring &) = delete;
+  event_ring &operator=(const event_ring &) = delete;
+
+  /**
+   * @brief   Records an event, owning thread only.
+   */
+  void push(const uint64_t begin, const uint64_t duration, const stage what,
+            const uint8_t command) noexcept
+  {
+    const uint64_t index = _claimed.load(std::memory_order_relaxed);
+    slot &s              = _slots[index & (capacity - 1)];
+
+    /* Readers seeing the new slot contents also see the claim. */
+    _claimed.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s.begin.store(begin, std::memory_order_relaxed);
+    s.info.store((duration << 16) | (uint64_t(what) << 8) | command,
+                 std::memory_order_relaxed);
+
+    _published.store(index + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief   Thread number of the ring.
+   */
+  uint32_t thread_id() const noexcept
+  {
+    return _thread_id;
+  }
+
+  /**
+   * @brief   Copies the events in the ring, from any thread.
+   *
+   * @param[out] out  Receives the events, oldest first.
+   * @param[in] max   Size of out.
+   *
+   * @return  Number of events copied.
+   */
+  std::size_t copy(event *out, std::size_t max) const noexcept;
+
+  /**
+   * @brief   Drops all events, owning thread only.
+   */
+  void clear() noexcept;
+};
+
+/**
+ * @brief   Ring of the calling thread, taken on first use from the rings of
+ *          exited threads or created.
+ */
+event_ring &thread_ring();
+
+/**
+ * @brief   Steady clock time in nanoseconds.
+ */
+inline uint64_t now_ns() noexcept
+{
+  return static_cast< uint64_t >(
+      std::chrono::duration_cast< std::chrono::nanoseconds >(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+/**
+ * @brief   Time stamp of an event: the TSC on x86, which costs a fraction
+ *          of a clock read and is converted when the events are written, or
+ *          steady clock nanoseconds elsewhere.
+ */
+inline uint64_t ticks() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return now_ns();
+#endif
+}
+
+/**
+ * @brief   Tracer recording nothing, every use compiles away. Code templated
+ *          on the tracer can be compared with and without tracing.
+ */
+struct null_tracer
+{
+  struct scope
+  {
+    explicit scope(stage, uint8_t = 0) noexcept
+    {
+    }
+  };
+};
+
+/**
+ * @brief   Tracer recording scopes into the ring of the calling thread.
+ */
+struct ring_tracer
+{
+  class scope
+  {
+  private:
+    event_ring &_ring;
+    const uint64_t _begin;
+    const stage _what;
+    const uint8_t _command;
+
+  public:
+    explicit scope(stage what, uint8_t command = 0)
+        : _ring(thread_ring()),
+          _begin(ticks()),
+          _what(what),
+          _command(command)
+    {
+    }
+
+    ~scope()
+    {
+      _ring.push(_begin, ticks() - _begin, _what, _command);
+    }
+
+    scope(const scope &) = delete;
+    scope &operator=(const scope &) = delete;
+  };
+};
+
+/**
+ * @brief   Writes the events of all threads in the Chrome trace event
+ *          format, for chrome://tracing or Perfetto.
+ *
+ * @param[out] out  The stream to write to.
+ */
+void write_chrome_json(std::ostream &out);
+
+/**
+ * @brief   Writes the events of all threads to a Chrome trace event file.
+ *
+ * @param[in] file  Path of the file.
+ */
+void write_chrome_json(const std::string &file);
+
+/**
+ * @brief   Drops the events of the calling thread.
+ */
+void clear_thread();
+
+}  // namespace trace
+
+}  // namespace kfly_comm
+
+#define KFLY_COMM_TRACE_CONCAT_(a, b) a##b
+#define KFLY_COMM_TRACE_CONCAT(a, b) KFLY_COMM_TRACE_CONCAT_(a, b)
+
+/**
+ * @brief   Traces the rest of the enclosing scope as a stage, with an
+ *          optional command. Expands to nothing unless KFLY_COMM_TRACING is
+ *          defined, which the CMake option of the same name does for the
+ *          library and everything linking it.
+ */
+#ifdef KFLY_COMM_TRACING
+#define KFLY_COMM_TRACE_SCOPE(...)                                       \
+  const ::kfly_comm::trace::ring_tracer::scope KFLY_COMM_TRACE_CONCAT( \
+      _kfly_comm_trace_scope_, __LINE__)(__VA_ARGS__)
+#else
+#define KFLY_COMM_TRACE_SCOPE(...) static_cast< void >(0)
+#endif
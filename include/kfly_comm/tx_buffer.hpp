@@ -0,0 +1,135 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "kfly_comm/commands.hpp"
+#include "kfly_comm/datagrams.hpp"
+#include "kfly_comm/datagram_traits.hpp"
+#include "kfly_comm/packet.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief     A preallocated transmit buffer which packets are encoded into
+ *            back to back, so a batch of packets can be sent with one write.
+ *
+ * @details   The storage is allocated once at construction, appending a
+ *            packet only encodes into the free space. After the contents
+ *            have been written out the buffer is reused with clear().
+ */
+class tx_buffer
+{
+private:
+  /** @brief The storage. */
+  std::vector< uint8_t > _buffer;
+
+  /** @brief Number of bytes used. */
+  std::size_t _size;
+
+public:
+  /**
+   * @brief   Constructor, allocates the storage.
+   *
+   * @param[in] capacity  Size of the storage in bytes.
+   */
+  explicit tx_buffer(std::size_t capacity) : _buffer(capacity), _size(0)
+  {
+  }
+
+  /**
+   * @brief   Appends an encoded packet of a datagram.
+   *
+   * @param[in] datagram  The Datagram to be encoded.
+   * @param[in] ack       If true, then an ack is requested.
+   *
+   * @return  False if the free space cannot hold the worst case encoding of
+   *          the packet, nothing is appended then.
+   */
+  template < typename Datagram >
+  bool append(const Datagram &datagram, bool ack = false)
+  {
+    if (free_space() < max_encoded_size< Datagram >::value)
+      return false;
+
+    _size += encode_packet(
+        command_traits::get_packet_command< Datagram >::value, datagram, ack,
+        _buffer.data() + _size, free_space());
+
+    return true;
+  }
+
+  /**
+   * @brief   Appends an encoded command (no datagram).
+   *
+   * @param[in] command   The command to send.
+   * @param[in] ack       If true, then an ack is requested.
+   *
+   * @return  False if the free space cannot hold the packet.
+   */
+  bool append_command(commands command, bool ack = false)
+  {
+    if (free_space() < max_encoded_size< datagrams::Ack, false >::value)
+      return false;
+
+    _size += encode_packet< datagrams::Ack, false >(
+        command, datagrams::Ack{}, ack, _buffer.data() + _size, free_space());
+
+    return true;
+  }
+
+  /**
+   * @brief   Removes all contents, the storage is kept.
+   */
+  void clear() noexcept
+  {
+    _size = 0;
+  }
+
+  /**
+   * @brief   Pointer to the encoded packets.
+   */
+  const uint8_t *data() const noexcept
+  {
+    return _buffer.data();
+  }
+
+  /**
+   * @brief   Number of bytes of encoded packets.
+   */
+  std::size_t size() const noexcept
+  {
+    return _size;
+  }
+
+  /**
+   * @brief   Checks if the buffer is empty.
+   */
+  bool empty() const noexcept
+  {
+    return _size == 0;
+  }
+
+  /**
+   * @brief   Size of the storage in bytes.
+   */
+  std::size_t capacity() const noexcept
+  {
+    return _buffer.size();
+  }
+
+  /**
+   * @brief   Number of unused bytes in the storage.
+   */
+  std::size_t free_space() const noexcept
+  {
+    return _buffer.size() - _size;
+  }
+};
+
+}  // namespace kfly_comm
@@ -0,0 +1,634 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <array>
+#include <chrono>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+
+/* Data includes */
+#include <memory>
+#include <vector>
+
+/* Threading includes */
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/* KFly includes */
+#include "kfly_comm/kfly_comm.hpp"
+#include "kfly_comm/fd_io.hpp"
+#include "kfly_comm/mpsc_queue.hpp"
+#include "kfly_comm/seqlock.hpp"
+
+namespace kfly_comm
+{
+/**
+ * @brief   Priority classes of transmitted frames, highest first.
+ */
+enum class tx_priority : uint8_t
+{
+  /** @brief Real-time control, e.g. ComputerControlReference. */
+  control,
+
+  /** @brief Requests and everything else. */
+  normal,
+
+  /** @brief Configuration uploads and flash operations. */
+  bulk
+};
+
+/** @brief Number of priority classes. */
+constexpr std::size_t tx_priority_count = 3;
+
+/**
+ * @brief   The class a command is sent with by default.
+ */
+constexpr tx_priority default_priority(const commands command)
+{
+  switch (command)
+  {
+    case commands::ComputerControlReference:
+    case commands::MotionCaptureMeasurement:
+    case commands::MotorOverride:
+      return tx_priority::control;
+
+    case commands::SetDeviceStrings:
+    case commands::SaveToFlash:
+    case commands::EraseFlash:
+    case commands::SetControllerLimits:
+    case commands::SetArmSettings:
+    case commands::SetRateControllerData:
+    case commands::SetAttitudeControllerData:
+    case commands::SetVelocityControllerData:
+    case commands::SetPositionControllerData:
+    case commands::SetChannelMix:
+    case commands::SetRCInputSettings:
+    case commands::SetRCOutputSettings:
+    case commands::SetIMUCalibration:
+    case commands::SetControlFilters:
+      return tx_priority::bulk;
+
+    default:
+      return tx_priority::normal;
+  }
+}
+
+/**
+ * @brief   Settings of a tx_scheduler.
+ */
+struct tx_scheduler_options
+{
+  /** @brief Baudrate of the link the writes are paced to, 0 to write as
+   *         fast as the file descriptor accepts. */
+  unsigned baudrate = 0;
+
+  /** @brief Wire time handed to the driver ahead of the transmission when
+   *         paced. A new frame waits at most this plus one frame. */
+  std::chrono::microseconds window = std::chrono::microseconds(1000);
+
+  /** @brief Nodes preallocated for queued frames and recycled once
+   *         written, further frames are allocated while all are in use. */
+  std::size_t pool_size = 256;
+
+  /** @brief Counters the written frames are recorded in, e.g. the
+   *         statistics() of the link's codec, nullptr for none. */
+  link_statistics *statistics = nullptr;
+};
+
+/**
+ * @brief   Counters of a priority class.
+ */
+struct tx_class_statistics
+{
+  /** @brief Frames written. */
+  uint64_t frames;
+
+  /** @brief Bytes written. */
+  uint64_t bytes;
+
+  /** @brief Summed time from send to the write of the frame, in ns. */
+  uint64_t latency_ns;
+
+  /** @brief Longest time from send to the write of a frame, in ns. */
+  uint64_t max_latency_ns;
+
+  /**
+   * @brief   Mean time from send to write, in ns.
+   */
+  double mean_latency_ns() const noexcept
+  {
+    return frames > 0 ? static_cast< double >(latency_ns) / frames : 0;
+  }
+};
+
+/**
+ * @brief   Counters of a tx_scheduler.
+ */
+struct tx_scheduler_statistics
+{
+  /** @brief Per priority class, indexed by tx_priority. */
+  std::array< tx_class_statistics, tx_priority_count > classes;
+
+  /** @brief Write calls, frames per write shows the coalescing. */
+  uint64_t writes;
+};
+
+/**
+ * @brief   Counters of a tx_mailbox.
+ */
+struct tx_mailbox_statistics
+{
+  /** @brief Samples posted. */
+  uint64_t posted;
+
+  /** @brief Samples written. */
+  uint64_t sent;
+
+  /** @brief Samples overwritten by a newer one before they were written. */
+  uint64_t superseded;
+};
+
+namespace details
+{
+class tx_mailbox_base;
+
+/** @brief Largest frame held by a node, a full packet with every byte
+ *         escaped. */
+constexpr std::size_t tx_frame_capacity =
+    slip::max_encoded_size(max_frame_size);
+
+/**
+ * @brief   A frame waiting for transmission.
+ */
+struct tx_node : mpsc_node
+{
+  tx_priority priority;
+
+  /** @brief The mailbox owning the node, which encodes its freshest sample
+   *          when the node is gathered, nullptr for a queued frame. */
+  tx_mailbox_base *mailbox;
+
+  /** @brief Position in the scheduler's pool plus one, 0 for an allocated
+   *         or mailbox node. */
+  uint32_t pool_index;
+
+  /** @brief Pool position plus one of the next free node, while free. */
+  std::atomic< uint32_t > next_free;
+
+  std::chrono::steady_clock::time_point enqueued;
+  std::size_t size;
+  uint8_t data[tx_frame_capacity];
+};
+}
+
+template < typename Datagram >
+class tx_mailbox;
+
+/**
+ * @brief     Transmits the frames of many producer threads in priority
+ *            order, coalesced into single writes.
+ *
+ * @details   Producers encode into a node and push it on a lock-free MPSC
+ *            queue, waking the scheduler thread only when it sleeps. The
+ *            thread sorts the nodes into one FIFO per priority class and
+ *            gathers the highest classes first into one writev per
+ *            wakeup. Nodes come from a preallocated pool and return to it
+ *            once written, so sending does not allocate.
+ *
+ *            Unpaced, everything pending is written at once. Paced to a
+ *            baudrate, the thread tracks when the wire drains and only
+ *            hands the driver a window of wire time ahead, so a control
+ *            frame sent during a configuration upload waits behind at most
+ *            the window and one frame, not the driver's whole buffer:
+ *
+ *              serial_link link(kfly, "/dev/ttyUSB0", 115200);
+ *
+ *              tx_scheduler_options o;
+ *              o.baudrate   = 115200;
+ *              o.statistics = &kfly.statistics();
+ *
+ *              tx_scheduler tx(link.native_handle(), o);
+ *
+ *              tx.send(reference);  // Control, first out.
+ *              tx.send(mix);        // Bulk.
+ *
+ *            Streams where only the freshest sample matters, e.g.
+ *            ComputerControlReference and MotionCaptureFrame, are posted
+ *            to a mailbox instead. A post replaces the unsent sample, which
+ *            is encoded when the mailbox's turn comes, so a control loop
+ *            outrunning the link sends fewer, fresh samples rather than a
+ *            growing backlog:
+ *
+ *              tx.post(reference);
+ *
+ * @note      Linux only. The file descriptor is not owned, all
+ *            transmissions should go through the scheduler. Classes are
+ *            strictly ordered, a saturated higher class starves the lower
+ *            ones.
+ */
+class tx_scheduler
+{
+public:
+  /** @brief Largest frame held by a node, a full packet with every byte
+   *         escaped. */
+  static constexpr std::size_t frame_capacity = details::tx_frame_capacity;
+
+private:
+  using node = details::tx_node;
+
+  /**
+   * @brief   Atomic counters of a priority class, written by the thread.
+   */
+  struct class_counters
+  {
+    std::atomic< uint64_t > frames, bytes, latency_ns, max_latency_ns;
+  };
+
+  /** @brief Settings. */
+  const tx_scheduler_options _options;
+
+  /** @brief The file descriptor written to. */
+  const int _fd;
+
+  /** @brief Event used to wake the thread. */
+  details::wake_event _wake;
+
+  /** @brief Preallocated nodes, and the head of their free list: the pool
+   *         position plus one in the low half, a tag counting the changes
+   *         in the high half so a stale exchange fails. */
+  std::unique_ptr< node[] > _pool;
+  std::atomic< uint64_t > _free;
+
+  /** @brief Frames from the producers. */
+  mpsc_queue< node > _queue;
+
+  /** @brief Set while the thread sleeps, producers then wake it. */
+  std::atomic< bool > _sleeping;
+
+  /** @brief Frames sorted by class, thread only. */
+  std::array< std::deque< node * >, tx_priority_count > _pending;
+
+  /** @brief Frames of the write in progress and the bytes of the first
+   *         one already written, thread only. */
+  std::deque< node * > _batch;
+  std::size_t _batch_offset;
+
+  /** @brief Time the paced wire drains, thread only. */
+  std::chrono::steady_clock::time_point _wire_free;
+
+  /** @brief Counters. */
+  std::array< class_counters, tx_priority_count > _counters;
+  std::atomic< uint64_t > _writes;
+
+  /** @brief The mailboxes, by command, and their storage. */
+  std::array< std::atomic< details::tx_mailbox_base * >, 128 > _mailbox_index;
+  std::vector< std::unique_ptr< details::tx_mailbox_base > > _mailboxes;
+  std::mutex _mailbox_lock;
+
+  std::atomic< bool > _running;
+
+  /** @brief The errno which stopped the thread, 0 if none. */
+  std::atomic< int > _error;
+
+  std::thread _thread;
+
+  /** @brief Mailboxes queue their node. */
+  friend class details::tx_mailbox_base;
+
+  /**
+   * @brief   The thread's loop.
+   */
+  void run();
+
+  /**
+   * @brief   Moves the queued nodes to the class FIFOs.
+   */
+  void drain_queue();
+
+  /**
+   * @brief   Fills the batch with the highest priority frames the pacing
+   *          allows.
+   */
+  void gather(std::chrono::steady_clock::time_point now);
+
+  /**
+   * @brief   Writes the batch.
+   *
+   * @return  False if the link failed.
+   */
+  bool write_batch(bool &would_block);
+
+  /**
+   * @brief   Time the next batch may be gathered, paced only.
+   */
+  std::chrono::steady_clock::time_point next_gather() const;
+
+  /**
+   * @brief   Takes a node for a frame from the pool, or allocates one if the
+   *          pool is empty, stamped with the current time.
+   */
+  node *make_node(tx_priority priority, std::size_t size);
+
+  /**
+   * @brief   Returns a written or dropped node to the pool, or frees it.
+   *          Mailbox nodes stay with their mailbox.
+   */
+  void release(node *n) noexcept;
+
+  /**
+   * @brief   Queues a filled node and wakes the thread if it sleeps. Only
+   *          the link of the node is written, a mailbox node may still be
+   *          in the batch being written.
+   */
+  void enqueue(node *n);
+
+public:
+  /**
+   * @brief   Starts the scheduler thread.
+   *
+   * @param[in] fd        The file descriptor to write to, not owned, made
+   *                      non-blocking.
+   * @param[in] options   Settings.
+   */
+  explicit tx_scheduler(int fd, const tx_scheduler_options &options =
+                                    tx_scheduler_options());
+
+  /**
+   * @brief   Stops the thread, unsent frames are dropped.
+   */
+  ~tx_scheduler();
+
+  tx_scheduler(const tx_scheduler &) = delete;
+  tx_scheduler &operator=(const tx_scheduler &) = delete;
+
+  /**
+   * @brief   Encodes and queues a datagram with the class of its command.
+   *
+   * @param[in] datagram  The Datagram to send.
+   * @param[in] ack       If true, then an ack is requested.
+   */
+  template < typename Datagram >
+  void send(const Datagram &datagram, bool ack = false)
+  {
+    constexpr commands command =
+        command_traits::get_packet_command< Datagram >::value;
+
+    send(default_priority(command), datagram, ack);
+  }
+
+  /**
+   * @brief   Encodes and queues a datagram with a class.
+   *
+   * @param[in] priority  The class.
+   * @param[in] datagram  The Datagram to send.
+   * @param[in] ack       If true, then an ack is requested.
+   */
+  template < typename Datagram >
+  void send(tx_priority priority, const Datagram &datagram, bool ack = false)
+  {
+    static_assert(max_encoded_size< Datagram >::value <= frame_capacity,
+                  "The datagram does not fit a frame.");
+
+    node *n = make_node(priority, 0);
+    n->size = codec::generate_packet_into(datagram, n->data,
+                                          sizeof(n->data), ack);
+    enqueue(n);
+  }
+
+  /**
+   * @brief   Queues a command without datagram with the class of the
+   *          command, from the pre-encoded frames.
+   *
+   * @param[in] command   The command.
+   * @param[in] ack       If true, then an ack is requested.
+   */
+  void send_command(commands command, bool ack = false);
+
+  /**
+   * @brief   Queues an encoded frame with a class.
+   *
+   * @param[in] priority  The class.
+   * @param[in] data      Pointer to the frame.
+   * @param[in] size      Size of the frame, at most frame_capacity.
+   */
+  void send(tx_priority priority, const uint8_t *data,
+            const std::size_t size);
+
+  /**
+   * @brief   Queues an encoded frame with the class of its command, e.g. as
+   *          the send function of a request_engine or clock_sync.
+   *
+   * @param[in] data      Pointer to the frame.
+   * @param[in] size      Size of the frame, at most frame_capacity.
+   */
+  void send(const uint8_t *data, const std::size_t size);
+
+  /**
+   * @brief   The mailbox of a datagram, created on first use and owned by
+   *          the scheduler.
+   *
+   * @return  The mailbox, valid for the lifetime of the scheduler.
+   */
+  template < typename Datagram >
+  tx_mailbox< Datagram > &mailbox();
+
+  /**
+   * @brief   Posts a datagram to its mailbox, replacing an unsent one.
+   *
+   * @param[in] datagram  The Datagram to send.
+   */
+  template < typename Datagram >
+  void post(const Datagram &datagram);
+
+  /**
+   * @brief   The counters, from any thread.
+   */
+  tx_scheduler_statistics statistics() const noexcept;
+
+  /**
+   * @brief   Checks if the thread is running.
+   *
+   * @return  False if a write failed.
+   */
+  bool is_running() const noexcept
+  {
+    return _running.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief   The errno which stopped the thread, 0 if none.
+   */
+  int error() const noexcept
+  {
+    return _error.load(std::memory_order_relaxed);
+  }
+};
+
+namespace details
+{
+/**
+ * @brief     The type independent part of a tx_mailbox.
+ *
+ * @details   The mailbox owns one node, queued on the scheduler when a
+ *            sample is posted and the node is not queued already. The
+ *            scheduler thread encodes the freshest sample into the node when
+ *            it gathers it, skipping samples sent before.
+ */
+class tx_mailbox_base
+{
+private:
+  /** @brief The scheduler the node is queued on. */
+  tx_scheduler &_scheduler;
+
+  /** @brief Set while the node is queued. */
+  std::atomic< bool > _queued;
+
+  /** @brief Sequence of the latest sample sent, scheduler thread only. */
+  uint64_t _last_sent;
+
+  /** @brief Counters. */
+  std::atomic< uint64_t > _posted, _sent, _superseded;
+
+protected:
+  /** @brief The node, encoded by the scheduler thread. */
+  tx_node _node;
+
+  /**
+   * @brief   Encodes the freshest sample into the node, scheduler thread.
+   *
+   * @param[out] sequence   Number of posts up to the sample.
+   * @param[out] posted     Time the sample was posted.
+   */
+  virtual void encode_latest(uint64_t &sequence,
+                             std::chrono::steady_clock::time_point &posted) = 0;
+
+  /**
+   * @brief   Queues the node unless it is queued, poster only.
+   */
+  void notify();
+
+public:
+  tx_mailbox_base(tx_scheduler &scheduler, tx_priority priority,
+                  std::size_t frame_size);
+
+  virtual ~tx_mailbox_base();
+
+  tx_mailbox_base(const tx_mailbox_base &) = delete;
+  tx_mailbox_base &operator=(const tx_mailbox_base &) = delete;
+
+  /**
+   * @brief   Encodes the freshest sample into the node, scheduler thread.
+   *
+   * @return  False if the sample was already sent.
+   */
+  bool take();
+
+  /**
+   * @brief   The counters, from any thread.
+   */
+  tx_mailbox_statistics statistics() const noexcept;
+};
+}
+
+/**
+ * @brief     A latest-wins mailbox for an uplink datagram, see
+ *            tx_scheduler::mailbox.
+ *
+ * @note      Only one thread may post to a mailbox at a time.
+ *
+ * @tparam Datagram   A datagram with a get_packet_command trait.
+ */
+template < typename Datagram >
+class tx_mailbox : public details::tx_mailbox_base
+{
+private:
+  static_assert(max_encoded_size< Datagram >::value <=
+                    details::tx_frame_capacity,
+                "The datagram does not fit a frame.");
+
+  /**
+   * @brief   A posted sample.
+   */
+  struct sample
+  {
+    Datagram value;
+    std::chrono::steady_clock::time_point posted;
+  };
+
+  /** @brief The latest sample. */
+  seqlock< sample > _sample;
+
+  void encode_latest(uint64_t &sequence,
+                     std::chrono::steady_clock::time_point &posted) override
+  {
+    const sample s = _sample.load(sequence);
+
+    posted     = s.posted;
+    _node.size = codec::generate_packet_into(s.value, _node.data,
+                                             sizeof(_node.data));
+  }
+
+public:
+  /**
+   * @brief   Constructor, used by tx_scheduler::mailbox.
+   */
+  tx_mailbox(tx_scheduler &scheduler, tx_priority priority)
+      : tx_mailbox_base(scheduler, priority, 4 + sizeof(Datagram))
+  {
+  }
+
+  /**
+   * @brief   Replaces the pending sample, wait-free.
+   *
+   * @param[in] datagram  The Datagram to send.
+   */
+  void post(const Datagram &datagram) noexcept
+  {
+    _sample.store(sample{datagram, std::chrono::steady_clock::now()});
+    notify();
+  }
+};
+
+template < typename Datagram >
+tx_mailbox< Datagram > &tx_scheduler::mailbox()
+{
+  constexpr commands command =
+      command_traits::get_packet_command< Datagram >::value;
+  auto &slot = _mailbox_index[static_cast< uint8_t >(command) & 0x7f];
+
+  details::tx_mailbox_base *box = slot.load(std::memory_order_acquire);
+
+  if (box == nullptr)
+  {
+    std::lock_guard< std::mutex > lock(_mailbox_lock);
+
+    box = slot.load(std::memory_order_relaxed);
+
+    if (box == nullptr)
+    {
+      std::unique_ptr< details::tx_mailbox_base > created(
+          new tx_mailbox< Datagram >(*this, default_priority(command)));
+
+      box = created.get();
+      _mailboxes.push_back(std::move(created));
+      slot.store(box, std::memory_order_release);
+    }
+  }
+
+  return static_cast< tx_mailbox< Datagram > & >(*box);
+}
+
+template < typename Datagram >
+void tx_scheduler::post(const Datagram &datagram)
+{
+  mailbox< Datagram >().post(datagram);
+}
+
+}  // namespace kfly_comm
@@ -0,0 +1,687 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_sim.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace kfly_sim
+{
+using namespace kfly_comm;
+using kfly_comm::details::throw_errno;
+
+namespace
+{
+/**
+ * @brief   Longest time the thread sleeps without events.
+ */
+constexpr std::chrono::milliseconds max_sleep(100);
+
+/**
+ * @brief   Bits per byte on a 8N1 serial line.
+ */
+constexpr unsigned bits_per_byte = 10;
+}
+
+/*********************************
+ * Answers
+ ********************************/
+
+namespace details
+{
+/**
+ * @brief   Answers Get commands with the state of a datagram and stores it
+ *          for Set commands.
+ */
+template < typename Datagram >
+struct answer< Datagram, false >
+{
+  static void get(endpoint &e, commands cmd)
+  {
+    Datagram datagram;
+
+    {
+      std::lock_guard< std::mutex > lock(e._state_lock);
+      e.animate(cmd);
+      datagram = std::get< Datagram >(e._state);
+    }
+
+    uint8_t buffer[max_encoded_size< Datagram >::value];
+    e.append(buffer,
+             encode_packet(cmd, datagram, false, buffer, sizeof(buffer)));
+  }
+
+  static void set(endpoint &e, const uint8_t *payload, std::size_t size)
+  {
+    /* Throws on a payload of the wrong size. */
+    const Datagram datagram =
+        serializable_datagram< Datagram >(payload, size).datagram;
+
+    std::lock_guard< std::mutex > lock(e._state_lock);
+    std::get< Datagram >(e._state) = datagram;
+  }
+};
+
+/**
+ * @brief   Commands with an empty datagram, Ping and ACK, are echoed.
+ */
+template < typename Datagram >
+struct answer< Datagram, true >
+{
+  static void get(endpoint &e, commands cmd)
+  {
+    uint8_t buffer[max_encoded_size< datagrams::Ack, false >::value];
+    e.append(buffer, codec::generate_command_into(cmd, buffer, sizeof(buffer)));
+  }
+
+  static void set(endpoint &, const uint8_t *, std::size_t)
+  {
+  }
+};
+}
+
+namespace
+{
+/**
+ * @brief   The handlers of a command.
+ */
+struct handlers
+{
+  void (*get)(endpoint &, commands);
+  void (*set)(endpoint &, const uint8_t *, std::size_t);
+};
+
+template < typename Datagram >
+struct command_handlers
+{
+  static constexpr handlers value = {
+      &details::answer< Datagram, std::is_empty< Datagram >::value >::get,
+      &details::answer< Datagram, std::is_empty< Datagram >::value >::set};
+};
+
+/**
+ * @brief   Commands without a datagram are only ACKed.
+ */
+template <>
+struct command_handlers< void >
+{
+  static constexpr handlers value = {nullptr, nullptr};
+};
+
+template < typename Datagram >
+constexpr handlers command_handlers< Datagram >::value;
+
+constexpr handlers command_handlers< void >::value;
+
+template < std::size_t... Commands >
+constexpr std::array< handlers, 128 > make_table(
+    std::index_sequence< Commands... >)
+{
+  return {{command_handlers<
+      kfly_comm::details::command_datagram_t< Commands > >::value...}};
+}
+
+/**
+ * @brief   Handlers of each command, by the command value.
+ */
+constexpr std::array< handlers, 128 > table =
+    make_table(std::make_index_sequence< 128 >{});
+}
+
+/*********************************
+ * Functions
+ ********************************/
+
+pty open_pty()
+{
+  pty p;
+
+  p.master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (p.master < 0)
+    throw_errno("Unable to open a pseudo-terminal");
+
+  if (grantpt(p.master) < 0 || unlockpt(p.master) < 0)
+  {
+    const int err = errno;
+    close(p.master);
+    throw std::system_error(err, std::system_category(),
+                            "Unable to unlock the pseudo-terminal");
+  }
+
+  p.slave_path = ptsname(p.master);
+  p.slave      = open(p.slave_path.c_str(), O_RDWR | O_NOCTTY);
+
+  struct termios tty;
+
+  if (p.slave < 0 || tcgetattr(p.slave, &tty) < 0)
+  {
+    const int err = errno;
+    close(p.master);
+    throw std::system_error(err, std::system_category(),
+                            "Unable to open the pseudo-terminal slave");
+  }
+
+  /* Raw, so the line discipline does not touch the frames. */
+  cfmakeraw(&tty);
+  tcsetattr(p.slave, TCSANOW, &tty);
+
+  return p;
+}
+
+/*********************************
+ * Private members
+ ********************************/
+
+void endpoint::run()
+{
+  std::vector< uint8_t > rx_buffer(4096);
+
+  while (_running.load(std::memory_order_relaxed))
+  {
+    {
+      std::lock_guard< std::mutex > lock(_queue_lock);
+
+      for (const auto &frame : _queued)
+        append(frame.data(), frame.size());
+
+      _queued.clear();
+    }
+
+    const auto next_publish = publish();
+
+    if (!transmit())
+      break;
+
+    /* Sleep until the next subscription, the port or a request. */
+    const auto now     = std::chrono::steady_clock::now();
+    const bool pending = _tx_offset < _tx_buffer.size();
+    auto wake_up       = std::min(next_publish, now + max_sleep);
+    bool wait_writable = false;
+
+    if (pending)
+    {
+      if (_tx_free > now)
+        wake_up = std::min(wake_up, _tx_free);
+      else
+        wait_writable = true;
+    }
+
+    const auto sleep = std::max(std::chrono::steady_clock::duration(0),
+                                wake_up - now);
+    const auto ns =
+        std::chrono::duration_cast< std::chrono::nanoseconds >(sleep).count();
+
+    struct timespec timeout;
+    timeout.tv_sec  = ns / 1000000000;
+    timeout.tv_nsec = ns % 1000000000;
+
+    struct pollfd fds[2];
+    fds[0].fd      = _fd;
+    fds[0].events  = POLLIN | (wait_writable ? POLLOUT : 0);
+    fds[0].revents = 0;
+    fds[1].fd      = _wake->native_handle();
+    fds[1].events  = POLLIN;
+    fds[1].revents = 0;
+
+    if (ppoll(fds, 2, &timeout, nullptr) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      break;
+    }
+
+    if (fds[1].revents & POLLIN)
+      _wake->clear();
+
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+    {
+      const ssize_t n = read(_fd, rx_buffer.data(), rx_buffer.size());
+
+      if (n > 0)
+        _parser.parse(
+            rx_buffer.data(), static_cast< std::size_t >(n),
+            [this](const uint8_t *frame, std::size_t size, std::size_t) {
+              on_request(frame, size);
+            },
+            [](std::size_t) {});
+      else if (n == 0 ||
+               (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        break;
+    }
+  }
+
+  _running = false;
+}
+
+void endpoint::append(const uint8_t *data, std::size_t size)
+{
+  if (size == 0)
+    return;
+
+  /* Drop what was sent before growing the buffer. */
+  if (_tx_offset == _tx_buffer.size())
+  {
+    _tx_buffer.clear();
+    _tx_frame_ends.clear();
+    _tx_offset = 0;
+  }
+
+  const std::size_t start = _tx_buffer.size();
+  _tx_buffer.insert(_tx_buffer.end(), data, data + size);
+  _tx_frame_ends.push_back(_tx_buffer.size());
+
+  inject_errors(_tx_buffer.data() + start, size);
+  _tx_frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void endpoint::on_request(const uint8_t *frame, std::size_t size)
+{
+  if (size < 4 || static_cast< std::size_t >(frame[1]) + 4 != size)
+    return;
+
+  const uint8_t command = frame[0] & 0x7f;
+  const bool ack        = (frame[0] & 0x80) != 0;
+
+  /* The CRC does not cover the ack bit. */
+  const uint16_t crc = CRC16_CCITT::generateCRC(
+      frame + 1, size - 3, CRC16_CCITT::generateCRC(command));
+
+  if ((frame[size - 2] | (frame[size - 1] << 8)) != crc)
+    return;
+
+  _rx_frames.fetch_add(1, std::memory_order_relaxed);
+  const uint8_t *payload = frame + 2;
+  const std::size_t payload_size = size - 4;
+
+  try
+  {
+    if (static_cast< commands >(command) == commands::ManageSubscriptions)
+    {
+      on_subscription(serializable_datagram< datagrams::ManageSubscription >(
+                          payload, payload_size)
+                          .datagram);
+    }
+    else if (payload_size == 0)
+    {
+      if (table[command].get != nullptr)
+        table[command].get(*this, static_cast< commands >(command));
+    }
+    else if (table[command].set != nullptr)
+    {
+      table[command].set(*this, payload, payload_size);
+    }
+  }
+  catch (const std::invalid_argument &)
+  {
+    /* A payload of the wrong size, KFly ignores it. */
+    return;
+  }
+
+  if (ack)
+  {
+    uint8_t buffer[max_encoded_size< datagrams::Ack, false >::value];
+    append(buffer, codec::generate_command_into(commands::ACK, buffer,
+                                                sizeof(buffer)));
+    _acks.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void endpoint::on_subscription(const datagrams::ManageSubscription &s)
+{
+  const auto now = std::chrono::steady_clock::now();
+
+  /* Unsubscribe from all. */
+  if (s.cmd == commands::None && !s.subscribe)
+  {
+    for (auto &sub : _subscriptions)
+      sub.active = false;
+
+    return;
+  }
+
+  const uint8_t command = static_cast< uint8_t >(s.cmd) & 0x7f;
+  subscription &sub     = _subscriptions[command];
+
+  if (!s.subscribe || table[command].get == nullptr)
+  {
+    sub.active = false;
+    return;
+  }
+
+  /* Copied out of the packed datagram, it cannot be bound to a reference. */
+  const uint32_t delta_ms = s.delta_ms;
+
+  sub.period = std::chrono::milliseconds(std::max< uint32_t >(1, delta_ms));
+  sub.next   = now;
+  sub.active = true;
+}
+
+std::chrono::steady_clock::time_point endpoint::publish()
+{
+  const auto now = std::chrono::steady_clock::now();
+  auto next      = std::chrono::steady_clock::time_point::max();
+
+  for (std::size_t i = 0; i < _subscriptions.size(); i++)
+  {
+    subscription &sub = _subscriptions[i];
+
+    if (!sub.active)
+      continue;
+
+    if (sub.next <= now)
+    {
+      /* The firmware drops samples the link cannot keep up with. */
+      if (_tx_frame_ends.size() < _options.tx_backlog)
+        table[i].get(*this, static_cast< commands >(i));
+      else
+        _dropped_samples.fetch_add(1, std::memory_order_relaxed);
+
+      sub.next += sub.period;
+
+      /* Skip what was missed rather than bursting. */
+      if (sub.next <= now)
+        sub.next = now + sub.period;
+    }
+
+    next = std::min(next, sub.next);
+  }
+
+  return next;
+}
+
+void endpoint::animate(commands cmd)
+{
+  const double t = std::chrono::duration< double >(
+                       std::chrono::steady_clock::now() - _start)
+                       .count();
+  const float s = static_cast< float >(std::sin(t));
+  const float c = static_cast< float >(std::cos(t));
+
+  switch (cmd)
+  {
+    case commands::GetIMUData:
+    {
+      auto &d = std::get< datagrams::IMUData >(_state);
+
+      d.accelerometer[0] = 0.05f * s;
+      d.accelerometer[1] = 0.05f * c;
+      d.accelerometer[2] = 1.0f;
+      d.gyroscope[0]     = 0.5f * s;
+      d.gyroscope[1]     = 0.5f * c;
+      d.gyroscope[2]     = 0.2f;
+      d.magnetometer[0]  = c;
+      d.magnetometer[1]  = s;
+      d.magnetometer[2]  = 0.3f;
+      d.temperature      = 25.0f;
+      d.pressure         = 101325.0f;
+      d.time_stamp_ns    = vehicle_time_ns();
+      break;
+    }
+
+    case commands::GetRawIMUData:
+    {
+      auto &d = std::get< datagrams::RawIMUData >(_state);
+
+      d.accelerometer[0] = static_cast< int16_t >(800 * s);
+      d.accelerometer[1] = static_cast< int16_t >(800 * c);
+      d.accelerometer[2] = 16384;
+      d.gyroscope[0]     = static_cast< int16_t >(8000 * s);
+      d.gyroscope[1]     = static_cast< int16_t >(8000 * c);
+      d.gyroscope[2]     = 3200;
+      d.magnetometer[0]  = static_cast< int16_t >(1000 * c);
+      d.magnetometer[1]  = static_cast< int16_t >(1000 * s);
+      d.magnetometer[2]  = 300;
+      d.temperature      = 2500;
+      d.pressure         = 101325;
+      d.time_stamp_ns    = vehicle_time_ns();
+      break;
+    }
+
+    case commands::GetEstimationAttitude:
+    {
+      auto &d = std::get< datagrams::EstimationAttitude >(_state);
+
+      /* Yawing at 0.2 rad/s. */
+      const double yaw = 0.2 * t;
+
+      d.q.w            = static_cast< float >(std::cos(yaw / 2));
+      d.q.x            = 0;
+      d.q.y            = 0;
+      d.q.z            = static_cast< float >(std::sin(yaw / 2));
+      d.angular_rate.x = 0;
+      d.angular_rate.y = 0;
+      d.angular_rate.z = 0.2f;
+      break;
+    }
+
+    case commands::GetControlSignals:
+    {
+      auto &d = std::get< datagrams::ControlSignals >(_state);
+
+      d.throttle = 0.5f + 0.1f * s;
+      d.torque.x = 0.01f * s;
+      d.torque.y = 0.01f * c;
+      d.torque.z = 0;
+
+      for (auto &m : d.motor_command)
+        m = d.throttle;
+
+      break;
+    }
+
+    case commands::GetRCValues:
+    {
+      auto &d = std::get< datagrams::RCValues >(_state);
+
+      d.active_connection = true;
+      d.num_connections   = RCINPUT_N_CHANNELS;
+      d.rssi              = 100;
+
+      for (std::size_t i = 0; i < RCINPUT_N_CHANNELS; i++)
+      {
+        d.calibrated_value[i] = static_cast< float >(std::sin(t + i));
+        d.channel_value[i] =
+            static_cast< uint16_t >(1500 + 500 * d.calibrated_value[i]);
+      }
+
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+bool endpoint::transmit()
+{
+  while (_tx_offset < _tx_buffer.size())
+  {
+    std::size_t size = _tx_buffer.size() - _tx_offset;
+    const auto now   = std::chrono::steady_clock::now();
+
+    if (_options.baudrate > 0)
+    {
+      if (_tx_free > now)
+        return true;
+
+      /* At most a millisecond of bytes at a time. */
+      size = std::min< std::size_t >(
+          size, std::max(1u, _options.baudrate / bits_per_byte / 1000));
+    }
+
+    const ssize_t n = write(_fd, _tx_buffer.data() + _tx_offset, size);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    _tx_offset += n;
+    _tx_bytes.fetch_add(n, std::memory_order_relaxed);
+
+    while (!_tx_frame_ends.empty() && _tx_frame_ends.front() <= _tx_offset)
+      _tx_frame_ends.pop_front();
+
+    if (_options.baudrate > 0)
+      _tx_free = std::max(_tx_free, now) +
+                 std::chrono::nanoseconds(uint64_t(n) * bits_per_byte *
+                                          1000000000ull / _options.baudrate);
+  }
+
+  _tx_buffer.clear();
+  _tx_frame_ends.clear();
+  _tx_offset = 0;
+
+  return true;
+}
+
+void endpoint::inject_errors(uint8_t *data, std::size_t size)
+{
+  if (_options.bit_error_rate <= 0)
+    return;
+
+  /* Jump from error to error, the gaps are geometrically distributed. */
+  uint64_t bits = uint64_t(size) * 8;
+
+  while (_bits_to_error < bits)
+  {
+    data[_bits_to_error / 8] ^= uint8_t(1u << (_bits_to_error % 8));
+    _flipped_bits.fetch_add(1, std::memory_order_relaxed);
+
+    _bits_to_error += 1 + std::geometric_distribution< uint64_t >(
+                              _options.bit_error_rate)(_rng);
+  }
+
+  _bits_to_error -= bits;
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+endpoint::endpoint(int fd, const options &o)
+    : _options(o),
+      _fd(fd),
+      _start(std::chrono::steady_clock::now()),
+      _parser(),
+      _state(),
+      _subscriptions(),
+      _tx_offset(0),
+      _rng(o.seed),
+      _bits_to_error(0),
+      _rx_frames(0),
+      _tx_frames(0),
+      _dropped_samples(0),
+      _tx_bytes(0),
+      _acks(0),
+      _flipped_bits(0),
+      _running(false)
+{
+  if (fd < 0)
+    throw std::invalid_argument("Invalid file descriptor.");
+
+  try
+  {
+    if (o.bit_error_rate < 0 || o.bit_error_rate >= 1)
+      throw std::invalid_argument("The bit error rate must be in [0, 1).");
+
+    if (o.bit_error_rate > 0)
+      _bits_to_error = std::geometric_distribution< uint64_t >(
+          o.bit_error_rate)(_rng);
+
+    kfly_comm::details::set_nonblocking(fd);
+    _wake.reset(new kfly_comm::details::wake_event);
+  }
+  catch (...)
+  {
+    close(_fd);
+    throw;
+  }
+
+  /* Fixed identification, the rest of the state starts zeroed. */
+  auto &strings = std::get< datagrams::SystemStrings >(_state);
+  std::snprintf(strings.vehicle_name, sizeof(strings.vehicle_name),
+                "kfly_sim");
+  std::snprintf(strings.vehicle_type, sizeof(strings.vehicle_type),
+                "simulated");
+  std::snprintf(strings.kfly_version, sizeof(strings.kfly_version),
+                "kfly_sim");
+
+  _running = true;
+
+  try
+  {
+    _thread = std::thread(&endpoint::run, this);
+  }
+  catch (...)
+  {
+    close(_fd);
+    throw;
+  }
+}
+
+endpoint::~endpoint()
+{
+  _running = false;
+  _wake->signal();
+
+  if (_thread.joinable())
+    _thread.join();
+
+  close(_fd);
+}
+
+void endpoint::queue(const uint8_t *data, std::size_t size)
+{
+  {
+    std::lock_guard< std::mutex > lock(_queue_lock);
+    _queued.emplace_back(data, data + size);
+  }
+
+  _wake->signal();
+}
+
+int64_t endpoint::vehicle_time_ns() const noexcept
+{
+  const double elapsed = std::chrono::duration< double, std::nano >(
+                             std::chrono::steady_clock::now() - _start)
+                             .count();
+
+  const double rate = 1 + 1e-6 * _options.clock_drift_ppm;
+
+  return _options.clock_offset_ns + static_cast< int64_t >(elapsed * rate);
+}
+
+statistics endpoint::stats() const noexcept
+{
+  statistics s;
+
+  s.rx_frames       = _rx_frames.load(std::memory_order_relaxed);
+  s.tx_frames       = _tx_frames.load(std::memory_order_relaxed);
+  s.dropped_samples = _dropped_samples.load(std::memory_order_relaxed);
+  s.tx_bytes        = _tx_bytes.load(std::memory_order_relaxed);
+  s.acks            = _acks.load(std::memory_order_relaxed);
+  s.flipped_bits    = _flipped_bits.load(std::memory_order_relaxed);
+
+  return s;
+}
+
+}  // namespace kfly_sim
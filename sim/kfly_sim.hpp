@@ -0,0 +1,347 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <array>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/* Threading includes */
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/* KFly includes */
+#include "kfly_comm/kfly_comm.hpp"
+#include "kfly_comm/fd_io.hpp"
+
+namespace kfly_sim
+{
+/**
+ * @brief   Settings of a simulated KFly.
+ */
+struct options
+{
+  /** @brief Baudrate the transmission is throttled to, 0 for unthrottled. */
+  unsigned baudrate = 0;
+
+  /** @brief Probability of flipping each transmitted bit. */
+  double bit_error_rate = 0;
+
+  /** @brief Seed of the bit error injection. */
+  uint32_t seed = 1;
+
+  /** @brief Vehicle clock at start, in ns. */
+  int64_t clock_offset_ns = 0;
+
+  /** @brief Drift of the vehicle clock relative to the host, in ppm. */
+  double clock_drift_ppm = 0;
+
+  /** @brief Frames waiting for transmission above which subscription
+   *         samples are dropped, as the firmware does on a slow link. */
+  std::size_t tx_backlog = 4;
+};
+
+/**
+ * @brief   Counters of a simulated KFly.
+ */
+struct statistics
+{
+  /** @brief Verified frames received. */
+  uint64_t rx_frames;
+
+  /** @brief Frames transmitted, answers and subscriptions. */
+  uint64_t tx_frames;
+
+  /** @brief Subscription samples dropped as the backlog was full. */
+  uint64_t dropped_samples;
+
+  /** @brief Bytes transmitted. */
+  uint64_t tx_bytes;
+
+  /** @brief ACKs transmitted. */
+  uint64_t acks;
+
+  /** @brief Bits flipped by the error injection. */
+  uint64_t flipped_bits;
+};
+
+/**
+ * @brief   A pseudo-terminal.
+ */
+struct pty
+{
+  /** @brief The master side, for the endpoint. */
+  int master;
+
+  /** @brief The slave side, kept open so the master does not hang up
+   *         while no host has the slave open. */
+  int slave;
+
+  /** @brief Path of the slave side, for the host to open. */
+  std::string slave_path;
+};
+
+/**
+ * @brief   Opens a pseudo-terminal in raw mode.
+ *
+ * @note    Throws std::system_error on failure.
+ */
+pty open_pty();
+
+namespace details
+{
+/**
+ * @brief   A tuple with one of each datagram of a director.
+ */
+template < typename Director >
+struct datagram_tuple;
+
+template < typename... Datagrams >
+struct datagram_tuple< datagram_director< Datagrams... > >
+{
+  using type = std::tuple< Datagrams... >;
+};
+
+/**
+ * @brief   Answers the commands of a datagram, defined with the table.
+ */
+template < typename Datagram, bool Empty >
+struct answer;
+}
+
+/**
+ * @brief     The firmware side of a KFly link, for testing the host stack
+ *            without hardware.
+ *
+ * @details   A thread reads the host's frames from a file descriptor, e.g.
+ *            a pty master or one end of a socketpair, and behaves like
+ *            KFly. Frames are verified as the firmware does, with the CRC
+ *            over the command without the ack bit. Ping is answered with
+ *            Ping, a Get command without payload with the current value of
+ *            its datagram, and a command with payload stores the datagram,
+ *            ACKed when the ack bit is set. ManageSubscriptions streams the
+ *            datagram of a command at the requested delta_ms. IMUData,
+ *            RawIMUData, EstimationAttitude, ControlSignals and RCValues
+ *            are filled with synthetic motion and vehicle clock timestamps
+ *            each time they are sent. Transmission can be throttled to a
+ *            baudrate and corrupted with bit errors. When more than
+ *            options.tx_backlog frames wait for transmission, subscription
+ *            samples are dropped instead of queued, so latency stays
+ *            bounded as on the firmware.
+ *
+ * @note      Linux only.
+ */
+class endpoint
+{
+private:
+  using state_tuple =
+      details::datagram_tuple< kfly_comm::kfly_datagram_director >::type;
+
+  /**
+   * @brief   A streamed command.
+   */
+  struct subscription
+  {
+    std::chrono::steady_clock::duration period;
+    std::chrono::steady_clock::time_point next;
+    bool active;
+  };
+
+  /** @brief Settings. */
+  const options _options;
+
+  /** @brief The file descriptor to the host. */
+  int _fd;
+
+  /** @brief Event used to wake the thread for stop, created after the
+   *         file descriptor is owned. */
+  std::unique_ptr< kfly_comm::details::wake_event > _wake;
+
+  /** @brief Start of the vehicle clock. */
+  const std::chrono::steady_clock::time_point _start;
+
+  /** @brief SLIP decodes the host's frames, thread only. */
+  kfly_comm::kfly_parser _parser;
+
+  /** @brief Guards the datagram values. */
+  mutable std::mutex _state_lock;
+  state_tuple _state;
+
+  /** @brief Subscriptions per command, thread only. */
+  std::array< subscription, 128 > _subscriptions;
+
+  /** @brief Encoded bytes waiting for transmission, thread only. */
+  std::vector< uint8_t > _tx_buffer;
+  std::size_t _tx_offset;
+
+  /** @brief End offsets of the frames in the transmit buffer not yet
+   *         written, thread only. */
+  std::deque< std::size_t > _tx_frame_ends;
+
+  /** @brief Time the throttled port is free to send again. */
+  std::chrono::steady_clock::time_point _tx_free;
+
+  /** @brief Bit error injection, thread only. */
+  std::mt19937_64 _rng;
+  uint64_t _bits_to_error;
+
+  /** @brief Frames queued from other threads. */
+  std::mutex _queue_lock;
+  std::vector< std::vector< uint8_t > > _queued;
+
+  /** @brief Counters. */
+  std::atomic< uint64_t > _rx_frames, _tx_frames, _dropped_samples,
+      _tx_bytes, _acks, _flipped_bits;
+
+  std::atomic< bool > _running;
+  std::thread _thread;
+
+  /** @brief The answer table needs append, animate and the state. */
+  template < typename, bool >
+  friend struct details::answer;
+
+  /**
+   * @brief   The thread's poll loop.
+   */
+  void run();
+
+  /**
+   * @brief   Appends an encoded frame to the transmit buffer, thread only.
+   */
+  void append(const uint8_t *data, std::size_t size);
+
+  /**
+   * @brief   Verifies and handles a decoded frame from the host.
+   */
+  void on_request(const uint8_t *frame, std::size_t size);
+
+  /**
+   * @brief   Handles a subscription request.
+   */
+  void on_subscription(const kfly_comm::datagrams::ManageSubscription &s);
+
+  /**
+   * @brief   Sends the subscriptions which are due.
+   *
+   * @return  Time of the next subscription.
+   */
+  std::chrono::steady_clock::time_point publish();
+
+  /**
+   * @brief   Fills the synthetic datagrams of a command with the current
+   *          motion, state lock held.
+   */
+  void animate(kfly_comm::commands cmd);
+
+  /**
+   * @brief   Writes as much of the transmit buffer as the port and the
+   *          throttling allow.
+   *
+   * @return  False if the link failed.
+   */
+  bool transmit();
+
+  /**
+   * @brief   Flips bits of bytes about to be sent.
+   */
+  void inject_errors(uint8_t *data, std::size_t size);
+
+public:
+  /**
+   * @brief   Starts the simulated KFly on a file descriptor, which it owns.
+   *
+   * @param[in] fd    The file descriptor to the host, made non-blocking.
+   * @param[in] o     Settings.
+   *
+   * @note    Throws std::invalid_argument or std::system_error, the file
+   *          descriptor is closed unless it was invalid.
+   */
+  explicit endpoint(int fd, const options &o = options());
+
+  ~endpoint();
+
+  endpoint(const endpoint &) = delete;
+  endpoint &operator=(const endpoint &) = delete;
+
+  /**
+   * @brief   Queues an encoded datagram or command for transmission, e.g.
+   *          to test the host with a specific packet.
+   *
+   * @param[in] cmd       The command to send under.
+   * @param[in] datagram  The datagram.
+   */
+  template < typename Datagram >
+  void send(kfly_comm::commands cmd, const Datagram &datagram)
+  {
+    static_assert(!std::is_empty< Datagram >::value,
+                  "Queue empty datagrams with generate_command instead.");
+
+    uint8_t buffer[kfly_comm::max_encoded_size< Datagram >::value];
+
+    const std::size_t n =
+        kfly_comm::encode_packet(cmd, datagram, false, buffer, sizeof(buffer));
+
+    queue(buffer, n);
+  }
+
+  /**
+   * @brief   Queues an encoded frame for transmission, from any thread.
+   */
+  void queue(const uint8_t *data, std::size_t size);
+
+  /**
+   * @brief   Sets the value answered and streamed for a datagram.
+   */
+  template < typename Datagram >
+  void set_state(const Datagram &datagram)
+  {
+    std::lock_guard< std::mutex > lock(_state_lock);
+    std::get< Datagram >(_state) = datagram;
+  }
+
+  /**
+   * @brief   The current value of a datagram, e.g. as set by the host.
+   */
+  template < typename Datagram >
+  Datagram state() const
+  {
+    std::lock_guard< std::mutex > lock(_state_lock);
+    return std::get< Datagram >(_state);
+  }
+
+  /**
+   * @brief   The simulated vehicle clock, in ns.
+   */
+  int64_t vehicle_time_ns() const noexcept;
+
+  /**
+   * @brief   The counters.
+   */
+  statistics stats() const noexcept;
+
+  /**
+   * @brief   Checks if the thread is running.
+   *
+   * @return  False if the host closed the link or it failed.
+   */
+  bool is_running() const noexcept
+  {
+    return _running.load(std::memory_order_relaxed);
+  }
+
+};
+
+}  // namespace kfly_sim
@@ -0,0 +1,118 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "kfly_sim.hpp"
+
+using namespace std;
+
+namespace
+{
+volatile sig_atomic_t stop = 0;
+
+void on_signal(int)
+{
+  stop = 1;
+}
+
+void usage(const char *name)
+{
+  cout << "Usage: " << name << " [options]\n"
+       << "Simulates a KFly on a pseudo-terminal, whose path is printed.\n\n"
+       << "  --baud N        Throttle transmission to N baud, 0 for none\n"
+       << "  --ber P         Flip each transmitted bit with probability P\n"
+       << "  --seed N        Seed of the bit errors\n"
+       << "  --offset-ns N   Vehicle clock at start\n"
+       << "  --drift-ppm D   Vehicle clock drift\n";
+}
+}
+
+int main(int argc, char *argv[])
+{
+  kfly_sim::options options;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const string arg = argv[i];
+
+    if (i + 1 >= argc)
+    {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+
+    const char *value = argv[++i];
+
+    if (arg == "--baud")
+      options.baudrate = static_cast< unsigned >(strtoul(value, nullptr, 10));
+    else if (arg == "--ber")
+      options.bit_error_rate = strtod(value, nullptr);
+    else if (arg == "--seed")
+      options.seed = static_cast< uint32_t >(strtoul(value, nullptr, 10));
+    else if (arg == "--offset-ns")
+      options.clock_offset_ns = strtoll(value, nullptr, 10);
+    else if (arg == "--drift-ppm")
+      options.clock_drift_ppm = strtod(value, nullptr);
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  kfly_sim::pty pty;
+  unique_ptr< kfly_sim::endpoint > kfly;
+
+  try
+  {
+    pty = kfly_sim::open_pty();
+  }
+  catch (const exception &e)
+  {
+    cerr << "Unable to open a pseudo-terminal: " << e.what() << endl;
+    return 1;
+  }
+
+  try
+  {
+    kfly.reset(new kfly_sim::endpoint(pty.master, options));
+  }
+  catch (const exception &e)
+  {
+    cerr << "Unable to start the simulator: " << e.what() << endl;
+    close(pty.slave);
+    return 1;
+  }
+
+  cout << pty.slave_path << endl;
+
+  while (!stop && kfly->is_running())
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+  const auto s = kfly->stats();
+
+  cout << "Received " << s.rx_frames << " frames, sent " << s.tx_frames
+       << " frames (" << s.tx_bytes << " bytes, " << s.acks << " ACKs, "
+       << s.dropped_samples << " dropped samples, " << s.flipped_bits
+       << " flipped bits)\n";
+
+  close(pty.slave);
+
+  return 0;
+}
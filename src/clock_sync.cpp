@@ -0,0 +1,264 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/clock_sync.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace kfly_comm
+{
+namespace
+{
+/**
+ * @brief   Steady clock time in ns.
+ */
+int64_t to_ns(std::chrono::steady_clock::time_point t)
+{
+  return std::chrono::duration_cast< std::chrono::nanoseconds >(
+             t.time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief   Reads the vehicle timestamp of a frame holding a datagram with a
+ *          time_stamp_ns member.
+ */
+template < typename Datagram >
+bool read_time_stamp(const uint8_t *frame, const std::size_t size,
+                     int64_t &vehicle_ns)
+{
+  if (size != sizeof(Datagram) + 4)
+    return false;
+
+  std::memcpy(&vehicle_ns, frame + 2 + offsetof(Datagram, time_stamp_ns),
+              sizeof(vehicle_ns));
+
+  return true;
+}
+}
+
+/**
+ * @brief   Feeds the timestamps of the frames received by the codec.
+ */
+class clock_sync::timestamp_tap : public frame_tap
+{
+public:
+  clock_sync &sync;
+
+  explicit timestamp_tap(clock_sync &s) : sync(s)
+  {
+  }
+
+  void on_frame(const uint8_t *frame, const std::size_t size,
+                std::chrono::steady_clock::time_point timestamp) override
+  {
+    int64_t vehicle_ns;
+
+    /* Without the ack bit, an acked Ping is a Ping. */
+    switch (static_cast< commands >(frame[0] & 0x7f))
+    {
+      case commands::GetIMUData:
+        if (read_time_stamp< datagrams::IMUData >(frame, size, vehicle_ns))
+          sync.on_sample(vehicle_ns, timestamp);
+        break;
+
+      case commands::GetRawIMUData:
+        if (read_time_stamp< datagrams::RawIMUData >(frame, size,
+                                                     vehicle_ns))
+          sync.on_sample(vehicle_ns, timestamp);
+        break;
+
+      case commands::Ping:
+        sync.on_ping(timestamp);
+        break;
+
+      default:
+        break;
+    }
+  }
+};
+
+/*********************************
+ * Private members
+ ********************************/
+
+void clock_sync::on_sample(int64_t vehicle_ns,
+                           std::chrono::steady_clock::time_point host)
+{
+  /* Restart on the first sample and when the vehicle clock restarted. */
+  if (_samples == 0 || vehicle_ns < _last_vehicle)
+  {
+    _vehicle_base  = vehicle_ns;
+    _host_base     = host;
+    _samples       = 0;
+    _current_valid = false;
+    _blocks.clear();
+  }
+
+  _last_vehicle = vehicle_ns;
+  _samples++;
+
+  const point p = {vehicle_ns - _vehicle_base, to_ns(host) - to_ns(_host_base)};
+  const int64_t block_ns =
+      std::chrono::duration_cast< std::chrono::nanoseconds >(_options.block)
+          .count();
+
+  /* Blocks follow the vehicle clock, which has no transport jitter. */
+  if (_current_valid && p.vehicle / block_ns != _current.vehicle / block_ns)
+  {
+    _blocks.push_back(_current);
+    _current_valid = false;
+
+    if (_blocks.size() > _options.blocks)
+      _blocks.pop_front();
+  }
+
+  /* Keep the earliest arrival, relative to the vehicle clock. */
+  if (!_current_valid ||
+      p.host - p.vehicle < _current.host - _current.vehicle)
+  {
+    _current       = p;
+    _current_valid = true;
+    update();
+  }
+}
+
+void clock_sync::on_ping(std::chrono::steady_clock::time_point host)
+{
+  const int64_t sent = _ping_sent.exchange(0, std::memory_order_relaxed);
+
+  /* Not our ping. */
+  if (sent == 0)
+    return;
+
+  _round_trips[_round_trip_count++ % _round_trips.size()] =
+      to_ns(host) - sent;
+
+  const std::size_t n = std::min(_round_trip_count, _round_trips.size());
+  _min_round_trip.store(
+      *std::min_element(_round_trips.begin(), _round_trips.begin() + n),
+      std::memory_order_relaxed);
+
+  if (_samples > 0)
+    update();
+}
+
+void clock_sync::update()
+{
+  std::vector< point > &hull = _hull;
+  const double count          = double(_blocks.size() + 1);
+  double mean                 = 0;
+
+  /* Lower convex hull, the points are sorted by vehicle time. */
+  const auto add = [&](const point &p) {
+    while (hull.size() >= 2)
+    {
+      const point &o = hull[hull.size() - 2];
+      const point &a = hull.back();
+
+      const double cross =
+          double(a.vehicle - o.vehicle) * double(p.host - o.host) -
+          double(a.host - o.host) * double(p.vehicle - o.vehicle);
+
+      if (cross > 0)
+        break;
+
+      hull.pop_back();
+    }
+
+    hull.push_back(p);
+    mean += double(p.vehicle) / count;
+  };
+
+  hull.clear();
+
+  for (const auto &p : _blocks)
+    add(p);
+
+  add(_current);
+
+  /* The hull edge at the mean vehicle time. */
+  std::size_t edge = 0;
+
+  while (edge + 2 < hull.size() && hull[edge + 1].vehicle < mean)
+    edge++;
+
+  clock_estimate e;
+  e.samples = _samples;
+  e.rate    = 1;
+  e.latency = min_round_trip() / 2;
+
+  if (hull.size() >= 2)
+  {
+    const point &a = hull[edge];
+    const point &b = hull[edge + 1];
+
+    e.rate = double(b.host - a.host) / double(b.vehicle - a.vehicle);
+  }
+
+  e.vehicle_origin_ns = _vehicle_base + hull[edge].vehicle;
+  e.host_origin       = _host_base + std::chrono::nanoseconds(hull[edge].host) -
+                  std::chrono::duration_cast<
+                      std::chrono::steady_clock::duration >(e.latency);
+
+  _estimate.store(e);
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+clock_sync::clock_sync(codec &c, send_function send,
+                       const clock_sync_options &options)
+    : _options(options),
+      _codec(c),
+      _send(std::move(send)),
+      _vehicle_base(0),
+      _last_vehicle(0),
+      _current{0, 0},
+      _current_valid(false),
+      _samples(0),
+      _ping_sent(0),
+      _round_trips(),
+      _round_trip_count(0),
+      _min_round_trip(0),
+      _tap(new timestamp_tap(*this))
+{
+  _hull.reserve(_options.blocks + 1);
+
+  if (_options.block.count() <= 0 || _options.blocks == 0)
+    throw std::invalid_argument("The clock sync needs at least one block.");
+
+  _codec.add_frame_tap(*_tap);
+}
+
+clock_sync::~clock_sync()
+{
+  _codec.remove_frame_tap(*_tap);
+}
+
+void clock_sync::ping()
+{
+  const int64_t now  = to_ns(std::chrono::steady_clock::now());
+  const int64_t sent = _ping_sent.load(std::memory_order_relaxed);
+
+  if (sent != 0 && now - sent < 1000000000)
+    return;
+
+  _ping_sent.store(now, std::memory_order_relaxed);
+
+  const auto &frame = command_frame_for(commands::Ping);
+  _send(frame.bytes, frame.size);
+}
+
+std::chrono::nanoseconds clock_sync::min_round_trip() const noexcept
+{
+  return std::chrono::nanoseconds(
+      _min_round_trip.load(std::memory_order_relaxed));
+}
+
+}  // namespace kfly_comm
@@ -0,0 +1,178 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/crc.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KFLY_COMM_CRC_CLMUL 1
+#include <immintrin.h>
+#endif
+
+namespace CRC16_CCITT
+{
+namespace
+{
+/**
+ * @brief   Payloads shorter than this are faster with slicing-by-8.
+ */
+constexpr std::size_t clmul_threshold = 128;
+
+#ifdef KFLY_COMM_CRC_CLMUL
+
+/**
+ * @brief   Calculates x^n mod P, where P is the CRC-CCITT polynomial.
+ *
+ * @param[in] n   The exponent.
+ *
+ * @return  The remainder as a 16 bit polynomial.
+ */
+constexpr uint64_t xpow_mod(unsigned n)
+{
+  uint32_t r = 1;
+
+  for (unsigned i = 0; i < n; i++)
+  {
+    r <<= 1;
+
+    if (r & 0x10000)
+      r ^= 0x11021;
+  }
+
+  return r;
+}
+
+/**
+ * @brief   Folding constants, the accumulators are split in a high and low
+ *          64 bit half which are multiplied with x^(D+64) and x^D mod P to
+ *          move them D bits forward in the message.
+ */
+constexpr uint64_t fold128_hi = xpow_mod(128 + 64);
+constexpr uint64_t fold128_lo = xpow_mod(128);
+constexpr uint64_t fold512_hi = xpow_mod(512 + 64);
+constexpr uint64_t fold512_lo = xpow_mod(512);
+
+/**
+ * @brief   Loads 16 bytes as a big endian 128 bit polynomial.
+ */
+__attribute__((target("pclmul,ssse3"))) inline __m128i load_be(
+    const uint8_t *data, const __m128i &reverse)
+{
+  return _mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast< const __m128i * >(data)), reverse);
+}
+
+/**
+ * @brief   Folds an accumulator forward with the given constants.
+ */
+__attribute__((target("pclmul,ssse3"))) inline __m128i fold(
+    const __m128i &acc, const __m128i &k)
+{
+  return _mm_xor_si128(_mm_clmulepi64_si128(acc, k, 0x11),
+                       _mm_clmulepi64_si128(acc, k, 0x00));
+}
+
+/**
+ * @brief   Carry-less multiply folding engine. The message is folded into a
+ *          128 bit remainder (congruent modulo P), four 16 byte lanes at a
+ *          time, and the remainder is then finished with the table engine.
+ *
+ * @note    Requires size >= 64.
+ */
+__attribute__((target("pclmul,ssse3"))) uint16_t generateCRC_clmul(
+    const uint8_t *data, std::size_t size, const uint16_t crc_start)
+{
+  const __m128i reverse =
+      _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const __m128i k512 = _mm_set_epi64x(fold512_hi, fold512_lo);
+  const __m128i k128 = _mm_set_epi64x(fold128_hi, fold128_lo);
+
+  /* The starting value is XORed into the first two bytes. */
+  __m128i a0 = _mm_xor_si128(
+      load_be(data, reverse),
+      _mm_set_epi64x(static_cast< int64_t >(uint64_t(crc_start) << 48), 0));
+  __m128i a1 = load_be(data + 16, reverse);
+  __m128i a2 = load_be(data + 32, reverse);
+  __m128i a3 = load_be(data + 48, reverse);
+
+  data += 64;
+  size -= 64;
+
+  /* Fold 64 bytes per iteration, the lanes are independent. */
+  while (size >= 64)
+  {
+    a0 = _mm_xor_si128(fold(a0, k512), load_be(data, reverse));
+    a1 = _mm_xor_si128(fold(a1, k512), load_be(data + 16, reverse));
+    a2 = _mm_xor_si128(fold(a2, k512), load_be(data + 32, reverse));
+    a3 = _mm_xor_si128(fold(a3, k512), load_be(data + 48, reverse));
+
+    data += 64;
+    size -= 64;
+  }
+
+  /* Combine the lanes. */
+  __m128i acc = _mm_xor_si128(fold(a0, k128), a1);
+  acc         = _mm_xor_si128(fold(acc, k128), a2);
+  acc         = _mm_xor_si128(fold(acc, k128), a3);
+
+  /* Fold the remaining whole 16 byte blocks. */
+  while (size >= 16)
+  {
+    acc = _mm_xor_si128(fold(acc, k128), load_be(data, reverse));
+
+    data += 16;
+    size -= 16;
+  }
+
+  /* The CRC of the remainder with a zero start is the CRC of the message. */
+  uint8_t remainder[16];
+  _mm_storeu_si128(reinterpret_cast< __m128i * >(remainder),
+                   _mm_shuffle_epi8(acc, reverse));
+
+  const uint16_t crc = generateCRC_slice8(remainder, sizeof(remainder), 0);
+
+  return generateCRC_slice8(data, size, crc);
+}
+
+/**
+ * @brief   Checks the CPU for PCLMULQDQ and SSSE3 support.
+ */
+bool detect_clmul()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+}
+
+#else
+
+bool detect_clmul()
+{
+  return false;
+}
+
+#endif
+
+/**
+ * @brief   Result of the runtime CPU detection.
+ */
+const bool clmul_available = detect_clmul();
+}
+
+uint16_t generateCRC(const uint8_t *data, const std::size_t size,
+                     const uint16_t crc_start)
+{
+#ifdef KFLY_COMM_CRC_CLMUL
+  if (size >= clmul_threshold && clmul_available)
+    return generateCRC_clmul(data, size, crc_start);
+#endif
+
+  return generateCRC_slice8(data, size, crc_start);
+}
+
+bool has_clmul_engine()
+{
+  return clmul_available;
+}
+
+} /* END namespace CRC16_CCITT */
@@ -0,0 +1,158 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/fd_io.hpp"
+#include "kfly_comm/link_statistics.hpp"
+
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+namespace kfly_comm
+{
+namespace details
+{
+namespace
+{
+/**
+ * @brief   Maximum number of messages in one writev.
+ */
+constexpr std::size_t max_iovecs = 64;
+}
+
+void throw_errno(const char *what)
+{
+  throw std::system_error(errno, std::system_category(), what);
+}
+
+void set_nonblocking(int fd)
+{
+  const int flags = fcntl(fd, F_GETFL);
+
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    throw_errno("Unable to make the file descriptor non-blocking");
+}
+
+/*********************************
+ * wake_event
+ ********************************/
+
+wake_event::wake_event() : _fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+  if (_fd < 0)
+    throw_errno("Unable to create the event");
+}
+
+wake_event::~wake_event()
+{
+  close(_fd);
+}
+
+void wake_event::signal() noexcept
+{
+  const uint64_t one = 1;
+  if (write(_fd, &one, sizeof(one)) < 0)
+  {
+    /* The event counter cannot overflow here. */
+  }
+}
+
+void wake_event::clear() noexcept
+{
+  uint64_t count;
+  if (read(_fd, &count, sizeof(count)) < 0)
+  {
+    /* Spurious wake up, nothing to do. */
+  }
+}
+
+/*********************************
+ * tx_queue
+ ********************************/
+
+ssize_t tx_queue::flush(int fd)
+{
+  ssize_t written = 0;
+
+  while (!_messages.empty())
+  {
+    /* Gather the queued messages into one write. */
+    struct iovec iov[max_iovecs];
+    std::size_t count = 0;
+
+    for (auto it = _messages.begin();
+         it != _messages.end() && count < max_iovecs; ++it, ++count)
+    {
+      const std::size_t offset = (count == 0) ? _offset : 0;
+
+      iov[count].iov_base = const_cast< uint8_t * >(it->data() + offset);
+      iov[count].iov_len  = it->size() - offset;
+    }
+
+    ssize_t n = writev(fd, iov, static_cast< int >(count));
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return -1;
+
+      break;
+    }
+
+    written += n;
+
+    /* Remove the written messages. */
+    while (n > 0)
+    {
+      const std::size_t left = _messages.front().size() - _offset;
+
+      if (static_cast< std::size_t >(n) >= left)
+      {
+        n -= left;
+        _offset = 0;
+
+        if (_statistics != nullptr)
+          _statistics->tx_encoded(_messages.front().data(),
+                                  _messages.front().size());
+
+        _messages.pop_front();
+      }
+      else
+      {
+        _offset += n;
+        n = 0;
+      }
+    }
+  }
+
+  return written;
+}
+
+void watch_writable(int epoll_fd, int fd, uint64_t data, bool pending,
+                    bool &waiting)
+{
+  if (pending == waiting)
+    return;
+
+  struct epoll_event ev = {};
+
+  ev.events   = EPOLLIN;
+  ev.data.u64 = data;
+
+  if (pending)
+    ev.events |= EPOLLOUT;
+
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+
+  waiting = pending;
+}
+}  // namespace details
+}  // namespace kfly_comm
@@ -0,0 +1,418 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/flight_recorder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kfly_comm
+{
+namespace
+{
+/**
+ * @brief   Alignment of the buffers and writes, as O_DIRECT needs.
+ */
+constexpr std::size_t block_size = 4096;
+
+/**
+ * @brief   Converts a steady_clock time to ns.
+ */
+int64_t to_ns(std::chrono::steady_clock::time_point t)
+{
+  return std::chrono::duration_cast< std::chrono::nanoseconds >(
+             t.time_since_epoch())
+      .count();
+}
+}
+
+/**
+ * @brief   Feeds the frames received by a codec to the recorder.
+ */
+class flight_recorder::source_tap : public frame_tap
+{
+public:
+  flight_recorder &recorder;
+  codec &link;
+  const uint16_t source;
+
+  source_tap(flight_recorder &r, codec &c, uint16_t s)
+      : recorder(r), link(c), source(s)
+  {
+  }
+
+  void on_frame(const uint8_t *frame, const std::size_t size,
+                std::chrono::steady_clock::time_point timestamp) override
+  {
+    recorder.record(recording::direction::rx, source, frame, size, timestamp);
+  }
+};
+
+/*********************************
+ * Private members
+ ********************************/
+
+bool flight_recorder::reserve(std::size_t size) const noexcept
+{
+  /* A record is never larger than a buffer, so at most one hand off. */
+  return _active.size + size <= _options.buffer_size || !_free.empty();
+}
+
+void flight_recorder::append(const void *data, std::size_t size)
+{
+  const uint8_t *bytes = static_cast< const uint8_t * >(data);
+
+  while (size > 0)
+  {
+    /* A full buffer is handed off when more is appended. */
+    if (_active.size == _options.buffer_size)
+      hand_off();
+
+    const std::size_t n =
+        std::min(size, _options.buffer_size - _active.size);
+
+    std::memcpy(_active.data.get() + _active.size, bytes, n);
+    _active.size += n;
+    _offset += n;
+    bytes += n;
+    size -= n;
+  }
+}
+
+void flight_recorder::append_index()
+{
+  recording::record_header header = {};
+  header.timestamp_ns = _index.last_timestamp_ns;
+  header.direction    = static_cast< uint8_t >(recording::direction::index);
+  header.length       = sizeof(recording::index_block);
+
+  if (!reserve(sizeof(header) + sizeof(_index)))
+    return;
+
+  append(&header, sizeof(header));
+  append(&_index, sizeof(_index));
+
+  _index       = recording::index_block();
+  _index_start = _offset;
+  _index_blocks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void flight_recorder::hand_off()
+{
+  buffer next = std::move(_free.back());
+  _free.pop_back();
+
+  /* O_DIRECT writes whole blocks, the rest moves to the next buffer. */
+  std::size_t size = _active.size;
+
+  if (_options.direct_io)
+    size -= size % block_size;
+
+  next.size = _active.size - size;
+  std::memcpy(next.data.get(), _active.data.get() + size, next.size);
+
+  _active.size = size;
+
+  if (size > 0)
+  {
+    _queue.push_back(std::move(_active));
+    _cv.notify_all();
+  }
+  else
+  {
+    _free.push_back(std::move(_active));
+  }
+
+  _active = std::move(next);
+}
+
+void flight_recorder::run()
+{
+  std::unique_lock< std::mutex > lock(_lock);
+
+  while (true)
+  {
+    _cv.wait(lock, [&] { return !_queue.empty() || !_running; });
+
+    if (_queue.empty())
+      break;
+
+    buffer b = std::move(_queue.front());
+    _queue.pop_front();
+
+    lock.unlock();
+
+    std::size_t written = 0;
+
+    while (written < b.size && _error.load(std::memory_order_relaxed) == 0)
+    {
+      const ssize_t n = write(_fd, b.data.get() + written, b.size - written);
+
+      if (n >= 0)
+        written += static_cast< std::size_t >(n);
+      else if (errno != EINTR)
+        _error = errno;
+    }
+
+    _bytes.fetch_add(written, std::memory_order_relaxed);
+
+    lock.lock();
+
+    b.size = 0;
+    _free.push_back(std::move(b));
+  }
+}
+
+bool flight_recorder::record_tx_frame(uint8_t *frame, std::size_t size,
+                                      bool ack, uint16_t source)
+{
+  const uint16_t crc = CRC16_CCITT::generateCRC(frame, size - 2);
+  std::memcpy(frame + size - 2, &crc, sizeof(crc));
+
+  if (ack)
+    frame[0] |= 0x80;
+
+  return record(recording::direction::tx, source, frame, size);
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+flight_recorder::flight_recorder(const std::string &file,
+                                 const flight_recorder_options &options)
+    : _options(options),
+      _fd(-1),
+      _active{{nullptr, std::free}, 0},
+      _offset(0),
+      _index_start(0),
+      _index(),
+      _records(0),
+      _bytes(0),
+      _dropped(0),
+      _index_blocks(0),
+      _running(true),
+      _error(0)
+{
+  if (options.buffer_size == 0 || options.buffer_size % block_size != 0)
+    throw std::invalid_argument(
+        "The buffer size must be a multiple of 4096 bytes.");
+
+  if (options.buffer_count < 2)
+    throw std::invalid_argument("At least two buffers are needed.");
+
+  if (options.index_interval == 0)
+    throw std::invalid_argument("The index interval may not be zero.");
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+  if (options.direct_io)
+  {
+#ifdef O_DIRECT
+    flags |= O_DIRECT;
+#else
+    throw std::invalid_argument("O_DIRECT is not supported.");
+#endif
+  }
+
+  /* Allocate the buffers. */
+  for (std::size_t i = 0; i < options.buffer_count; i++)
+  {
+    void *p = nullptr;
+
+    if (posix_memalign(&p, block_size, options.buffer_size) != 0)
+      throw std::bad_alloc();
+
+    _free.push_back(buffer{{static_cast< uint8_t * >(p), std::free}, 0});
+  }
+
+  _active = std::move(_free.back());
+  _free.pop_back();
+
+  _fd = open(file.c_str(), flags, 0644);
+
+  if (_fd < 0)
+    throw std::system_error(errno, std::system_category(),
+                            "Unable to create the recording");
+
+  /* The file header. */
+  recording::file_header header = {};
+
+  std::memcpy(header.magic, recording::magic, sizeof(header.magic));
+  header.version         = recording::version;
+  header.header_size     = sizeof(header);
+  header.index_interval  = options.index_interval;
+  header.start_steady_ns = to_ns(std::chrono::steady_clock::now());
+  header.start_system_ns =
+      std::chrono::duration_cast< std::chrono::nanoseconds >(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+
+  append(&header, sizeof(header));
+  _index_start = _offset;
+
+  _thread = std::thread(&flight_recorder::run, this);
+}
+
+flight_recorder::~flight_recorder()
+{
+  {
+    std::lock_guard< std::mutex > lock(_taps_lock);
+
+    for (auto &tap : _taps)
+      tap->link.remove_frame_tap(*tap);
+
+    _taps.clear();
+  }
+
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+
+    if (_index.records > 0)
+      append_index();
+
+    /* The last buffer, padded to whole blocks for O_DIRECT. */
+    if (_options.direct_io && _active.size % block_size != 0)
+    {
+      const std::size_t padded =
+          _active.size + block_size - _active.size % block_size;
+
+      std::memset(_active.data.get() + _active.size, 0,
+                  padded - _active.size);
+      _active.size = padded;
+    }
+
+    if (_active.size > 0)
+      _queue.push_back(std::move(_active));
+
+    _running = false;
+    _cv.notify_all();
+  }
+
+  _thread.join();
+
+  /* Remove the padding. */
+  if (_options.direct_io && _error == 0 &&
+      ftruncate(_fd, static_cast< off_t >(_offset)) < 0)
+    _error = errno;
+
+  close(_fd);
+}
+
+void flight_recorder::attach(codec &c, uint16_t source)
+{
+  std::lock_guard< std::mutex > lock(_taps_lock);
+
+  _taps.emplace_back(new source_tap(*this, c, source));
+  c.add_frame_tap(*_taps.back());
+}
+
+void flight_recorder::detach(codec &c)
+{
+  std::lock_guard< std::mutex > lock(_taps_lock);
+
+  for (auto it = _taps.begin(); it != _taps.end();)
+  {
+    if (&(*it)->link == &c)
+    {
+      c.remove_frame_tap(**it);
+      it = _taps.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+bool flight_recorder::record(recording::direction dir, uint16_t source,
+                             const uint8_t *frame, std::size_t size,
+                             std::chrono::steady_clock::time_point timestamp)
+{
+  if (size > 0xffff)
+    throw std::invalid_argument("Frame too large to record.");
+
+  /* A record may span at most two buffers, see reserve. */
+  if (sizeof(recording::record_header) + size > _options.buffer_size)
+  {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  recording::record_header header = {};
+  header.timestamp_ns = to_ns(timestamp);
+  header.source       = source;
+  header.direction    = static_cast< uint8_t >(dir);
+  header.length       = static_cast< uint16_t >(size);
+
+  std::lock_guard< std::mutex > lock(_lock);
+
+  if (!reserve(sizeof(header) + size))
+  {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  if (_index.records == 0)
+  {
+    _index.first_offset       = _offset;
+    _index.first_timestamp_ns = header.timestamp_ns;
+  }
+
+  _index.last_timestamp_ns = header.timestamp_ns;
+  _index.records++;
+
+  if (size > 0)
+  {
+    const uint8_t cmd = frame[0] & 0x7f;
+    _index.commands[cmd / 8] |= static_cast< uint8_t >(1 << (cmd % 8));
+  }
+
+  append(&header, sizeof(header));
+  append(frame, size);
+
+  _records.fetch_add(1, std::memory_order_relaxed);
+
+  if (_offset - _index_start >= _options.index_interval)
+    append_index();
+
+  return true;
+}
+
+bool flight_recorder::record_tx_command(commands command, bool ack,
+                                        uint16_t source)
+{
+  uint8_t frame[4] = {static_cast< uint8_t >(command), 0, 0, 0};
+
+  return record_tx_frame(frame, sizeof(frame), ack, source);
+}
+
+void flight_recorder::flush()
+{
+  std::lock_guard< std::mutex > lock(_lock);
+
+  if (_active.size > 0 && !_free.empty())
+    hand_off();
+}
+
+flight_recorder_stats flight_recorder::stats() const noexcept
+{
+  flight_recorder_stats s;
+
+  s.records      = _records.load(std::memory_order_relaxed);
+  s.bytes        = _bytes.load(std::memory_order_relaxed);
+  s.dropped      = _dropped.load(std::memory_order_relaxed);
+  s.index_blocks = _index_blocks.load(std::memory_order_relaxed);
+
+  return s;
+}
+
+}  // namespace kfly_comm
@@ -5,259 +5,164 @@
 
 #include "kfly_comm/kfly_comm.hpp"
 
+#include <algorithm>
+
 namespace kfly_comm
 {
 /*********************************
  * Private members
  ********************************/
 
-void codec::parse_packet(const std::vector< uint8_t > &payload)
+void codec::parse_packet(const uint8_t *frame, const std::size_t size)
 {
-  /* Check size */
-  if (payload.size() < 4)
-      return;
+  KFLY_COMM_TRACE_SCOPE(trace::stage::frame, frame[0]);
+
+  /* The END byte of the frame was just parsed. */
+  _rx_timestamp = std::chrono::steady_clock::now();
 
-  /* Extract command. */
-  const uint8_t cmd = payload[0];
+  frame_status status;
 
-  /* Extract size and expected size. */
-  const unsigned int expected_size = (unsigned int)payload[1];
-  const unsigned int length        = payload.size();
+  {
+    KFLY_COMM_TRACE_SCOPE(trace::stage::check_frame);
+    status = check_frame(frame, size);
+  }
 
-  /* Extract the CRC and remove it. */
-  union {
-    uint8_t b[2];
-    uint16_t u16;
-  } crc;
+  /* Check the length and CRC. */
+  switch (status)
+  {
+    case frame_status::size_error:
+      _parse_result.size_errors++;
+      _statistics.length_error();
+      return;
 
-  crc.b[0] = payload[length - 2];
-  crc.b[1] = payload[length - 1];
+    case frame_status::crc_error:
+      _parse_result.crc_errors++;
+      _statistics.crc_error();
+      return;
 
-  /* Remove CRC. */
-  std::vector< uint8_t > data(payload.begin(), payload.end() - 2);
+    case frame_status::ok:
+      break;
+  }
 
-  /* Calculate CRC. */
-  uint16_t crc_calc = CRC16_CCITT::generateCRC(data);
+  {
+    KFLY_COMM_TRACE_SCOPE(trace::stage::frame_taps);
 
-  /* Remove header. */
-  data.erase(data.begin(), data.begin() + 2);
+    for (auto tap : _taps)
+      tap->on_frame(frame, size, _rx_timestamp);
+  }
 
-  /* Check sizes and CRC. */
-  if (expected_size + 4 != length)
+  /* Send payload, without header and CRC, to further processing. */
+  try
   {
-    /* Size error. */
-    return;
+    transmit_datagram(frame[0], frame + 2, frame[1]);
+    _parse_result.packets++;
+    _statistics.rx_frame(frame[0], size);
   }
-  else if (crc_calc != crc.u16)
+  catch (const std::invalid_argument &e)
   {
-    /* CRC error. */
-    return;
+    /* Whenever a wrong sized payload is parsed, this will run. */
+    _parse_result.size_errors++;
+    _statistics.payload_error();
   }
-  else
+
+  if (--_callback_sample_countdown == 0)
   {
-    /* Send payload to further processing. */
-    try
-    {
-      transmit_datagram(cmd, data);
-    }
-    catch (const std::invalid_argument &e)
-    {
-      /* Whenever a wrong sized payload is parsed, this will run. */
-    }
+    _callback_sample_countdown = link_statistics::callback_sample_interval;
+    _statistics.callback_sample(std::chrono::steady_clock::now() -
+                                _rx_timestamp);
   }
 }
 
-void codec::transmit_datagram(const uint8_t cmd,
-                              const std::vector< uint8_t > &payload)
+void codec::transmit_datagram(const uint8_t cmd, const uint8_t *payload,
+                              const std::size_t size)
 {
-  /* Extract the command. */
-  const commands command = static_cast< commands >(cmd);
-
-  /* Do appropriate operation for each command. */
-  switch (command)
-  {
-    case commands::ACK:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::Ack >().get_datagram());
-      break;
-
-    case commands::Ping:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::Ping >().get_datagram());
-      break;
-
-    case commands::GetRunningMode:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::RunningMode >(payload)
-              .get_datagram());
-      break;
+  KFLY_COMM_TRACE_SCOPE(trace::stage::decode, cmd);
 
-    case commands::GetSystemStrings:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::SystemStrings >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetSystemStatus:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::SystemStatus >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetControlSignals:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::ControlSignals >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetControllerReferences:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::ControllerReferences >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetControllerLimits:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::ControllerLimits >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetArmSettings:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::ArmSettings >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetRateControllerData:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::RateControllerData >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetAttitudeControllerData:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::AttitudeControllerData >(payload)
-              .get_datagram());
-      break;
+  /* Get the decoder for the command, nullptr if it carries no datagram.
+   * The ack bit does not change the datagram. */
+  const auto decoder = datagram_dispatch< codec >::table[cmd & 0x7f];
 
-    case commands::GetChannelMix:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::ChannelMix >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetRCInputSettings:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::RCInputSettings >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetRCOutputSettings:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::RCOutputSettings >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetRCValues:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::RCValues >(payload).get_datagram());
-      break;
-
-    case commands::GetIMUData:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::IMUData >(payload).get_datagram());
-      break;
-
-    case commands::GetRawIMUData:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::RawIMUData >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetIMUCalibration:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::IMUCalibration >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetEstimationAttitude:
-
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::EstimationAttitude >(payload)
-              .get_datagram());
-      break;
-
-    case commands::GetControlFilters:
+  if (decoder != nullptr)
+    decoder(*this, payload, size);
+  else
+    _statistics.unknown_command();
+}
 
-      _callbacks.execute_callback(
-          serializable_datagram< datagrams::ControlFilterSettings >(payload)
-              .get_datagram());
-      break;
+void codec::attach(rx_consumer &consumer)
+{
+  std::lock_guard< std::mutex > locker(_parser_lock);
+  _consumers.push_back(&consumer);
+}
 
-    default:
-      break;
-  }
+void codec::detach(rx_consumer &consumer)
+{
+  std::lock_guard< std::mutex > locker(_parser_lock);
+  _consumers.erase(
+      std::remove(_consumers.begin(), _consumers.end(), &consumer),
+      _consumers.end());
 }
 
 /*********************************
  * Public members
  ********************************/
 
-codec::codec() : _parser()
+void codec::add_frame_tap(frame_tap &tap)
 {
   std::lock_guard< std::mutex > locker(_parser_lock);
+  _taps.push_back(&tap);
+}
 
-  /* Register the KFly packet parser to the parser output. */
-  _parser.registerCallback([&](const std::vector< uint8_t > &payload) {
-    this->parse_packet(payload);
-  });
+void codec::remove_frame_tap(frame_tap &tap)
+{
+  std::lock_guard< std::mutex > locker(_parser_lock);
+  _taps.erase(std::remove(_taps.begin(), _taps.end(), &tap), _taps.end());
+}
+
+codec::codec()
+    : _parser(),
+      _parse_result(),
+      _callback_sample_countdown(link_statistics::callback_sample_interval)
+{
 }
 
 codec::~codec()
 {
 }
 
-void codec::parse(const uint8_t data)
+parse_result codec::parse(const uint8_t data)
 {
-  std::lock_guard< std::mutex > locker(_parser_lock);
+  return parse(&data, 1);
+}
 
-  _parser.parse(data);
+parse_result codec::parse(const std::vector< uint8_t > &payload)
+{
+  return parse(payload.data(), payload.size());
 }
 
-void codec::parse(const std::vector< uint8_t > &payload)
+parse_result codec::parse(const uint8_t *data, const std::size_t size)
 {
   std::lock_guard< std::mutex > locker(_parser_lock);
+  KFLY_COMM_TRACE_SCOPE(trace::stage::parse);
 
-  _parser.parse(payload);
-}
+  _parse_result = parse_result();
+  _statistics.rx_raw(size);
 
-std::vector< uint8_t > codec::generate_command(commands command, bool ack)
-{
-  /* Take any random datagram. */
-  auto packet =
-      kfly_packet< datagrams::Ack, false >(command, datagrams::Ack{}, ack);
+  const uint64_t framing_errors = _parser.framing_errors();
+
+  _parser.parse(data, size,
+                [this](const uint8_t *frame, std::size_t frame_size,
+                       std::size_t consumed) {
+                  parse_packet(frame, frame_size);
+                  _parse_result.bytes_consumed = consumed;
+                },
+                [this](std::size_t consumed) {
+                  _parse_result.size_errors++;
+                  _parse_result.bytes_consumed = consumed;
+                  _statistics.oversized_frame();
+                });
 
-  std::vector< uint8_t > out;
-  kfly_parser::encode(packet.payload, out);
+  _statistics.framing_errors(_parser.framing_errors() - framing_errors);
 
-  return out;
+  return _parse_result;
 }
 }
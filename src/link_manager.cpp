@@ -0,0 +1,595 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/link_manager.hpp"
+#include "kfly_comm/serial_link.hpp"
+#include "kfly_comm/fd_io.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+namespace kfly_comm
+{
+namespace
+{
+/**
+ * @brief   Maximum number of events handled per epoll_wait.
+ */
+constexpr int max_events = 64;
+
+/**
+ * @brief   Epoll data of the wake up event, links start at 1.
+ */
+constexpr uint64_t wake_data = 0;
+
+/**
+ * @brief   The worker running on this thread, nullptr on other threads.
+ */
+thread_local const void *current_worker = nullptr;
+}
+
+using details::throw_errno;
+
+/**
+ * @brief   A link and the state its worker keeps for it.
+ */
+struct link_manager::link
+{
+  const link_id id;
+  const int fd;
+  worker &owner;
+
+  /** @brief Callback objects, declared before the codec calling them. */
+  std::vector< std::shared_ptr< void > > forwarders;
+
+  codec kfly;
+
+  /** @brief Transmit state, guarded by the worker's transmit lock. */
+  details::tx_queue tx;
+  bool tx_waiting;
+  bool tx_ready;
+
+  std::atomic< bool > running;
+  std::atomic< int > error;
+
+  link(link_id i, int f, worker &w)
+      : id(i),
+        fd(f),
+        owner(w),
+        tx(&kfly.statistics()),
+        tx_waiting(false),
+        tx_ready(false),
+        running(true),
+        error(0)
+  {
+  }
+
+  ~link()
+  {
+    close(fd);
+  }
+};
+
+/**
+ * @brief   An I/O thread waiting in an epoll loop on its links.
+ */
+class link_manager::worker
+{
+private:
+  details::wake_event _wake;
+  int _epoll_fd;
+
+  /** @brief Receive buffer shared by the links. */
+  std::vector< uint8_t > _rx_buffer;
+
+  /** @brief The links, worker thread only. */
+  std::unordered_map< link_id, link * > _links;
+
+  /**
+   * @brief   A link added or removed, applied by the worker thread so that
+   *          no other thread waits on a worker handling events.
+   */
+  struct change
+  {
+    link *added;
+    std::unique_ptr< link > removed;
+  };
+
+  /** @brief Guards the changes. */
+  std::mutex _changes_lock;
+  std::condition_variable _changes_applied;
+
+  /** @brief Changes not yet applied, in order. */
+  std::vector< change > _changes;
+  bool _changes_pending;
+
+  /** @brief Removals requested and applied, waited for by remove. */
+  uint64_t _removals_requested;
+  uint64_t _removals_applied;
+
+  /** @brief Guards the transmit queues of the links. */
+  std::mutex _tx_lock;
+
+  /** @brief Links with queued messages, guarded by the transmit lock. */
+  std::vector< link_id > _tx_ready;
+
+  std::atomic< bool > _running;
+  std::thread _thread;
+
+  void run();
+  void apply_changes();
+  bool receive(link &l);
+  bool transmit(link &l);
+  void fail(link &l);
+
+public:
+  /** @brief Number of links assigned, guarded by the manager lock. */
+  std::size_t assigned;
+
+  explicit worker(std::size_t rx_buffer_size);
+  ~worker();
+
+  void start(int cpu);
+  void add(link &l);
+  void remove(std::unique_ptr< link > l);
+  void send(link &l, std::vector< uint8_t > message);
+};
+
+/*********************************
+ * Worker
+ ********************************/
+
+link_manager::worker::worker(std::size_t rx_buffer_size)
+    : _epoll_fd(-1),
+      _rx_buffer(rx_buffer_size),
+      _changes_pending(false),
+      _removals_requested(0),
+      _removals_applied(0),
+      _running(false),
+      assigned(0)
+{
+  _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (_epoll_fd < 0)
+    throw_errno("Unable to create the epoll instance");
+
+  struct epoll_event ev = {};
+
+  ev.events   = EPOLLIN;
+  ev.data.u64 = wake_data;
+  epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake.native_handle(), &ev);
+}
+
+link_manager::worker::~worker()
+{
+  _running = false;
+  _wake.signal();
+
+  if (_thread.joinable())
+    _thread.join();
+
+  close(_epoll_fd);
+}
+
+void link_manager::worker::start(int cpu)
+{
+  _running = true;
+  _thread  = std::thread(&worker::run, this);
+
+  if (cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    const int err =
+        pthread_setaffinity_np(_thread.native_handle(), sizeof(set), &set);
+
+    if (err != 0)
+      throw std::system_error(err, std::system_category(),
+                              "Unable to pin the worker");
+  }
+}
+
+void link_manager::worker::add(link &l)
+{
+  /* Queued before its events can arrive, so the worker knows the link. */
+  {
+    std::lock_guard< std::mutex > lock(_changes_lock);
+    _changes.push_back(change{&l, nullptr});
+    _changes_pending = true;
+  }
+
+  struct epoll_event ev = {};
+
+  ev.events   = EPOLLIN;
+  ev.data.u64 = l.id;
+
+  if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, l.fd, &ev) < 0)
+    throw_errno("Unable to add the link to epoll");
+
+  _wake.signal();
+}
+
+void link_manager::worker::remove(std::unique_ptr< link > l)
+{
+  /* No new events, the ones being handled skip the link. */
+  l->running = false;
+  epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, l->fd, nullptr);
+
+  std::unique_lock< std::mutex > lock(_changes_lock);
+
+  _changes.push_back(change{nullptr, std::move(l)});
+  _changes_pending = true;
+
+  const uint64_t ticket = ++_removals_requested;
+
+  _wake.signal();
+
+  /* A worker may be removing from a callback, its link is closed once the
+   * worker is done with it. Other threads wait for that. */
+  if (current_worker != nullptr)
+    return;
+
+  _changes_applied.wait(lock, [&] { return _removals_applied >= ticket; });
+}
+
+void link_manager::worker::send(link &l, std::vector< uint8_t > message)
+{
+  bool notify;
+
+  {
+    std::lock_guard< std::mutex > lock(_tx_lock);
+    l.tx.push(std::move(message));
+
+    notify     = !l.tx_ready;
+    l.tx_ready = true;
+
+    if (notify)
+      _tx_ready.push_back(l.id);
+  }
+
+  if (notify)
+    _wake.signal();
+}
+
+void link_manager::worker::run()
+{
+  struct epoll_event events[max_events];
+  std::vector< link_id > ready;
+
+  current_worker = this;
+
+  while (_running.load(std::memory_order_relaxed))
+  {
+    const int n = epoll_wait(_epoll_fd, events, max_events, -1);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      break;
+    }
+
+    apply_changes();
+
+    for (int i = 0; i < n; i++)
+    {
+      if (events[i].data.u64 == wake_data)
+      {
+        /* Wake up for transmission or stop. */
+        _wake.clear();
+
+        {
+          std::lock_guard< std::mutex > tx_lock(_tx_lock);
+          ready.swap(_tx_ready);
+        }
+
+        for (auto id : ready)
+        {
+          const auto it = _links.find(id);
+
+          if (it == _links.end() || !it->second->running)
+            continue;
+
+          if (!transmit(*it->second))
+            fail(*it->second);
+        }
+
+        ready.clear();
+        continue;
+      }
+
+      const auto it = _links.find(static_cast< link_id >(events[i].data.u64));
+
+      /* Removed while the events were collected. */
+      if (it == _links.end() || !it->second->running)
+        continue;
+
+      link &l = *it->second;
+      bool ok = true;
+
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        ok = receive(l);
+
+      if (ok && (events[i].events & EPOLLOUT))
+        ok = transmit(l);
+
+      if (!ok)
+        fail(l);
+    }
+  }
+}
+
+void link_manager::worker::apply_changes()
+{
+  std::vector< change > changes;
+  uint64_t removals;
+
+  {
+    std::lock_guard< std::mutex > lock(_changes_lock);
+
+    if (!_changes_pending)
+      return;
+
+    changes.swap(_changes);
+    removals         = _removals_requested;
+    _changes_pending = false;
+  }
+
+  for (auto &c : changes)
+  {
+    if (c.added != nullptr)
+      _links[c.added->id] = c.added;
+    else
+      _links.erase(c.removed->id);
+  }
+
+  /* Closes the removed links, no event is being handled. */
+  changes.clear();
+
+  {
+    std::lock_guard< std::mutex > lock(_changes_lock);
+    _removals_applied = removals;
+  }
+
+  _changes_applied.notify_all();
+}
+
+bool link_manager::worker::receive(link &l)
+{
+  const auto status = details::read_available(
+      l.fd, _rx_buffer, [&l](const uint8_t *data, std::size_t size) {
+        l.kfly.parse(data, size);
+      });
+
+  if (status == details::read_status::failed)
+    l.error = errno;
+
+  return status == details::read_status::drained;
+}
+
+bool link_manager::worker::transmit(link &l)
+{
+  std::lock_guard< std::mutex > lock(_tx_lock);
+
+  l.tx_ready = false;
+
+  if (l.tx.flush(l.fd) < 0)
+  {
+    l.error = errno;
+    return false;
+  }
+
+  /* Wait for the port to become writable only while data is pending. */
+  details::watch_writable(_epoll_fd, l.fd, l.id, !l.tx.empty(),
+                          l.tx_waiting);
+
+  return true;
+}
+
+void link_manager::worker::fail(link &l)
+{
+  l.running = false;
+
+  epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, l.fd, nullptr);
+}
+
+/*********************************
+ * Private members
+ ********************************/
+
+link_manager::link &link_manager::find(link_id id) const
+{
+  const auto it = _links.find(id);
+
+  if (it == _links.end())
+    throw std::invalid_argument("Unknown link.");
+
+  return *it->second;
+}
+
+void link_manager::add_callback(attach_function attach)
+{
+  std::lock_guard< std::mutex > lock(_lock);
+
+  for (auto &l : _links)
+    l.second->forwarders.push_back(attach(l.second->kfly, l.first));
+
+  _callbacks.emplace_back(std::move(attach));
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+link_manager::link_manager(const link_manager_options &options)
+    : _options(options), _next_id(1)
+{
+  if (_options.rx_buffer_size == 0)
+    throw std::invalid_argument("The receive buffer may not be empty.");
+
+  const std::size_t cores =
+      std::max< std::size_t >(1, std::thread::hardware_concurrency());
+  const std::size_t count = (_options.workers > 0) ? _options.workers : cores;
+
+  for (std::size_t i = 0; i < count; i++)
+  {
+    _workers.emplace_back(new worker(_options.rx_buffer_size));
+    _workers.back()->start(_options.pin_workers ? int(i % cores) : -1);
+  }
+}
+
+link_manager::~link_manager()
+{
+  /* Stop the workers before the links they use are closed. */
+  _workers.clear();
+}
+
+link_id link_manager::add_link(const std::string &device, unsigned baudrate)
+{
+  return add_link(open_serial_port(device, baudrate));
+}
+
+link_id link_manager::add_link(int fd)
+{
+  if (fd < 0)
+    throw std::invalid_argument("Invalid file descriptor.");
+
+  try
+  {
+    details::set_nonblocking(fd);
+  }
+  catch (...)
+  {
+    close(fd);
+    throw;
+  }
+
+  link *l;
+
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+
+    /* The worker with the fewest links. */
+    auto &w = *std::min_element(_workers.begin(), _workers.end(),
+                                [](const std::unique_ptr< worker > &a,
+                                   const std::unique_ptr< worker > &b) {
+                                  return a->assigned < b->assigned;
+                                });
+
+    std::unique_ptr< link > created(new link(_next_id++, fd, *w));
+
+    for (auto &attach : _callbacks)
+      created->forwarders.push_back(attach(created->kfly, created->id));
+
+    l = created.get();
+    _links.emplace(l->id, std::move(created));
+    w->assigned++;
+  }
+
+  /* Not under the manager lock, callbacks may use the manager. */
+  try
+  {
+    l->owner.add(*l);
+  }
+  catch (...)
+  {
+    remove_link(l->id);
+    throw;
+  }
+
+  return l->id;
+}
+
+void link_manager::remove_link(link_id id)
+{
+  std::unique_ptr< link > l;
+
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+
+    const auto it = _links.find(id);
+
+    if (it == _links.end())
+      throw std::invalid_argument("Unknown link.");
+
+    l = std::move(it->second);
+    _links.erase(it);
+    l->owner.assigned--;
+  }
+
+  /* Not under the manager lock, the worker may be in a callback using the
+   * manager. */
+  worker &owner = l->owner;
+  owner.remove(std::move(l));
+}
+
+codec &link_manager::link_codec(link_id id)
+{
+  std::lock_guard< std::mutex > lock(_lock);
+  return find(id).kfly;
+}
+
+void link_manager::send(link_id id, std::vector< uint8_t > message)
+{
+  if (message.empty())
+    return;
+
+  std::lock_guard< std::mutex > lock(_lock);
+
+  link &l = find(id);
+
+  l.owner.send(l, std::move(message));
+}
+
+void link_manager::send(link_id id, const uint8_t *data,
+                        const std::size_t size)
+{
+  send(id, std::vector< uint8_t >(data, data + size));
+}
+
+bool link_manager::is_running(link_id id) const
+{
+  std::lock_guard< std::mutex > lock(_lock);
+  return find(id).running.load(std::memory_order_relaxed);
+}
+
+int link_manager::error(link_id id) const
+{
+  std::lock_guard< std::mutex > lock(_lock);
+  return find(id).error.load(std::memory_order_relaxed);
+}
+
+std::size_t link_manager::worker_of(link_id id) const
+{
+  std::lock_guard< std::mutex > lock(_lock);
+
+  const worker *w = &find(id).owner;
+
+  for (std::size_t i = 0; i < _workers.size(); i++)
+    if (_workers[i].get() == w)
+      return i;
+
+  return 0;
+}
+
+std::size_t link_manager::link_count() const
+{
+  std::lock_guard< std::mutex > lock(_lock);
+  return _links.size();
+}
+
+}  // namespace kfly_comm
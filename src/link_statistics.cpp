@@ -0,0 +1,177 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/link_statistics.hpp"
+#include "kfly_comm/slip.hpp"
+
+#include <numeric>
+
+namespace kfly_comm
+{
+/*********************************
+ * direction_counters
+ ********************************/
+
+uint64_t direction_counters::total_frames() const noexcept
+{
+  return std::accumulate(frames.begin(), frames.end(), uint64_t(0));
+}
+
+uint64_t direction_counters::total_bytes() const noexcept
+{
+  return std::accumulate(bytes.begin(), bytes.end(), uint64_t(0));
+}
+
+/*********************************
+ * link_statistics
+ ********************************/
+
+constexpr uint32_t link_statistics::callback_sample_interval;
+
+link_statistics::link_statistics() noexcept
+{
+  reset();
+}
+
+void link_statistics::tx_encoded(const uint8_t *data,
+                                 std::size_t size) noexcept
+{
+  const uint8_t *p   = data;
+  const uint8_t *end = data + size;
+
+  std::size_t frame_size = 0;
+  uint8_t command        = 0;
+  bool escaped           = false;
+
+  /* Walk the runs between END and ESC bytes, a frame ends at END. */
+  while (p < end)
+  {
+    if (escaped)
+    {
+      if (frame_size++ == 0)
+        command = (*p == slip::ESC_END) ? slip::END : slip::ESC;
+
+      escaped = false;
+      p++;
+      continue;
+    }
+
+    const uint8_t *special = slip::find_special(p, end);
+
+    if (special > p)
+    {
+      if (frame_size == 0)
+        command = *p;
+
+      frame_size += special - p;
+    }
+
+    if (special == end)
+      break;
+
+    if (*special == slip::ESC)
+    {
+      escaped = true;
+    }
+    else if (frame_size > 0)
+    {
+      _tx_frames[command & 0x7f].fetch_add(1, std::memory_order_relaxed);
+      _tx_bytes[command & 0x7f].fetch_add(frame_size,
+                                          std::memory_order_relaxed);
+      frame_size = 0;
+    }
+
+    p = special + 1;
+  }
+}
+
+link_snapshot link_statistics::snapshot() const noexcept
+{
+  link_snapshot s;
+
+  s.time = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < command_count; i++)
+  {
+    s.rx.frames[i] = _rx_frames[i].load(std::memory_order_relaxed);
+    s.rx.bytes[i]  = _rx_bytes[i].load(std::memory_order_relaxed);
+    s.tx.frames[i] = _tx_frames[i].load(std::memory_order_relaxed);
+    s.tx.bytes[i]  = _tx_bytes[i].load(std::memory_order_relaxed);
+  }
+
+  s.rx_raw_bytes     = _rx_raw_bytes.load(std::memory_order_relaxed);
+  s.crc_errors       = _crc_errors.load(std::memory_order_relaxed);
+  s.length_errors    = _length_errors.load(std::memory_order_relaxed);
+  s.payload_errors   = _payload_errors.load(std::memory_order_relaxed);
+  s.unknown_commands = _unknown_commands.load(std::memory_order_relaxed);
+  s.oversized_frames = _oversized_frames.load(std::memory_order_relaxed);
+  s.framing_errors   = _framing_errors.load(std::memory_order_relaxed);
+  s.callback_ns      = _callback_ns.load(std::memory_order_relaxed);
+  s.callback_max_ns  = _callback_max_ns.load(std::memory_order_relaxed);
+
+  return s;
+}
+
+void link_statistics::reset() noexcept
+{
+  for (std::size_t i = 0; i < command_count; i++)
+  {
+    _rx_frames[i].store(0, std::memory_order_relaxed);
+    _rx_bytes[i].store(0, std::memory_order_relaxed);
+    _tx_frames[i].store(0, std::memory_order_relaxed);
+    _tx_bytes[i].store(0, std::memory_order_relaxed);
+  }
+
+  _rx_raw_bytes.store(0, std::memory_order_relaxed);
+  _crc_errors.store(0, std::memory_order_relaxed);
+  _length_errors.store(0, std::memory_order_relaxed);
+  _payload_errors.store(0, std::memory_order_relaxed);
+  _unknown_commands.store(0, std::memory_order_relaxed);
+  _oversized_frames.store(0, std::memory_order_relaxed);
+  _framing_errors.store(0, std::memory_order_relaxed);
+  _callback_ns.store(0, std::memory_order_relaxed);
+  _callback_max_ns.store(0, std::memory_order_relaxed);
+}
+
+/*********************************
+ * Rates
+ ********************************/
+
+link_rates rates(const link_snapshot &before, const link_snapshot &after)
+{
+  link_rates r = {};
+
+  r.seconds =
+      std::chrono::duration< double >(after.time - before.time).count();
+
+  if (r.seconds <= 0)
+    return r;
+
+  /* A counter below its earlier value was reset in between, the window
+   * then has no known count. */
+  const auto per_second = [&](uint64_t b, uint64_t a) {
+    return (a > b) ? static_cast< double >(a - b) / r.seconds : 0.0;
+  };
+
+  r.rx_frames = per_second(before.rx.total_frames(), after.rx.total_frames());
+  r.rx_bytes  = per_second(before.rx.total_bytes(), after.rx.total_bytes());
+  r.tx_frames = per_second(before.tx.total_frames(), after.tx.total_frames());
+  r.tx_bytes  = per_second(before.tx.total_bytes(), after.tx.total_bytes());
+
+  r.rx_raw_bytes   = per_second(before.rx_raw_bytes, after.rx_raw_bytes);
+  r.errors         = per_second(before.errors(), after.errors());
+  r.crc_errors     = per_second(before.crc_errors, after.crc_errors);
+  r.length_errors  = per_second(before.length_errors, after.length_errors);
+  r.framing_errors = per_second(before.framing_errors, after.framing_errors);
+
+  const double frames = r.rx_frames + r.errors;
+  r.error_ratio       = (frames > 0) ? r.errors / frames : 0;
+
+  r.callback_load = per_second(before.callback_ns, after.callback_ns) * 1e-9;
+
+  return r;
+}
+
+}  // namespace kfly_comm
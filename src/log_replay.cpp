@@ -0,0 +1,472 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/log_replay.hpp"
+#include "kfly_comm/flight_recorder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace kfly_comm
+{
+namespace
+{
+using slots = details::datagram_slots< kfly_datagram_director >;
+
+/**
+ * @brief   A part of the capture starting and ending at a frame boundary.
+ */
+struct chunk
+{
+  const uint8_t *begin;
+  const uint8_t *end;
+};
+
+/**
+ * @brief   The decoded datagrams and counters of a chunk.
+ */
+struct chunk_result
+{
+  /**
+   * @brief   A decoded datagram waiting for ordered delivery.
+   */
+  struct entry
+  {
+    int64_t timestamp_ns;
+    slots::slot datagram;
+  };
+
+  std::vector< entry > entries;
+  uint64_t frames      = 0;
+  uint64_t delivered   = 0;
+  uint64_t crc_errors  = 0;
+  uint64_t size_errors = 0;
+  bool ready           = false;
+};
+
+/**
+ * @brief   Receives the datagrams decoded from a chunk, it either queues
+ *          them for ordered delivery or delivers them directly.
+ */
+struct chunk_sink
+{
+  chunk_result &result;
+  kfly_datagram_director &callbacks;
+  const bool ordered;
+  int64_t timestamp_ns;
+
+  template < typename Datagram >
+  void execute_callback(const Datagram &datagram)
+  {
+    if (ordered)
+    {
+      result.entries.emplace_back();
+      result.entries.back().timestamp_ns = timestamp_ns;
+      slots::store(result.entries.back().datagram, datagram);
+    }
+    else
+    {
+      callbacks.execute_callback(datagram);
+      result.delivered++;
+    }
+  }
+
+  /**
+   * @brief   Checks and decodes a SLIP decoded frame.
+   */
+  void frame(const uint8_t *frame, const std::size_t size)
+  {
+    switch (check_frame(frame, size))
+    {
+      case frame_status::size_error:
+        result.size_errors++;
+        return;
+
+      case frame_status::crc_error:
+        result.crc_errors++;
+        return;
+
+      case frame_status::ok:
+        break;
+    }
+
+    result.frames++;
+
+    const auto decoder = datagram_dispatch< chunk_sink >::table[frame[0]];
+
+    try
+    {
+      if (decoder != nullptr)
+        decoder(*this, frame + 2, frame[1]);
+    }
+    catch (const std::invalid_argument &)
+    {
+      result.size_errors++;
+    }
+  }
+};
+
+/**
+ * @brief   Splits raw SLIP bytes into chunks ending after an END byte.
+ */
+std::vector< chunk > split_slip(const uint8_t *data, std::size_t size,
+                                std::size_t chunk_size)
+{
+  std::vector< chunk > chunks;
+  const uint8_t *end = data + size;
+  const uint8_t *p   = data;
+
+  while (p < end)
+  {
+    const uint8_t *target =
+        (static_cast< std::size_t >(end - p) > chunk_size) ? p + chunk_size
+                                                           : end;
+
+    const uint8_t *boundary = static_cast< const uint8_t * >(
+        std::memchr(target, slip::END, end - target));
+
+    const uint8_t *next = (boundary != nullptr) ? boundary + 1 : end;
+
+    chunks.push_back(chunk{p, next});
+    p = next;
+  }
+
+  return chunks;
+}
+
+/**
+ * @brief   Checks the file header of a recording.
+ *
+ * @return  A description of the problem, nullptr if the header is valid.
+ */
+const char *check_recording_header(const uint8_t *data, std::size_t size)
+{
+  recording::file_header header;
+
+  if (size < sizeof(header))
+    return "The recording is truncated in its header.";
+
+  std::memcpy(&header, data, sizeof(header));
+
+  if (std::memcmp(header.magic, recording::magic, sizeof(header.magic)) != 0)
+    return "The recording has a bad magic.";
+
+  if (header.version != recording::version)
+    return "The recording has an unsupported version.";
+
+  if (header.header_size < sizeof(header) || header.header_size > size)
+    return "The recording has a bad header size.";
+
+  return nullptr;
+}
+
+/**
+ * @brief   Splits the records of a recording into chunks, a truncated last
+ *          record is left out. The header must have been checked.
+ */
+std::vector< chunk > split_recording(const uint8_t *data, std::size_t size,
+                                     std::size_t chunk_size)
+{
+  std::vector< chunk > chunks;
+
+  recording::file_header header;
+  std::memcpy(&header, data, sizeof(header));
+
+  const uint8_t *end   = data + size;
+  const uint8_t *p     = data + header.header_size;
+  const uint8_t *start = p;
+
+  while (end - p >= static_cast< std::ptrdiff_t >(
+                        sizeof(recording::record_header)))
+  {
+    recording::record_header record;
+    std::memcpy(&record, p, sizeof(record));
+
+    const std::size_t length = sizeof(record) + record.length;
+
+    if (static_cast< std::size_t >(end - p) < length)
+      break;
+
+    p += length;
+
+    if (static_cast< std::size_t >(p - start) >= chunk_size)
+    {
+      chunks.push_back(chunk{start, p});
+      start = p;
+    }
+  }
+
+  if (p > start)
+    chunks.push_back(chunk{start, p});
+
+  return chunks;
+}
+
+/**
+ * @brief   SLIP decodes a chunk of raw bytes.
+ */
+void decode_slip(const chunk &c, chunk_sink &sink)
+{
+  slip::decoder< max_frame_size > decoder;
+
+  decoder.parse(c.begin, c.end - c.begin,
+                [&](const uint8_t *frame, std::size_t size, std::size_t) {
+                  sink.frame(frame, size);
+                },
+                [&](std::size_t) { sink.result.size_errors++; });
+}
+
+/**
+ * @brief   Decodes a chunk of recorder records.
+ */
+void decode_recording(const chunk &c, chunk_sink &sink, bool include_tx)
+{
+  for (const uint8_t *p = c.begin; p < c.end;)
+  {
+    recording::record_header record;
+    std::memcpy(&record, p, sizeof(record));
+    p += sizeof(record);
+
+    const uint8_t *payload = p;
+    p += record.length;
+
+    const auto dir = static_cast< recording::direction >(record.direction);
+
+    if (dir == recording::direction::index ||
+        (dir == recording::direction::tx && !include_tx))
+      continue;
+
+    if (record.length > max_frame_size)
+    {
+      sink.result.size_errors++;
+      continue;
+    }
+
+    sink.timestamp_ns = record.timestamp_ns;
+    sink.frame(payload, record.length);
+  }
+}
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+log_replay::log_replay(const std::string &file,
+                       const log_replay_options &options)
+    : _data(nullptr), _size(0), _format(capture_format::slip),
+      _options(options)
+{
+  if (options.chunk_size == 0)
+    throw std::invalid_argument("The chunk size may not be zero.");
+
+  if (options.speed < 0)
+    throw std::invalid_argument("The speed may not be negative.");
+
+  const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(),
+                            "Unable to open the capture");
+
+  struct stat st;
+
+  if (fstat(fd, &st) < 0)
+  {
+    const int err = errno;
+    close(fd);
+    throw std::system_error(err, std::system_category(),
+                            "Unable to read the capture size");
+  }
+
+  _size = static_cast< std::size_t >(st.st_size);
+
+  if (_size > 0)
+  {
+    void *p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (p == MAP_FAILED)
+    {
+      const int err = errno;
+      close(fd);
+      throw std::system_error(err, std::system_category(),
+                              "Unable to map the capture");
+    }
+
+    madvise(p, _size, MADV_SEQUENTIAL);
+    _data = static_cast< const uint8_t * >(p);
+  }
+
+  close(fd);
+
+  if (_size >= sizeof(recording::magic) &&
+      std::memcmp(_data, recording::magic, sizeof(recording::magic)) == 0)
+  {
+    _format = capture_format::recording;
+
+    const char *error = check_recording_header(_data, _size);
+
+    if (error != nullptr)
+    {
+      munmap(const_cast< uint8_t * >(_data), _size);
+      throw std::invalid_argument(error);
+    }
+  }
+}
+
+log_replay::~log_replay()
+{
+  if (_data != nullptr)
+    munmap(const_cast< uint8_t * >(_data), _size);
+}
+
+replay_stats log_replay::run()
+{
+  using clock = std::chrono::steady_clock;
+
+  const auto start = clock::now();
+
+  const std::vector< chunk > chunks =
+      (_format == capture_format::recording)
+          ? split_recording(_data, _size, _options.chunk_size)
+          : split_slip(_data, _size, _options.chunk_size);
+
+  const bool ordered = (_options.order == replay_order::ordered);
+
+  std::size_t threads = _options.threads;
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  threads = std::max< std::size_t >(1, std::min(threads, chunks.size()));
+
+  /* Ordered replays keep at most two chunks per worker decoded ahead. */
+  const std::size_t window = 2 * threads;
+
+  std::vector< chunk_result > results(chunks.size());
+  std::mutex lock;
+  std::condition_variable cv;
+  std::size_t next      = 0;
+  std::size_t delivered = 0;
+
+  const auto worker = [&] {
+    while (true)
+    {
+      std::size_t i;
+
+      {
+        std::unique_lock< std::mutex > l(lock);
+
+        cv.wait(l, [&] {
+          return next >= chunks.size() || !ordered ||
+                 next < delivered + window;
+        });
+
+        if (next >= chunks.size())
+          return;
+
+        i = next++;
+      }
+
+      chunk_sink sink{results[i], _callbacks, ordered, 0};
+
+      if (_format == capture_format::recording)
+        decode_recording(chunks[i], sink, _options.include_tx);
+      else
+        decode_slip(chunks[i], sink);
+
+      {
+        std::lock_guard< std::mutex > l(lock);
+        results[i].ready = true;
+      }
+
+      cv.notify_all();
+    }
+  };
+
+  std::vector< std::thread > pool;
+  for (std::size_t i = 0; i < threads; i++)
+    pool.emplace_back(worker);
+
+  if (ordered)
+  {
+    const bool paced =
+        _options.speed > 0 && _format == capture_format::recording;
+
+    bool first_entry    = true;
+    int64_t first_ns    = 0;
+    clock::time_point t0;
+
+    for (std::size_t i = 0; i < chunks.size(); i++)
+    {
+      {
+        std::unique_lock< std::mutex > l(lock);
+        cv.wait(l, [&] { return results[i].ready; });
+      }
+
+      for (const auto &e : results[i].entries)
+      {
+        if (paced)
+        {
+          if (first_entry)
+          {
+            first_entry = false;
+            first_ns    = e.timestamp_ns;
+            t0          = clock::now();
+          }
+
+          const auto offset = std::chrono::nanoseconds(static_cast< int64_t >(
+              (e.timestamp_ns - first_ns) / _options.speed));
+
+          std::this_thread::sleep_until(
+              t0 + std::chrono::duration_cast< clock::duration >(offset));
+        }
+
+        slots::table[e.datagram.index](_callbacks, e.datagram);
+      }
+
+      results[i].delivered = results[i].entries.size();
+      std::vector< chunk_result::entry >().swap(results[i].entries);
+
+      {
+        std::lock_guard< std::mutex > l(lock);
+        delivered = i + 1;
+      }
+
+      cv.notify_all();
+    }
+  }
+
+  for (auto &t : pool)
+    t.join();
+
+  replay_stats stats = {};
+
+  for (const auto &r : results)
+  {
+    stats.frames += r.frames;
+    stats.datagrams += r.delivered;
+    stats.crc_errors += r.crc_errors;
+    stats.size_errors += r.size_errors;
+  }
+
+  stats.bytes   = _size;
+  stats.seconds = std::chrono::duration< double >(clock::now() - start).count();
+
+  return stats;
+}
+
+}  // namespace kfly_comm
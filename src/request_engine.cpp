@@ -0,0 +1,345 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/request_engine.hpp"
+
+#include <algorithm>
+
+namespace kfly_comm
+{
+namespace
+{
+/**
+ * @brief   Bits on the wire per byte, 8N1.
+ */
+constexpr uint64_t bits_per_byte = 10;
+
+/**
+ * @brief   Wire time of bytes at a baudrate.
+ */
+std::chrono::nanoseconds wire_time(std::size_t bytes, unsigned baudrate)
+{
+  return std::chrono::nanoseconds(bytes * bits_per_byte * 1000000000ull /
+                                  baudrate);
+}
+}
+
+/**
+ * @brief   Feeds the frames received by the codec to the engine.
+ */
+class request_engine::answer_tap : public frame_tap
+{
+public:
+  request_engine &engine;
+
+  explicit answer_tap(request_engine &e) : engine(e)
+  {
+  }
+
+  void on_frame(const uint8_t *frame, const std::size_t size,
+                std::chrono::steady_clock::time_point) override
+  {
+    /* Telemetry streams past at a high rate, skip it when idle. */
+    if (engine._expected_count.load(std::memory_order_relaxed) > 0)
+      engine.on_answer(frame, size);
+  }
+};
+
+/*********************************
+ * Private members
+ ********************************/
+
+void request_engine::transmit(request &r,
+                              std::chrono::steady_clock::time_point now,
+                              std::vector< std::vector< uint8_t > > &frames)
+{
+  /* The frame leaves the wire after the ones sent before it. */
+  auto sent = now;
+
+  if (_options.baudrate > 0)
+  {
+    _wire_free = std::max(_wire_free, now) +
+                 wire_time(r.frame.size(), _options.baudrate);
+    sent = _wire_free;
+  }
+
+  r.deadline = sent + _options.timeout;
+  r.attempts++;
+
+  _transmissions.push_back(
+      transmission{r.id, r.answer, r.deadline + _options.timeout});
+  frames.push_back(r.frame);
+}
+
+void request_engine::expire_transmissions(
+    std::chrono::steady_clock::time_point now)
+{
+  _transmissions.erase(
+      std::remove_if(_transmissions.begin(), _transmissions.end(),
+                     [&](const transmission &t) { return t.expires < now; }),
+      _transmissions.end());
+}
+
+void request_engine::fill_window(std::vector< std::vector< uint8_t > > &frames)
+{
+  const auto now = std::chrono::steady_clock::now();
+
+  while (!_waiting.empty() && _in_flight.size() < _options.window)
+  {
+    request r = std::move(_waiting.front());
+    _waiting.pop_front();
+
+    transmit(r, now, frames);
+
+    _in_flight.push_back(std::move(r));
+    _sent.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  _expected_count.store(_in_flight.size() + _transmissions.size(),
+                        std::memory_order_relaxed);
+  _cv.notify_all();
+}
+
+void request_engine::send_frames(
+    const std::vector< std::vector< uint8_t > > &frames)
+{
+  for (const auto &f : frames)
+    _send(f.data(), f.size());
+}
+
+void request_engine::submit(std::vector< uint8_t > frame, commands answer,
+                            completion done)
+{
+  std::vector< std::vector< uint8_t > > frames;
+
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+
+    _waiting.push_back(request{_next_id++, std::move(frame),
+                               static_cast< uint8_t >(answer),
+                               std::move(done),
+                               std::chrono::steady_clock::time_point(), 0});
+    fill_window(frames);
+  }
+
+  send_frames(frames);
+}
+
+void request_engine::on_answer(const uint8_t *frame, std::size_t size)
+{
+  const uint8_t cmd = frame[0] & 0x7f;
+
+  std::vector< std::vector< uint8_t > > frames;
+  completion done;
+
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+
+    expire_transmissions(std::chrono::steady_clock::now());
+
+    /* KFly answers in order, the answer belongs to the oldest transmission
+     * expecting it. A subscribed stream of the command is indistinguishable
+     * from the answer, see the class description. */
+    auto t = std::find_if(
+        _transmissions.begin(), _transmissions.end(),
+        [&](const transmission &tr) { return tr.answer == cmd; });
+
+    if (t == _transmissions.end())
+    {
+      _expected_count.store(_in_flight.size() + _transmissions.size(),
+                            std::memory_order_relaxed);
+      return;
+    }
+
+    const uint64_t id = t->id;
+    _transmissions.erase(t);
+
+    auto it = std::find_if(_in_flight.begin(), _in_flight.end(),
+                           [&](const request &r) { return r.id == id; });
+
+    if (it == _in_flight.end())
+    {
+      /* Answer to another transmission of a completed request. */
+      _duplicates.fetch_add(1, std::memory_order_relaxed);
+      _expected_count.store(_in_flight.size() + _transmissions.size(),
+                            std::memory_order_relaxed);
+      return;
+    }
+
+    done = std::move(it->done);
+    _in_flight.erase(it);
+    _completed.fetch_add(1, std::memory_order_relaxed);
+
+    fill_window(frames);
+  }
+
+  /* The payload, without header and CRC. */
+  done(frame + 2, size - 4, std::error_code());
+
+  send_frames(frames);
+}
+
+void request_engine::run()
+{
+  std::unique_lock< std::mutex > lock(_lock);
+
+  while (_running)
+  {
+    if (_in_flight.empty())
+    {
+      _cv.wait(lock);
+      continue;
+    }
+
+    const auto earliest =
+        std::min_element(_in_flight.begin(), _in_flight.end(),
+                         [](const request &a, const request &b) {
+                           return a.deadline < b.deadline;
+                         })
+            ->deadline;
+
+    if (_cv.wait_until(lock, earliest) != std::cv_status::timeout)
+      continue;
+
+    /* Retransmit or fail the expired requests. */
+    const auto now = std::chrono::steady_clock::now();
+
+    std::vector< std::vector< uint8_t > > frames;
+    std::vector< completion > failed;
+
+    for (auto it = _in_flight.begin(); it != _in_flight.end();)
+    {
+      if (it->deadline > now)
+      {
+        ++it;
+      }
+      else if (it->attempts <= _options.retries)
+      {
+        transmit(*it, now, frames);
+        _retransmits.fetch_add(1, std::memory_order_relaxed);
+        ++it;
+      }
+      else
+      {
+        failed.push_back(std::move(it->done));
+        it = _in_flight.erase(it);
+        _timeouts.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    expire_transmissions(now);
+    fill_window(frames);
+
+    lock.unlock();
+
+    for (auto &done : failed)
+      done(nullptr, 0, std::make_error_code(std::errc::timed_out));
+
+    send_frames(frames);
+
+    lock.lock();
+  }
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+request_engine::request_engine(codec &c, send_function send,
+                               const request_options &options)
+    : _options(options),
+      _codec(c),
+      _send(std::move(send)),
+      _next_id(0),
+      _expected_count(0),
+      _sent(0),
+      _retransmits(0),
+      _completed(0),
+      _timeouts(0),
+      _duplicates(0),
+      _tap(new answer_tap(*this)),
+      _running(true)
+{
+  if (options.window == 0)
+    throw std::invalid_argument("The window may not be zero.");
+
+  if (!_send)
+    throw std::invalid_argument("A send function is needed.");
+
+  _thread = std::thread(&request_engine::run, this);
+  _codec.add_frame_tap(*_tap);
+}
+
+request_engine::~request_engine()
+{
+  /* No answers arrive after this, the parser lock is taken by it. */
+  _codec.remove_frame_tap(*_tap);
+
+  std::deque< request > cancelled;
+
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+
+    _running = false;
+    _cv.notify_all();
+
+    cancelled = std::move(_in_flight);
+    cancelled.insert(cancelled.end(),
+                     std::make_move_iterator(_waiting.begin()),
+                     std::make_move_iterator(_waiting.end()));
+    _waiting.clear();
+    _transmissions.clear();
+    _expected_count = 0;
+  }
+
+  _thread.join();
+
+  for (auto &r : cancelled)
+    r.done(nullptr, 0, std::make_error_code(std::errc::operation_canceled));
+}
+
+void request_engine::command(commands command, set_callback done)
+{
+  submit(codec::generate_command(command, true), commands::ACK,
+         [done](const uint8_t *, std::size_t, std::error_code ec) {
+           done(ec);
+         });
+}
+
+std::future< void > request_engine::command(commands command)
+{
+  auto promise = std::make_shared< std::promise< void > >();
+
+  this->command(command, [promise](std::error_code ec) {
+    if (ec)
+      promise->set_exception(std::make_exception_ptr(
+          std::system_error(ec, "Command request failed")));
+    else
+      promise->set_value();
+  });
+
+  return promise->get_future();
+}
+
+std::size_t request_engine::pending()
+{
+  std::lock_guard< std::mutex > lock(_lock);
+  return _waiting.size() + _in_flight.size();
+}
+
+request_stats request_engine::stats() const noexcept
+{
+  request_stats s;
+
+  s.sent        = _sent.load(std::memory_order_relaxed);
+  s.retransmits = _retransmits.load(std::memory_order_relaxed);
+  s.completed   = _completed.load(std::memory_order_relaxed);
+  s.timeouts    = _timeouts.load(std::memory_order_relaxed);
+  s.duplicates  = _duplicates.load(std::memory_order_relaxed);
+
+  return s;
+}
+
+}  // namespace kfly_comm
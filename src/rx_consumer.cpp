@@ -0,0 +1,155 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/rx_consumer.hpp"
+#include "kfly_comm/kfly_comm.hpp"
+
+namespace kfly_comm
+{
+/*********************************
+ * Private members
+ ********************************/
+
+void rx_consumer::notify_consumer()
+{
+  /* Pairs with the fence in run(), either the consumer sees the new
+   * datagram or the parser sees that it waits. */
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if (_consumer_waiting.load(std::memory_order_relaxed))
+  {
+    std::lock_guard< std::mutex > lock(_wait_lock);
+    _wait_cv.notify_all();
+  }
+}
+
+void rx_consumer::wait_for_space()
+{
+  std::unique_lock< std::mutex > lock(_wait_lock);
+
+  _producer_waiting.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  _wait_cv.wait(lock, [&] {
+    return _ring.size() < _ring.capacity() ||
+           !_accepting.load(std::memory_order_acquire);
+  });
+
+  _producer_waiting.store(false, std::memory_order_relaxed);
+}
+
+void rx_consumer::run()
+{
+  while (_running.load(std::memory_order_acquire))
+  {
+    if (poll() > 0)
+      continue;
+
+    std::unique_lock< std::mutex > lock(_wait_lock);
+
+    _consumer_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    _wait_cv.wait(lock, [&] {
+      return !_ring.empty() || !_running.load(std::memory_order_acquire);
+    });
+
+    _consumer_waiting.store(false, std::memory_order_relaxed);
+  }
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+rx_consumer::rx_consumer(codec &c, std::size_t capacity,
+                         overflow_policy policy)
+    : _codec(c),
+      _policy(policy),
+      _ring(capacity),
+      _queued(0),
+      _overflows(0),
+      _high_water(0),
+      _delivered(0),
+      _consumer_waiting(false),
+      _producer_waiting(false),
+      _accepting(true),
+      _running(false)
+{
+  _codec.attach(*this);
+}
+
+rx_consumer::~rx_consumer()
+{
+  /* Release a blocked parser before taking the parser lock. */
+  {
+    std::lock_guard< std::mutex > lock(_wait_lock);
+    _accepting.store(false, std::memory_order_release);
+    _wait_cv.notify_all();
+  }
+
+  stop();
+  _codec.detach(*this);
+}
+
+std::size_t rx_consumer::poll(std::size_t max)
+{
+  std::size_t count = 0;
+  slots::slot s;
+
+  while (count < max && _ring.try_pop(s))
+  {
+    /* Pairs with the fence in wait_for_space(). */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (_producer_waiting.load(std::memory_order_relaxed))
+    {
+      std::lock_guard< std::mutex > lock(_wait_lock);
+      _wait_cv.notify_all();
+    }
+
+    slots::table[s.index](_callbacks, s);
+    count++;
+  }
+
+  _delivered.fetch_add(count, std::memory_order_relaxed);
+
+  return count;
+}
+
+void rx_consumer::start()
+{
+  if (_running.exchange(true))
+    return;
+
+  _thread = std::thread(&rx_consumer::run, this);
+}
+
+void rx_consumer::stop()
+{
+  {
+    std::lock_guard< std::mutex > lock(_wait_lock);
+    _running.store(false, std::memory_order_release);
+    _wait_cv.notify_all();
+  }
+
+  if (_thread.joinable())
+    _thread.join();
+}
+
+rx_consumer_stats rx_consumer::stats() const noexcept
+{
+  rx_consumer_stats s;
+
+  s.queued     = _queued.load(std::memory_order_relaxed);
+  s.delivered  = _delivered.load(std::memory_order_relaxed);
+  s.overflows  = _overflows.load(std::memory_order_relaxed);
+  s.high_water = _high_water.load(std::memory_order_relaxed);
+  s.capacity   = _ring.capacity();
+
+  return s;
+}
+
+}  // namespace kfly_comm
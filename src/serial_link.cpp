@@ -0,0 +1,297 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/serial_link.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+namespace kfly_comm
+{
+namespace
+{
+/**
+ * @brief   Epoll data of the events of the I/O thread.
+ */
+constexpr uint64_t wake_data = 0;
+constexpr uint64_t link_data = 1;
+
+/**
+ * @brief   Converts a baudrate to the termios speed.
+ */
+speed_t to_speed(unsigned baudrate)
+{
+  switch (baudrate)
+  {
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+    case 460800:
+      return B460800;
+    case 500000:
+      return B500000;
+    case 921600:
+      return B921600;
+    case 1000000:
+      return B1000000;
+    case 2000000:
+      return B2000000;
+    case 3000000:
+      return B3000000;
+    case 4000000:
+      return B4000000;
+    default:
+      throw std::invalid_argument("Unsupported baudrate.");
+  }
+}
+}
+
+using details::throw_errno;
+
+int open_serial_port(const std::string &device, unsigned baudrate)
+{
+  const speed_t speed = to_speed(baudrate);
+
+  const int fd = open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+  if (fd < 0)
+    throw_errno("Unable to open the serial port");
+
+  struct termios tty;
+
+  if (tcgetattr(fd, &tty) < 0)
+  {
+    const int err = errno;
+    close(fd);
+    throw std::system_error(err, std::system_category(),
+                            "Unable to read the serial port settings");
+  }
+
+  /* Raw 8N1, no flow control, reads return what is available. */
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tty.c_cc[VMIN]  = 0;
+  tty.c_cc[VTIME] = 0;
+
+  if (cfsetispeed(&tty, speed) < 0 || cfsetospeed(&tty, speed) < 0 ||
+      tcsetattr(fd, TCSANOW, &tty) < 0)
+  {
+    const int err = errno;
+    close(fd);
+    throw std::system_error(err, std::system_category(),
+                            "Unable to configure the serial port");
+  }
+
+  tcflush(fd, TCIOFLUSH);
+
+  return fd;
+}
+
+/*********************************
+ * Private members
+ ********************************/
+
+void serial_link::start()
+{
+  details::set_nonblocking(_fd);
+
+  _wake.reset(new details::wake_event());
+
+  _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (_epoll_fd < 0)
+    throw_errno("Unable to create the epoll instance");
+
+  struct epoll_event ev = {};
+
+  ev.events   = EPOLLIN;
+  ev.data.u64 = link_data;
+
+  if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _fd, &ev) < 0)
+    throw_errno("Unable to add the link to epoll");
+
+  ev.events   = EPOLLIN;
+  ev.data.u64 = wake_data;
+
+  if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake->native_handle(), &ev) < 0)
+    throw_errno("Unable to add the wake event to epoll");
+
+  _running = true;
+  _thread  = std::thread(&serial_link::run, this);
+}
+
+void serial_link::run()
+{
+  struct epoll_event events[2];
+
+  while (_running.load(std::memory_order_relaxed))
+  {
+    const int n = epoll_wait(_epoll_fd, events, 2, -1);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      _error = errno;
+      break;
+    }
+
+    bool ok = true;
+
+    for (int i = 0; i < n && ok; i++)
+    {
+      if (events[i].data.u64 == wake_data)
+      {
+        /* Wake up for transmission or stop. */
+        _wake->clear();
+        ok = transmit();
+      }
+      else
+      {
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+          ok = receive();
+
+        if (ok && (events[i].events & EPOLLOUT))
+          ok = transmit();
+      }
+    }
+
+    if (!ok)
+      break;
+  }
+
+  _running = false;
+}
+
+bool serial_link::receive()
+{
+  const auto status = details::read_available(
+      _fd, _rx_buffer, [this](const uint8_t *data, std::size_t size) {
+        _rx_bytes.fetch_add(size, std::memory_order_relaxed);
+        _codec.parse(data, size);
+      });
+
+  if (status == details::read_status::failed)
+    _error = errno;
+
+  return status == details::read_status::drained;
+}
+
+bool serial_link::transmit()
+{
+  std::lock_guard< std::mutex > lock(_tx_lock);
+
+  const ssize_t n = _tx_queue.flush(_fd);
+
+  if (n < 0)
+  {
+    _error = errno;
+    return false;
+  }
+
+  _tx_bytes.fetch_add(n, std::memory_order_relaxed);
+
+  /* Wait for the port to become writable only while data is pending. */
+  details::watch_writable(_epoll_fd, _fd, link_data, !_tx_queue.empty(),
+                          _tx_waiting);
+
+  return true;
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+serial_link::serial_link(codec &c, const std::string &device,
+                         unsigned baudrate, std::size_t rx_buffer_size)
+    : serial_link(c, open_serial_port(device, baudrate), rx_buffer_size)
+{
+}
+
+serial_link::serial_link(codec &c, int fd, std::size_t rx_buffer_size)
+    : _codec(c),
+      _fd(fd),
+      _epoll_fd(-1),
+      _rx_buffer(),
+      _tx_queue(&c.statistics()),
+      _tx_waiting(false),
+      _running(false),
+      _error(0),
+      _rx_bytes(0),
+      _tx_bytes(0)
+{
+  if (fd < 0)
+    throw std::invalid_argument("Invalid file descriptor.");
+
+  /* The descriptor is owned from here on, whatever fails closes it and
+   * the epoll instance. The wake event closes itself. */
+  try
+  {
+    if (rx_buffer_size == 0)
+      throw std::invalid_argument("The receive buffer may not be empty.");
+
+    _rx_buffer.resize(rx_buffer_size);
+    start();
+  }
+  catch (...)
+  {
+    if (_epoll_fd >= 0)
+      close(_epoll_fd);
+
+    close(_fd);
+    throw;
+  }
+}
+
+serial_link::~serial_link()
+{
+  /* Stop and wake the I/O thread. */
+  _running = false;
+  _wake->signal();
+
+  if (_thread.joinable())
+    _thread.join();
+
+  close(_epoll_fd);
+  close(_fd);
+}
+
+void serial_link::send(std::vector< uint8_t > message)
+{
+  if (message.empty())
+    return;
+
+  {
+    std::lock_guard< std::mutex > lock(_tx_lock);
+    _tx_queue.push(std::move(message));
+  }
+
+  /* Wake the I/O thread to write the message. */
+  _wake->signal();
+}
+
+void serial_link::send(const uint8_t *data, const std::size_t size)
+{
+  send(std::vector< uint8_t >(data, data + size));
+}
+
+}  // namespace kfly_comm
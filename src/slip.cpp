@@ -0,0 +1,220 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/slip.hpp"
+
+#include <atomic>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KFLY_COMM_SLIP_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace kfly_comm
+{
+namespace slip
+{
+namespace
+{
+using find_function = const uint8_t *(*)(const uint8_t *, const uint8_t *);
+using encode_function = std::size_t (*)(const uint8_t *, std::size_t,
+                                        uint8_t *);
+
+const uint8_t *find_scalar(const uint8_t *p, const uint8_t *end) noexcept
+{
+  while (p < end && !is_special(*p))
+    p++;
+
+  return p;
+}
+
+/**
+ * @brief   Escapes bytes, copying the runs found by Find in bulk. Bytes which
+ *          need escaping are checked before scanning, so dense escapes do
+ *          not pay for a scan each.
+ */
+template < const uint8_t *(*Find)(const uint8_t *, const uint8_t *) >
+std::size_t encode_runs(const uint8_t *p, std::size_t size,
+                        uint8_t *out) noexcept
+{
+  const uint8_t *end = p + size;
+  uint8_t *o         = out;
+
+  while (p < end)
+  {
+    if (is_special(*p))
+    {
+      o += encode_byte(*p++, o);
+      continue;
+    }
+
+    const uint8_t *special = Find(p, end);
+
+    std::memcpy(o, p, special - p);
+    o += special - p;
+    p = special;
+  }
+
+  return o - out;
+}
+
+#ifdef KFLY_COMM_SLIP_SIMD
+
+/* SSE2 is part of x86-64, the kernel needs no runtime check. */
+const uint8_t *find_sse2(const uint8_t *p, const uint8_t *end) noexcept
+{
+  const __m128i end_byte = _mm_set1_epi8(static_cast< char >(END));
+  const __m128i esc_byte = _mm_set1_epi8(static_cast< char >(ESC));
+
+  while (end - p >= 16)
+  {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast< const __m128i * >(p));
+    const int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, end_byte), _mm_cmpeq_epi8(v, esc_byte)));
+
+    if (mask != 0)
+      return p + __builtin_ctz(static_cast< unsigned >(mask));
+
+    p += 16;
+  }
+
+  return find_scalar(p, end);
+}
+
+__attribute__((target("avx2"))) const uint8_t *find_avx2(
+    const uint8_t *p, const uint8_t *end) noexcept
+{
+  const __m256i end_byte = _mm256_set1_epi8(static_cast< char >(END));
+  const __m256i esc_byte = _mm256_set1_epi8(static_cast< char >(ESC));
+
+  while (end - p >= 32)
+  {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast< const __m256i * >(p));
+    const int mask = _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(v, end_byte), _mm256_cmpeq_epi8(v, esc_byte)));
+
+    if (mask != 0)
+      return p + __builtin_ctz(static_cast< unsigned >(mask));
+
+    p += 32;
+  }
+
+  return find_sse2(p, end);
+}
+
+/**
+ * @brief   Checks the CPU for AVX2 support.
+ */
+bool detect_avx2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool detect_avx2()
+{
+  return false;
+}
+
+#endif
+
+/**
+ * @brief   The kernels of an engine.
+ */
+struct kernels
+{
+  engine id;
+  find_function find;
+  encode_function encode;
+};
+
+constexpr kernels scalar_kernels = {engine::scalar, find_scalar,
+                                    encode_runs< find_scalar >};
+
+#ifdef KFLY_COMM_SLIP_SIMD
+constexpr kernels sse2_kernels = {engine::sse2, find_sse2,
+                                  encode_runs< find_sse2 >};
+
+constexpr kernels avx2_kernels = {engine::avx2, find_avx2,
+                                  encode_runs< find_avx2 >};
+#endif
+
+/**
+ * @brief   The kernels in use, nullptr until the first use. Constant
+ *          initialized, so it may be used from other static initializers.
+ */
+std::atomic< const kernels * > active(nullptr);
+
+/**
+ * @brief   The kernels in use, the fastest ones supported by the running CPU
+ *          are selected on the first use.
+ */
+const kernels *get_kernels() noexcept
+{
+  const kernels *k = active.load(std::memory_order_relaxed);
+
+  if (k == nullptr)
+  {
+#ifdef KFLY_COMM_SLIP_SIMD
+    k = detect_avx2() ? &avx2_kernels : &sse2_kernels;
+#else
+    k = &scalar_kernels;
+#endif
+
+    active.store(k, std::memory_order_relaxed);
+  }
+
+  return k;
+}
+}
+
+engine active_engine() noexcept
+{
+  return get_kernels()->id;
+}
+
+bool select_engine(engine e) noexcept
+{
+  switch (e)
+  {
+    case engine::scalar:
+      active.store(&scalar_kernels, std::memory_order_relaxed);
+      return true;
+
+#ifdef KFLY_COMM_SLIP_SIMD
+    case engine::sse2:
+      active.store(&sse2_kernels, std::memory_order_relaxed);
+      return true;
+
+    case engine::avx2:
+      if (!detect_avx2())
+        return false;
+
+      active.store(&avx2_kernels, std::memory_order_relaxed);
+      return true;
+#endif
+
+    default:
+      return false;
+  }
+}
+
+const uint8_t *find_special(const uint8_t *begin, const uint8_t *end) noexcept
+{
+  return get_kernels()->find(begin, end);
+}
+
+std::size_t encode(const uint8_t *data, std::size_t size,
+                   uint8_t *out) noexcept
+{
+  return get_kernels()->encode(data, size, out);
+}
+
+}  // namespace slip
+}  // namespace kfly_comm
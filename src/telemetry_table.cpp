@@ -0,0 +1,118 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/telemetry_table.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace kfly_comm
+{
+namespace details
+{
+namespace
+{
+/**
+ * @brief   Alignment of the chunks and columns, a cache line and the widest
+ *          vector load.
+ */
+constexpr std::size_t column_alignment = 64;
+
+constexpr std::size_t align_up(std::size_t n)
+{
+  return (n + column_alignment - 1) & ~(column_alignment - 1);
+}
+
+/**
+ * @brief   Copies one element, with a fixed size for the common sizes.
+ */
+inline void copy_element(uint8_t *dst, const uint8_t *src, std::size_t size)
+{
+  switch (size)
+  {
+    case 1:
+      *dst = *src;
+      break;
+
+    case 2:
+      std::memcpy(dst, src, 2);
+      break;
+
+    case 4:
+      std::memcpy(dst, src, 4);
+      break;
+
+    case 8:
+      std::memcpy(dst, src, 8);
+      break;
+
+    default:
+      std::memcpy(dst, src, size);
+      break;
+  }
+}
+}
+
+/*********************************
+ * Private members
+ ********************************/
+
+void column_store::grow()
+{
+  void *p = nullptr;
+
+  if (posix_memalign(&p, column_alignment, _chunk_bytes) != 0)
+    throw std::bad_alloc();
+
+  _chunks.emplace_back(static_cast< uint8_t * >(p), std::free);
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+column_store::column_store(const std::vector< column_info > &columns,
+                           std::size_t chunk_rows)
+    : _columns(columns), _chunk_rows(chunk_rows), _chunk_bytes(0), _rows(0)
+{
+  if (chunk_rows == 0 || chunk_rows % column_alignment != 0)
+    throw std::invalid_argument("The chunk rows must be a multiple of 64.");
+
+  for (const auto &c : _columns)
+  {
+    _column_offsets.push_back(_chunk_bytes);
+    _chunk_bytes += align_up(c.size * _chunk_rows);
+  }
+}
+
+void column_store::append(const uint8_t *row)
+{
+  const std::size_t chunk = _rows / _chunk_rows;
+  const std::size_t index = _rows % _chunk_rows;
+
+  if (chunk == _chunks.size())
+    grow();
+
+  uint8_t *base = _chunks[chunk].get();
+
+  for (std::size_t i = 0; i < _columns.size(); i++)
+  {
+    const column_info &c = _columns[i];
+
+    copy_element(base + _column_offsets[i] + index * c.size, row + c.offset,
+                 c.size);
+  }
+
+  _rows++;
+}
+
+void column_store::reserve(std::size_t rows)
+{
+  while (_chunks.size() * _chunk_rows < rows)
+    grow();
+}
+
+}  // namespace details
+}  // namespace kfly_comm
@@ -0,0 +1,283 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+namespace kfly_comm
+{
+namespace trace
+{
+namespace
+{
+/**
+ * @brief   The rings of all threads which traced, kept after the threads
+ *          exit so their events can still be written. The ring of an
+ *          exited thread is reused by the next new thread, so there are
+ *          only as many rings as threads ever traced at the same time.
+ */
+struct ring_registry
+{
+  std::mutex lock;
+  std::vector< std::shared_ptr< event_ring > > rings;
+
+  /** @brief Rings of exited threads, not written by any thread. */
+  std::vector< std::shared_ptr< event_ring > > idle;
+
+  /** @brief Clock and ticks() when the first ring was created. */
+  uint64_t origin_ns    = now_ns();
+  uint64_t origin_ticks = ticks();
+};
+
+ring_registry &registry()
+{
+  static ring_registry r;
+  return r;
+}
+
+/**
+ * @brief   The ring of a thread, returned to the registry on thread exit.
+ */
+class thread_ring_owner
+{
+private:
+  std::shared_ptr< event_ring > _ring;
+
+public:
+  ~thread_ring_owner()
+  {
+    if (!_ring)
+      return;
+
+    auto &r = registry();
+    std::lock_guard< std::mutex > locker(r.lock);
+    r.idle.push_back(std::move(_ring));
+  }
+
+  event_ring &get()
+  {
+    if (!_ring)
+    {
+      auto &r = registry();
+      std::lock_guard< std::mutex > locker(r.lock);
+
+      if (!r.idle.empty())
+      {
+        _ring = std::move(r.idle.back());
+        r.idle.pop_back();
+      }
+      else
+      {
+        _ring = std::make_shared< event_ring >(
+            static_cast< uint32_t >(r.rings.size() + 1));
+        r.rings.push_back(_ring);
+      }
+    }
+
+    return *_ring;
+  }
+};
+
+/**
+ * @brief   Restores the format of a stream when leaving the scope.
+ */
+class format_guard
+{
+private:
+  std::ostream &_out;
+  const std::ios::fmtflags _flags;
+  const std::streamsize _precision;
+
+public:
+  explicit format_guard(std::ostream &out)
+      : _out(out), _flags(out.flags()), _precision(out.precision())
+  {
+  }
+
+  ~format_guard()
+  {
+    _out.flags(_flags);
+    _out.precision(_precision);
+  }
+
+  format_guard(const format_guard &) = delete;
+  format_guard &operator=(const format_guard &) = delete;
+};
+}
+
+/*********************************
+ * event_ring
+ ********************************/
+
+constexpr std::size_t event_ring::capacity;
+
+event_ring::event_ring(uint32_t thread_id) noexcept
+    : _claimed(0), _published(0), _start(0), _thread_id(thread_id)
+{
+  for (auto &s : _slots)
+  {
+    s.begin.store(0, std::memory_order_relaxed);
+    s.info.store(0, std::memory_order_relaxed);
+  }
+}
+
+std::size_t event_ring::copy(event *out, std::size_t max) const noexcept
+{
+  const uint64_t end = _published.load(std::memory_order_acquire);
+  uint64_t begin     = _start.load(std::memory_order_relaxed);
+
+  begin = std::max(begin, (end > capacity) ? end - capacity : 0);
+  begin = std::max(begin, (end > max) ? end - max : 0);
+
+  for (uint64_t i = begin; i < end; i++)
+  {
+    const slot &s       = _slots[i & (capacity - 1)];
+    const uint64_t info = s.info.load(std::memory_order_relaxed);
+
+    event &e      = out[i - begin];
+    e.begin    = s.begin.load(std::memory_order_relaxed);
+    e.duration = info >> 16;
+    e.what     = static_cast< stage >((info >> 8) & 0xff);
+    e.command  = static_cast< uint8_t >(info);
+  }
+
+  /* Drop the events the writer may have overwritten during the copy. */
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t claimed = _claimed.load(std::memory_order_relaxed);
+  const uint64_t valid   = (claimed > capacity) ? claimed - capacity : 0;
+
+  if (valid <= begin)
+    return end - begin;
+
+  if (valid >= end)
+    return 0;
+
+  std::copy(out + (valid - begin), out + (end - begin), out);
+
+  return end - valid;
+}
+
+void event_ring::clear() noexcept
+{
+  _start.store(_claimed.load(std::memory_order_relaxed),
+               std::memory_order_relaxed);
+}
+
+/*********************************
+ * Functions
+ ********************************/
+
+const char *stage_name(stage s) noexcept
+{
+  switch (s)
+  {
+    case stage::parse:
+      return "parse";
+
+    case stage::frame:
+      return "frame";
+
+    case stage::check_frame:
+      return "check_frame";
+
+    case stage::frame_taps:
+      return "frame_taps";
+
+    case stage::decode:
+      return "decode";
+
+    case stage::callback:
+      return "callback";
+  }
+
+  return "unknown";
+}
+
+event_ring &thread_ring()
+{
+  thread_local thread_ring_owner owner;
+  return owner.get();
+}
+
+void write_chrome_json(std::ostream &out)
+{
+  std::vector< std::shared_ptr< event_ring > > rings;
+  uint64_t origin_ns, origin_ticks;
+
+  {
+    auto &r = registry();
+    std::lock_guard< std::mutex > locker(r.lock);
+    rings        = r.rings;
+    origin_ns    = r.origin_ns;
+    origin_ticks = r.origin_ticks;
+  }
+
+  /* Microseconds per tick, from the time passed since the origin. */
+  const uint64_t elapsed_ns    = now_ns() - origin_ns;
+  const uint64_t elapsed_ticks = ticks() - origin_ticks;
+  const double us_per_tick =
+      (elapsed_ticks > 0) ? 1e-3 * elapsed_ns / elapsed_ticks : 1e-3;
+
+  std::vector< event > events(event_ring::capacity);
+  bool first = true;
+
+  const format_guard guard(out);
+
+  out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+
+  for (const auto &ring : rings)
+  {
+    const std::size_t n = ring->copy(events.data(), events.size());
+
+    for (std::size_t i = 0; i < n; i++)
+    {
+      const event &e = events[i];
+
+      /* Timestamps are in microseconds. */
+      out << (first ? "\n" : ",\n") << "{\"name\": \"" << stage_name(e.what)
+          << "\", \"cat\": \"kfly_comm\", \"ph\": \"X\", \"pid\": 1, "
+          << "\"tid\": " << ring->thread_id() << std::fixed
+          << std::setprecision(3) << ", \"ts\": "
+          << 1e-3 * origin_ns +
+                 us_per_tick * static_cast< int64_t >(e.begin - origin_ticks)
+          << ", \"dur\": " << us_per_tick * e.duration;
+
+      if (e.command != 0)
+        out << ", \"args\": {\"command\": " << unsigned(e.command) << "}";
+
+      out << "}";
+      first = false;
+    }
+  }
+
+  out << "\n]}\n";
+}
+
+void write_chrome_json(const std::string &file)
+{
+  std::ofstream out(file);
+
+  if (!out)
+    throw std::system_error(errno, std::system_category(),
+                            "Unable to open " + file);
+
+  write_chrome_json(out);
+}
+
+void clear_thread()
+{
+  thread_ring().clear();
+}
+
+}  // namespace trace
+}  // namespace kfly_comm
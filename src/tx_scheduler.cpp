@@ -0,0 +1,535 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "kfly_comm/tx_scheduler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+namespace kfly_comm
+{
+namespace
+{
+/**
+ * @brief   Maximum number of frames in one writev.
+ */
+constexpr std::size_t max_iovecs = 64;
+
+/**
+ * @brief   Bits per byte on a 8N1 serial line.
+ */
+constexpr uint64_t bits_per_byte = 10;
+
+/**
+ * @brief   Wire time of bytes at a baudrate.
+ */
+std::chrono::nanoseconds wire_time(std::size_t bytes, unsigned baudrate)
+{
+  return std::chrono::nanoseconds(bytes * bits_per_byte * 1000000000ull /
+                                  baudrate);
+}
+}
+
+constexpr std::size_t tx_scheduler::frame_capacity;
+
+/*********************************
+ * Private members
+ ********************************/
+
+void tx_scheduler::run()
+{
+  const bool paced = _options.baudrate > 0;
+
+  while (_running.load(std::memory_order_relaxed))
+  {
+    drain_queue();
+
+    auto now         = std::chrono::steady_clock::now();
+    bool would_block = false;
+
+    if (_batch.empty() && (!paced || now >= next_gather()))
+      gather(now);
+
+    if (!_batch.empty() && !write_batch(would_block))
+      break;
+
+    const bool pending =
+        std::any_of(_pending.begin(), _pending.end(),
+                    [](const std::deque< node * > &q) { return !q.empty(); });
+
+    /* More to write right away, e.g. past the writev limit. */
+    if (!would_block && pending && !paced)
+      continue;
+
+    /* Sleep until the pacing allows the next batch, the port is writable
+     * or a frame is sent. */
+    struct timespec ts       = {0, 0};
+    struct timespec *timeout = nullptr;
+
+    if (!would_block && pending)
+    {
+      now = std::chrono::steady_clock::now();
+
+      const auto wait = next_gather() - now;
+
+      if (wait <= std::chrono::steady_clock::duration::zero())
+        continue;
+
+      const auto ns =
+          std::chrono::duration_cast< std::chrono::nanoseconds >(wait)
+              .count();
+
+      ts.tv_sec  = ns / 1000000000;
+      ts.tv_nsec = ns % 1000000000;
+      timeout    = &ts;
+    }
+
+    _sleeping.store(true, std::memory_order_seq_cst);
+
+    if (!_queue.empty())
+    {
+      _sleeping.store(false, std::memory_order_relaxed);
+      continue;
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd      = _wake.native_handle();
+    fds[0].events  = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd      = _fd;
+    fds[1].events  = would_block ? POLLOUT : 0;
+    fds[1].revents = 0;
+
+    const int n = ppoll(fds, would_block ? 2 : 1, timeout, nullptr);
+
+    _sleeping.store(false, std::memory_order_relaxed);
+
+    if (n < 0 && errno != EINTR)
+    {
+      _error = errno;
+      break;
+    }
+
+    if (n > 0 && (fds[0].revents & POLLIN))
+      _wake.clear();
+  }
+
+  _running = false;
+}
+
+void tx_scheduler::drain_queue()
+{
+  while (!_queue.empty())
+  {
+    node *n = _queue.try_pop();
+
+    if (n == nullptr)
+    {
+      /* A producer is between its two steps, it finishes shortly. */
+      std::this_thread::yield();
+      continue;
+    }
+
+    _pending[static_cast< std::size_t >(n->priority)].push_back(n);
+  }
+}
+
+void tx_scheduler::gather(std::chrono::steady_clock::time_point now)
+{
+  const bool paced  = _options.baudrate > 0;
+  std::size_t bytes = 0;
+
+  /* The wire time already handed to the driver counts against the
+   * window. */
+  const auto in_flight =
+      paced ? std::max(_wire_free - now, std::chrono::steady_clock::duration(0))
+            : std::chrono::steady_clock::duration(0);
+
+  for (auto &queue : _pending)
+  {
+    while (!queue.empty() && _batch.size() < max_iovecs)
+    {
+      node *n = queue.front();
+
+      /* Always take one frame, more while they fit the window. Stopping
+       * here keeps a lower class from passing a higher one. A mailbox's
+       * size is of its last frame, escaping aside the same. */
+      if (paced && !_batch.empty() &&
+          in_flight + wire_time(bytes + n->size, _options.baudrate) >
+              _options.window)
+        return;
+
+      queue.pop_front();
+
+      /* Mailboxes encode their freshest sample now. */
+      if (n->mailbox != nullptr && !n->mailbox->take())
+        continue;
+
+      _batch.push_back(n);
+      bytes += n->size;
+    }
+  }
+}
+
+bool tx_scheduler::write_batch(bool &would_block)
+{
+  while (!_batch.empty())
+  {
+    struct iovec iov[max_iovecs];
+    std::size_t count = 0;
+
+    for (auto it = _batch.begin(); it != _batch.end() && count < max_iovecs;
+         ++it, ++count)
+    {
+      const std::size_t offset = (count == 0) ? _batch_offset : 0;
+
+      iov[count].iov_base = (*it)->data + offset;
+      iov[count].iov_len  = (*it)->size - offset;
+    }
+
+    ssize_t n = writev(_fd, iov, static_cast< int >(count));
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        would_block = true;
+        return true;
+      }
+
+      _error = errno;
+      return false;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+
+    _writes.fetch_add(1, std::memory_order_relaxed);
+
+    if (_options.baudrate > 0)
+      _wire_free = std::max(_wire_free, now) +
+                   wire_time(static_cast< std::size_t >(n), _options.baudrate);
+
+    /* Retire the written frames. */
+    while (n > 0)
+    {
+      node *front            = _batch.front();
+      const std::size_t left = front->size - _batch_offset;
+
+      if (static_cast< std::size_t >(n) < left)
+      {
+        _batch_offset += n;
+        break;
+      }
+
+      n -= left;
+      _batch_offset = 0;
+      _batch.pop_front();
+
+      class_counters &c =
+          _counters[static_cast< std::size_t >(front->priority)];
+
+      const uint64_t latency = static_cast< uint64_t >(
+          std::chrono::duration_cast< std::chrono::nanoseconds >(
+              now - front->enqueued)
+              .count());
+
+      c.frames.fetch_add(1, std::memory_order_relaxed);
+      c.bytes.fetch_add(front->size, std::memory_order_relaxed);
+      c.latency_ns.fetch_add(latency, std::memory_order_relaxed);
+
+      if (latency > c.max_latency_ns.load(std::memory_order_relaxed))
+        c.max_latency_ns.store(latency, std::memory_order_relaxed);
+
+      if (_options.statistics != nullptr)
+        _options.statistics->tx_encoded(front->data, front->size);
+
+      release(front);
+    }
+  }
+
+  return true;
+}
+
+std::chrono::steady_clock::time_point tx_scheduler::next_gather() const
+{
+  return _wire_free - _options.window;
+}
+
+tx_scheduler::node *tx_scheduler::make_node(tx_priority priority,
+                                            std::size_t size)
+{
+  node *n       = nullptr;
+  uint64_t head = _free.load(std::memory_order_acquire);
+
+  /* Pop the free list, the tag fails the exchange if the node was taken
+   * and returned meanwhile. */
+  while (static_cast< uint32_t >(head) != 0)
+  {
+    node *candidate = &_pool[static_cast< uint32_t >(head) - 1];
+    const uint64_t next =
+        ((head >> 32) + 1) << 32 |
+        candidate->next_free.load(std::memory_order_relaxed);
+
+    if (_free.compare_exchange_weak(head, next, std::memory_order_acquire,
+                                    std::memory_order_acquire))
+    {
+      n = candidate;
+      break;
+    }
+  }
+
+  if (n == nullptr)
+  {
+    n             = new node;
+    n->pool_index = 0;
+  }
+
+  n->priority = priority;
+  n->mailbox  = nullptr;
+  n->enqueued = std::chrono::steady_clock::now();
+  n->size     = size;
+
+  return n;
+}
+
+void tx_scheduler::release(node *n) noexcept
+{
+  if (n->mailbox != nullptr)
+    return;
+
+  if (n->pool_index == 0)
+  {
+    delete n;
+    return;
+  }
+
+  uint64_t head = _free.load(std::memory_order_relaxed);
+
+  do
+  {
+    n->next_free.store(static_cast< uint32_t >(head),
+                       std::memory_order_relaxed);
+  } while (!_free.compare_exchange_weak(
+      head, ((head >> 32) + 1) << 32 | n->pool_index,
+      std::memory_order_release, std::memory_order_relaxed));
+}
+
+void tx_scheduler::enqueue(node *n)
+{
+  _queue.push(n);
+
+  /* Only a sleeping thread needs the system call. */
+  if (_sleeping.load(std::memory_order_seq_cst) &&
+      _sleeping.exchange(false, std::memory_order_seq_cst))
+    _wake.signal();
+}
+
+/*********************************
+ * Public members
+ ********************************/
+
+tx_scheduler::tx_scheduler(int fd, const tx_scheduler_options &options)
+    : _options(options),
+      _fd(fd),
+      _free(0),
+      _sleeping(false),
+      _batch_offset(0),
+      _wire_free(),
+      _writes(0),
+      _running(false),
+      _error(0)
+{
+  if (fd < 0)
+    throw std::invalid_argument("Invalid file descriptor.");
+
+  if (options.window.count() < 0)
+    throw std::invalid_argument("The pacing window may not be negative.");
+
+  if (options.pool_size > UINT32_MAX - 1)
+    throw std::invalid_argument("The node pool is too large.");
+
+  if (options.pool_size > 0)
+  {
+    _pool.reset(new node[options.pool_size]);
+
+    /* Linked in order, the first node on top. */
+    for (std::size_t i = 0; i < options.pool_size; i++)
+    {
+      _pool[i].pool_index = static_cast< uint32_t >(i + 1);
+      _pool[i].next_free.store(
+          (i + 1 < options.pool_size) ? static_cast< uint32_t >(i + 2) : 0,
+          std::memory_order_relaxed);
+    }
+
+    _free.store(1, std::memory_order_relaxed);
+  }
+
+  for (auto &slot : _mailbox_index)
+    slot.store(nullptr, std::memory_order_relaxed);
+
+  for (auto &c : _counters)
+  {
+    c.frames         = 0;
+    c.bytes          = 0;
+    c.latency_ns     = 0;
+    c.max_latency_ns = 0;
+  }
+
+  details::set_nonblocking(fd);
+
+  _running = true;
+  _thread  = std::thread(&tx_scheduler::run, this);
+}
+
+tx_scheduler::~tx_scheduler()
+{
+  _running = false;
+  _wake.signal();
+
+  if (_thread.joinable())
+    _thread.join();
+
+  drain_queue();
+
+  for (auto &queue : _pending)
+    for (node *n : queue)
+      release(n);
+
+  for (node *n : _batch)
+    release(n);
+}
+
+void tx_scheduler::send_command(commands command, bool ack)
+{
+  const auto &frame = command_frame_for(command, ack);
+
+  send(default_priority(command), frame.bytes, frame.size);
+}
+
+void tx_scheduler::send(tx_priority priority, const uint8_t *data,
+                        const std::size_t size)
+{
+  if (size > frame_capacity)
+    throw std::invalid_argument("The message is larger than a frame.");
+
+  if (size == 0)
+    return;
+
+  node *n = make_node(priority, size);
+  std::memcpy(n->data, data, size);
+
+  enqueue(n);
+}
+
+void tx_scheduler::send(const uint8_t *data, const std::size_t size)
+{
+  /* The command follows the leading END, unescaped for all commands. */
+  const commands command = (size >= 2 && data[0] == slip::END)
+                               ? static_cast< commands >(data[1] & 0x7f)
+                               : commands::None;
+
+  send(default_priority(command), data, size);
+}
+
+/*********************************
+ * Mailboxes
+ ********************************/
+
+namespace details
+{
+void tx_mailbox_base::notify()
+{
+  _posted.fetch_add(1, std::memory_order_relaxed);
+
+  /* Queue the node once, the scheduler takes the freshest sample. */
+  if (!_queued.exchange(true, std::memory_order_acq_rel))
+    _scheduler.enqueue(&_node);
+}
+
+tx_mailbox_base::tx_mailbox_base(tx_scheduler &scheduler,
+                                 tx_priority priority, std::size_t frame_size)
+    : _scheduler(scheduler),
+      _queued(false),
+      _last_sent(0),
+      _posted(0),
+      _sent(0),
+      _superseded(0)
+{
+  _node.priority   = priority;
+  _node.mailbox    = this;
+  _node.pool_index = 0;
+  _node.size     = slip::max_encoded_size(0) + frame_size;
+}
+
+tx_mailbox_base::~tx_mailbox_base()
+{
+}
+
+bool tx_mailbox_base::take()
+{
+  /* Cleared first, a later post queues the node again. */
+  _queued.store(false, std::memory_order_seq_cst);
+
+  uint64_t sequence;
+  std::chrono::steady_clock::time_point posted;
+
+  encode_latest(sequence, posted);
+
+  /* Already sent when the node was queued again meanwhile. */
+  if (sequence == _last_sent)
+    return false;
+
+  _superseded.fetch_add(sequence - _last_sent - 1, std::memory_order_relaxed);
+  _sent.fetch_add(1, std::memory_order_relaxed);
+  _last_sent = sequence;
+
+  /* Latency counts from the post of the sample. */
+  _node.enqueued = posted;
+
+  return true;
+}
+
+tx_mailbox_statistics tx_mailbox_base::statistics() const noexcept
+{
+  tx_mailbox_statistics s;
+
+  s.posted     = _posted.load(std::memory_order_relaxed);
+  s.sent       = _sent.load(std::memory_order_relaxed);
+  s.superseded = _superseded.load(std::memory_order_relaxed);
+
+  return s;
+}
+}
+
+tx_scheduler_statistics tx_scheduler::statistics() const noexcept
+{
+  tx_scheduler_statistics s;
+
+  for (std::size_t i = 0; i < tx_priority_count; i++)
+  {
+    const class_counters &c = _counters[i];
+
+    s.classes[i].frames     = c.frames.load(std::memory_order_relaxed);
+    s.classes[i].bytes      = c.bytes.load(std::memory_order_relaxed);
+    s.classes[i].latency_ns = c.latency_ns.load(std::memory_order_relaxed);
+    s.classes[i].max_latency_ns =
+        c.max_latency_ns.load(std::memory_order_relaxed);
+  }
+
+  s.writes = _writes.load(std::memory_order_relaxed);
+
+  return s;
+}
+
+}  // namespace kfly_comm
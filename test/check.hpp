@@ -0,0 +1,47 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/* Data includes */
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * @brief   Checks a condition, reports the failure and counts it.
+ */
+#define KFLY_CHECK(cond)                                                   \
+  do                                                                       \
+  {                                                                        \
+    if (!(cond))                                                           \
+    {                                                                      \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: "       \
+                << #cond << "\n";                                          \
+      kfly_test::failures()++;                                             \
+    }                                                                      \
+  } while (0)
+
+namespace kfly_test
+{
+/**
+ * @brief   Number of failed checks of the test.
+ */
+inline int &failures()
+{
+  static int count = 0;
+  return count;
+}
+
+/**
+ * @brief   Exit code of the test.
+ */
+inline int result()
+{
+  if (failures() > 0)
+    std::cerr << failures() << " check(s) failed\n";
+
+  return failures() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+}  // namespace kfly_test
@@ -0,0 +1,274 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <stdexcept>
+#include <vector>
+
+#include "check.hpp"
+#include "kfly_comm/frame_tap.hpp"
+#include "kfly_comm/kfly_comm.hpp"
+
+using namespace kfly_comm;
+
+namespace
+{
+std::vector< float > received;
+
+void on_status(const datagrams::SystemStatus &status)
+{
+  received.push_back(status.up_time);
+}
+
+datagrams::SystemStatus make_status(float up_time)
+{
+  datagrams::SystemStatus status{};
+  status.up_time = up_time;
+
+  return status;
+}
+
+/**
+ * @brief   The unencoded frame of a SystemStatus, header, datagram and CRC.
+ */
+std::vector< uint8_t > raw_frame(float up_time)
+{
+  return kfly_packet< datagrams::SystemStatus, true >(
+             command_traits::get_packet_command<
+                 datagrams::SystemStatus >::value,
+             make_status(up_time), false)
+      .payload;
+}
+
+std::vector< uint8_t > encode(const std::vector< uint8_t > &frame)
+{
+  std::vector< uint8_t > out;
+  slip::encode_frame(frame, out);
+
+  return out;
+}
+
+/**
+ * @brief   Two frames split at every position across two parse calls.
+ */
+void test_split()
+{
+  std::vector< uint8_t > stream = codec::generate_packet(make_status(1));
+  const std::size_t first       = stream.size();
+
+  const auto second = codec::generate_packet(make_status(2));
+  stream.insert(stream.end(), second.begin(), second.end());
+
+  for (std::size_t split = 0; split <= stream.size(); split++)
+  {
+    codec kfly;
+    kfly.register_callback(on_status);
+    received.clear();
+
+    const auto a = kfly.parse(stream.data(), split);
+    const auto b = kfly.parse(stream.data() + split, stream.size() - split);
+
+    KFLY_CHECK(a.packets + b.packets == 2);
+    KFLY_CHECK(a.packets == (split >= first ? 1u : 0u) +
+                                (split == stream.size() ? 1u : 0u));
+    KFLY_CHECK(a.crc_errors + b.crc_errors == 0);
+    KFLY_CHECK(a.size_errors + b.size_errors == 0);
+    KFLY_CHECK(b.bytes_consumed == stream.size() - split);
+    KFLY_CHECK(received == std::vector< float >({1, 2}));
+  }
+}
+
+/**
+ * @brief   Several frames in one call are all dispatched, in order.
+ */
+void test_several()
+{
+  std::vector< uint8_t > stream;
+  std::vector< float > expected;
+
+  for (int i = 0; i < 10; i++)
+  {
+    const auto packet = codec::generate_packet(make_status(float(i)));
+    stream.insert(stream.end(), packet.begin(), packet.end());
+    expected.push_back(float(i));
+  }
+
+  codec kfly;
+  kfly.register_callback(on_status);
+  received.clear();
+
+  const auto result = kfly.parse(stream);
+
+  KFLY_CHECK(result.packets == 10);
+  KFLY_CHECK(result.crc_errors == 0);
+  KFLY_CHECK(result.size_errors == 0);
+  KFLY_CHECK(result.bytes_consumed == stream.size());
+  KFLY_CHECK(received == expected);
+}
+
+/**
+ * @brief   CRC and length errors are reported and dropped, the frames
+ *          around them are dispatched.
+ */
+void test_errors()
+{
+  /* A flipped CRC bit. */
+  auto bad_crc = raw_frame(2);
+  bad_crc.back() ^= 0x01;
+
+  /* A size byte one too large, with a CRC matching it. */
+  auto bad_size = raw_frame(3);
+  bad_size.resize(bad_size.size() - 2);
+  bad_size[1]++;
+
+  const uint16_t crc = CRC16_CCITT::generateCRC(bad_size);
+  bad_size.push_back(static_cast< uint8_t >(crc));
+  bad_size.push_back(static_cast< uint8_t >(crc >> 8));
+
+  /* Too short to hold a header and CRC. */
+  const std::vector< uint8_t > runt = {0x01, 0x00, 0x02};
+
+  std::vector< uint8_t > stream;
+
+  for (const auto &frame :
+       {raw_frame(1), bad_crc, bad_size, runt, raw_frame(4)})
+  {
+    const auto encoded = encode(frame);
+    stream.insert(stream.end(), encoded.begin(), encoded.end());
+  }
+
+  codec kfly;
+  kfly.register_callback(on_status);
+  received.clear();
+
+  const auto result = kfly.parse(stream);
+
+  KFLY_CHECK(result.packets == 2);
+  KFLY_CHECK(result.crc_errors == 1);
+  KFLY_CHECK(result.size_errors == 2);
+  KFLY_CHECK(received == std::vector< float >({1, 4}));
+
+  const auto s = kfly.statistics().snapshot();
+  KFLY_CHECK(s.crc_errors == 1);
+  KFLY_CHECK(s.length_errors == 2);
+  KFLY_CHECK(s.rx.total_frames() == 2);
+}
+
+/**
+ * @brief   Records the command byte of every tapped frame.
+ */
+class command_tap : public frame_tap
+{
+public:
+  std::vector< uint8_t > commands;
+
+  void on_frame(const uint8_t *frame, const std::size_t,
+                std::chrono::steady_clock::time_point) override
+  {
+    commands.push_back(frame[0]);
+  }
+};
+
+/**
+ * @brief   Frames with the ack bit set pass the CRC check, the CRC is on
+ *          the command without it, and are tapped and dispatched.
+ */
+void test_ack()
+{
+  std::vector< uint8_t > stream = codec::generate_packet(make_status(6), true);
+
+  const auto ping = codec::generate_command(commands::Ping, true);
+  stream.insert(stream.end(), ping.begin(), ping.end());
+
+  codec kfly;
+  kfly.register_callback(on_status);
+  received.clear();
+
+  command_tap tap;
+  kfly.add_frame_tap(tap);
+
+  const auto result = kfly.parse(stream);
+  kfly.remove_frame_tap(tap);
+
+  const uint8_t status_command = static_cast< uint8_t >(
+      command_traits::get_packet_command< datagrams::SystemStatus >::value);
+
+  KFLY_CHECK(result.packets == 2);
+  KFLY_CHECK(result.crc_errors == 0);
+  KFLY_CHECK(received == std::vector< float >({6}));
+  KFLY_CHECK(tap.commands ==
+             std::vector< uint8_t >(
+                 {static_cast< uint8_t >(status_command | 0x80),
+                  static_cast< uint8_t >(
+                      static_cast< uint8_t >(commands::Ping) | 0x80)}));
+
+  const auto s = kfly.statistics().snapshot();
+  KFLY_CHECK(s.rx.frames[status_command] == 1);
+  KFLY_CHECK(s.rx.frames[static_cast< uint8_t >(commands::Ping)] == 1);
+  KFLY_CHECK(s.unknown_commands == 0);
+}
+
+/**
+ * @brief   The allocation free generators reject a buffer one byte too
+ *          small and match the allocating ones otherwise.
+ */
+void test_generate_into()
+{
+  const auto status   = make_status(5);
+  const auto expected = codec::generate_packet(status);
+
+  constexpr std::size_t capacity =
+      max_encoded_size< datagrams::SystemStatus >::value;
+  std::vector< uint8_t > out(capacity);
+
+  bool thrown = false;
+
+  try
+  {
+    codec::generate_packet_into(status, out.data(), capacity - 1);
+  }
+  catch (const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+
+  KFLY_CHECK(thrown);
+
+  out.resize(codec::generate_packet_into(status, out.data(), capacity));
+  KFLY_CHECK(out == expected);
+
+  constexpr std::size_t command_capacity =
+      max_encoded_size< datagrams::Ack, false >::value;
+  std::vector< uint8_t > command(command_capacity);
+
+  thrown = false;
+
+  try
+  {
+    codec::generate_command_into(commands::Ping, command.data(),
+                                 command_capacity - 1);
+  }
+  catch (const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+
+  KFLY_CHECK(thrown);
+
+  command.resize(codec::generate_command_into(commands::Ping, command.data(),
+                                              command_capacity));
+  KFLY_CHECK(command == codec::generate_command(commands::Ping));
+}
+}
+
+int main()
+{
+  test_split();
+  test_several();
+  test_errors();
+  test_ack();
+  test_generate_into();
+
+  return kfly_test::result();
+}
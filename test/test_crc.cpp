@@ -0,0 +1,125 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <array>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "kfly_comm/crc.hpp"
+
+using namespace CRC16_CCITT;
+
+namespace
+{
+/* The constexpr overload is usable at compile time, "123456789" is the
+ * CRC-CCITT (0xFFFF) check value. */
+constexpr std::array< uint8_t, 9 > check_string = {
+    {'1', '2', '3', '4', '5', '6', '7', '8', '9'}};
+
+static_assert(generateCRC(check_string) == 0x29b1,
+              "The constexpr CRC does not match the check value.");
+static_assert(generateCRC(std::array< uint8_t, 0 >{}, 0x1234) == 0x1234,
+              "The constexpr CRC of nothing is not the seed.");
+static_assert(generateCRC(uint8_t('1')) ==
+                  generateCRC(std::array< uint8_t, 1 >{{'1'}}),
+              "The single byte CRC does not match the array CRC.");
+
+/**
+ * @brief   Compares every engine against the bytewise table over a range of
+ *          the buffer.
+ */
+void check_engines(const std::vector< uint8_t > &buffer, std::size_t offset,
+                   std::size_t size, uint16_t seed)
+{
+  const uint8_t *data     = buffer.data() + offset;
+  const uint16_t expected = generateCRC_bytewise(data, size, seed);
+
+  KFLY_CHECK(generateCRC_slice8(data, size, seed) == expected);
+  KFLY_CHECK(generateCRC(data, size, seed) == expected);
+  KFLY_CHECK(generateCRC(std::vector< uint8_t >(data, data + size), seed) ==
+             expected);
+}
+
+/**
+ * @brief   Random lengths up to 4 KiB from unaligned starts and random
+ *          seeds.
+ */
+void test_random()
+{
+  std::mt19937 rng(4);
+  std::vector< uint8_t > buffer(4096 + 16);
+
+  for (auto &b : buffer)
+    b = static_cast< uint8_t >(rng());
+
+  for (int i = 0; i < 2000; i++)
+  {
+    const std::size_t offset = rng() % 16;
+    const std::size_t size   = rng() % 4097;
+    const uint16_t seed      = static_cast< uint16_t >(rng());
+
+    check_engines(buffer, offset, size, seed);
+  }
+
+  check_engines(buffer, 0, 0, 0xffff);
+  check_engines(buffer, 0, 4096, 0xffff);
+}
+
+/**
+ * @brief   Every length around the carry-less multiply threshold of 128
+ *          bytes and its 64 byte folding steps.
+ */
+void test_threshold()
+{
+  std::mt19937 rng(5);
+  std::vector< uint8_t > buffer(512 + 16);
+
+  for (auto &b : buffer)
+    b = static_cast< uint8_t >(rng());
+
+  for (std::size_t size = 100; size <= 300; size++)
+    for (std::size_t offset = 0; offset < 8; offset++)
+    {
+      check_engines(buffer, offset, size, 0xffff);
+      check_engines(buffer, offset, size, 0);
+      check_engines(buffer, offset, size, static_cast< uint16_t >(rng()));
+    }
+}
+
+/**
+ * @brief   Chained calculations equal one over the whole payload.
+ */
+void test_chained()
+{
+  std::mt19937 rng(6);
+  std::vector< uint8_t > buffer(1024);
+
+  for (auto &b : buffer)
+    b = static_cast< uint8_t >(rng());
+
+  const uint16_t whole = generateCRC(buffer.data(), buffer.size());
+
+  for (std::size_t split = 0; split <= buffer.size(); split += 37)
+  {
+    const uint16_t first = generateCRC(buffer.data(), split);
+    KFLY_CHECK(generateCRC(buffer.data() + split, buffer.size() - split,
+                           first) == whole);
+  }
+}
+}
+
+int main()
+{
+  std::cout << "carry-less multiply engine: "
+            << (has_clmul_engine() ? "yes" : "no") << "\n";
+
+  test_random();
+  test_threshold();
+  test_chained();
+
+  return kfly_test::result();
+}
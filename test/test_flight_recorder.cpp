@@ -0,0 +1,138 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "check.hpp"
+#include "kfly_comm/flight_recorder.hpp"
+
+using namespace kfly_comm;
+
+namespace
+{
+const char *file = "test_flight_recorder.kflyrec";
+
+std::vector< uint8_t > make_frame(std::size_t size, uint8_t seed)
+{
+  std::vector< uint8_t > frame(size);
+
+  for (std::size_t i = 0; i < size; i++)
+    frame[i] = static_cast< uint8_t >(seed + i);
+
+  return frame;
+}
+
+/**
+ * @brief   Records frames, some larger than a buffer, and reads them back.
+ */
+void test_round_trip()
+{
+  std::vector< std::vector< uint8_t > > expected;
+  flight_recorder_stats stats;
+
+  {
+    flight_recorder_options options;
+    options.buffer_size    = 4096;
+    options.buffer_count   = 4;
+    options.index_interval = 8192;
+
+    flight_recorder recorder(file, options);
+
+    for (std::size_t i = 0; i < 200; i++)
+    {
+      auto frame = make_frame(20 + i % 150, static_cast< uint8_t >(i));
+
+      if (recorder.record(recording::direction::rx, 1, frame.data(),
+                          frame.size()))
+        expected.push_back(frame);
+
+      /* Leaves a partial buffer behind to be continued. */
+      if (i % 50 == 0)
+        recorder.flush();
+    }
+
+    /* Larger than a buffer, dropped instead of overrunning the buffers. */
+    auto large = make_frame(60000, 7);
+    KFLY_CHECK(!recorder.record(recording::direction::rx, 1, large.data(),
+                                large.size()));
+
+    /* Exactly one buffer. */
+    auto full = make_frame(4096 - sizeof(recording::record_header), 9);
+    if (recorder.record(recording::direction::tx, 2, full.data(), full.size()))
+      expected.push_back(full);
+
+    stats = recorder.stats();
+    KFLY_CHECK(stats.dropped >= 1);
+    KFLY_CHECK(stats.records == expected.size());
+    KFLY_CHECK(recorder.error() == 0);
+  }
+
+  std::ifstream in(file, std::ios::binary);
+  const std::vector< uint8_t > data((std::istreambuf_iterator< char >(in)),
+                                    std::istreambuf_iterator< char >());
+
+  KFLY_CHECK(data.size() >= sizeof(recording::file_header));
+  if (data.size() < sizeof(recording::file_header))
+    return;
+
+  recording::file_header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  KFLY_CHECK(std::memcmp(header.magic, recording::magic,
+                         sizeof(header.magic)) == 0);
+  KFLY_CHECK(header.version == recording::version);
+  KFLY_CHECK(header.header_size == sizeof(header));
+
+  std::size_t offset = sizeof(header);
+  std::size_t record = 0;
+  uint64_t index_blocks = 0;
+
+  while (offset + sizeof(recording::record_header) <= data.size())
+  {
+    recording::record_header rh;
+    std::memcpy(&rh, data.data() + offset, sizeof(rh));
+    offset += sizeof(rh);
+
+    KFLY_CHECK(offset + rh.length <= data.size());
+    if (offset + rh.length > data.size())
+      return;
+
+    if (rh.direction ==
+        static_cast< uint8_t >(recording::direction::index))
+    {
+      index_blocks++;
+    }
+    else
+    {
+      KFLY_CHECK(record < expected.size());
+      if (record < expected.size())
+        KFLY_CHECK(std::vector< uint8_t >(data.begin() + offset,
+                                          data.begin() + offset + rh.length) ==
+                   expected[record]);
+      record++;
+    }
+
+    offset += rh.length;
+  }
+
+  KFLY_CHECK(offset == data.size());
+  KFLY_CHECK(record == expected.size());
+  /* The destructor indexes the records since the last index block. */
+  KFLY_CHECK(index_blocks >= stats.index_blocks);
+  KFLY_CHECK(index_blocks <= stats.index_blocks + 1);
+
+  std::remove(file);
+}
+}
+
+int main()
+{
+  test_round_trip();
+
+  return kfly_test::result();
+}
@@ -0,0 +1,201 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "kfly_comm/link_manager.hpp"
+
+using namespace kfly_comm;
+
+namespace
+{
+/**
+ * @brief   Waits up to five seconds for a condition.
+ */
+bool eventually(const std::function< bool() > &cond)
+{
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+  while (!cond())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return true;
+}
+
+/**
+ * @brief   Adds a socketpair as a link, returns the peer end.
+ */
+int add_socket(link_manager &manager, link_id &id)
+{
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    return -1;
+
+  id = manager.add_link(fds[0]);
+
+  return fds[1];
+}
+
+void write_all(int fd, const std::vector< uint8_t > &data)
+{
+  for (std::size_t off = 0; off < data.size();)
+  {
+    const ssize_t n = write(fd, data.data() + off, data.size() - off);
+
+    if (n <= 0)
+      return;
+
+    off += static_cast< std::size_t >(n);
+  }
+}
+
+/**
+ * @brief   Datagrams are tagged with their link, messages are written to
+ *          the link.
+ */
+void test_round_trip()
+{
+  link_manager_options options;
+  options.workers = 2;
+
+  link_manager manager(options);
+
+  constexpr std::size_t links = 4;
+  std::atomic< uint64_t > pings[links + 1];
+
+  for (auto &p : pings)
+    p = 0;
+
+  manager.register_callback< datagrams::Ping >(
+      [&](link_id id, const datagrams::Ping &) { pings[id]++; });
+
+  std::vector< int > peers;
+  std::vector< link_id > ids;
+
+  for (std::size_t i = 0; i < links; i++)
+  {
+    link_id id;
+    peers.push_back(add_socket(manager, id));
+    ids.push_back(id);
+  }
+
+  KFLY_CHECK(manager.link_count() == links);
+
+  const auto ping = codec::generate_command(commands::Ping);
+
+  for (std::size_t i = 0; i < links; i++)
+    for (std::size_t n = 0; n <= i; n++)
+      write_all(peers[i], ping);
+
+  KFLY_CHECK(eventually([&] {
+    for (std::size_t i = 0; i < links; i++)
+      if (pings[ids[i]] != i + 1)
+        return false;
+
+    return true;
+  }));
+
+  /* Transmission, read back from the peer. */
+  const auto packet = codec::generate_command(commands::GetSystemStatus);
+  manager.send(ids[1], packet);
+
+  std::vector< uint8_t > received;
+  KFLY_CHECK(eventually([&] {
+    uint8_t buffer[64];
+    const ssize_t n = recv(peers[1], buffer, sizeof(buffer), MSG_DONTWAIT);
+
+    if (n > 0)
+      received.insert(received.end(), buffer, buffer + n);
+
+    return received.size() >= packet.size();
+  }));
+  KFLY_CHECK(received == packet);
+
+  for (int fd : peers)
+    close(fd);
+}
+
+/**
+ * @brief   Callbacks may remove their own link and add new ones without
+ *          deadlocking the worker.
+ */
+void test_callbacks_use_manager()
+{
+  link_manager_options options;
+  options.workers = 1;
+
+  link_manager manager(options);
+
+  std::atomic< link_id > removed(0);
+  std::atomic< int > added_peer(-1);
+  std::atomic< uint64_t > after_removal(0);
+
+  manager.register_callback< datagrams::Ping >(
+      [&](link_id id, const datagrams::Ping &) {
+        if (removed == id)
+        {
+          after_removal++;
+          return;
+        }
+
+        if (removed == 0)
+        {
+          link_id added;
+          added_peer = add_socket(manager, added);
+
+          manager.remove_link(id);
+          removed = id;
+        }
+      });
+
+  link_id id;
+  const int peer = add_socket(manager, id);
+
+  /* Two frames in one read, the second is parsed after the removal. */
+  auto pings = codec::generate_command(commands::Ping);
+  const auto ping = pings;
+  pings.insert(pings.end(), ping.begin(), ping.end());
+  write_all(peer, pings);
+
+  KFLY_CHECK(eventually([&] { return removed == id; }));
+  KFLY_CHECK(eventually([&] { return manager.link_count() == 1; }));
+
+  /* The removed link is closed by its worker. */
+  KFLY_CHECK(eventually([&] {
+    uint8_t byte;
+    return recv(peer, &byte, 1, MSG_DONTWAIT) == 0;
+  }));
+
+  KFLY_CHECK(after_removal <= 1);
+
+  close(peer);
+
+  if (added_peer >= 0)
+    close(added_peer);
+}
+}
+
+int main()
+{
+  test_round_trip();
+  test_callbacks_use_manager();
+
+  return kfly_test::result();
+}
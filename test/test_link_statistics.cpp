@@ -0,0 +1,166 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "kfly_comm/kfly_comm.hpp"
+
+#ifdef KFLY_COMM_SERIAL_LINK
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "kfly_comm/serial_link.hpp"
+#endif
+
+using namespace kfly_comm;
+
+namespace
+{
+/**
+ * @brief   A frame with a correct CRC and a payload of the wrong size for
+ *          its command.
+ */
+std::vector< uint8_t > wrong_payload_frame()
+{
+  const uint8_t payload[3] = {1, 2, 3};
+  uint8_t frame[2 + sizeof(payload) + 2];
+
+  frame[0] = static_cast< uint8_t >(commands::GetSystemStatus);
+  frame[1] = sizeof(payload);
+  std::memcpy(frame + 2, payload, sizeof(payload));
+
+  const uint16_t crc = CRC16_CCITT::generateCRC(frame, sizeof(frame) - 2);
+  std::memcpy(frame + sizeof(frame) - 2, &crc, sizeof(crc));
+
+  std::vector< uint8_t > encoded(slip::max_encoded_size(sizeof(frame)));
+  encoded.resize(slip::encode_frame(frame, sizeof(frame), encoded.data()));
+
+  return encoded;
+}
+
+/**
+ * @brief   A frame rejected for its payload size is an error, not a
+ *          received frame.
+ */
+void test_rejected_not_received()
+{
+  codec kfly;
+
+  const auto result = kfly.parse(wrong_payload_frame());
+  KFLY_CHECK(result.packets == 0);
+  KFLY_CHECK(result.size_errors == 1);
+
+  kfly.parse(codec::generate_command(commands::Ping));
+
+  const auto s = kfly.statistics().snapshot();
+  KFLY_CHECK(s.payload_errors == 1);
+  KFLY_CHECK(s.rx.total_frames() == 1);
+  KFLY_CHECK(s.rx.frames[static_cast< uint8_t >(commands::Ping)] == 1);
+}
+
+/**
+ * @brief   Rates over a reset are zero instead of wrapping around.
+ */
+void test_rates_over_reset()
+{
+  codec kfly;
+  const auto ping = codec::generate_command(commands::Ping);
+
+  for (int i = 0; i < 10; i++)
+    kfly.parse(ping);
+
+  kfly.parse(wrong_payload_frame());
+
+  const auto before = kfly.statistics().snapshot();
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+  kfly.statistics().reset();
+  kfly.parse(ping);
+
+  const auto after = kfly.statistics().snapshot();
+  const auto r     = rates(before, after);
+
+  KFLY_CHECK(r.seconds > 0);
+  KFLY_CHECK(r.rx_frames == 0);
+  KFLY_CHECK(r.rx_raw_bytes == 0);
+  KFLY_CHECK(r.errors == 0);
+  KFLY_CHECK(r.error_ratio == 0);
+}
+
+#ifdef KFLY_COMM_SERIAL_LINK
+/**
+ * @brief   serial_link counts frames once written, not when queued.
+ */
+void test_tx_counted_on_write()
+{
+  int fds[2];
+  KFLY_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  codec kfly;
+  serial_link link(kfly, fds[0]);
+
+  link.send(codec::generate_command(commands::Ping));
+  link.send(codec::generate_command(commands::GetSystemStatus));
+
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+  while (kfly.statistics().snapshot().tx.total_frames() < 2 &&
+         std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  const auto s = kfly.statistics().snapshot();
+  KFLY_CHECK(s.tx.total_frames() == 2);
+  KFLY_CHECK(s.tx.frames[static_cast< uint8_t >(commands::Ping)] == 1);
+
+  close(fds[1]);
+}
+
+/**
+ * @brief   serial_link closes the descriptor it was given if the constructor
+ *          throws.
+ */
+void test_invalid_buffer()
+{
+  int fds[2];
+  KFLY_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  codec kfly;
+  bool thrown = false;
+
+  try
+  {
+    serial_link link(kfly, fds[0], 0);
+  }
+  catch (const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+
+  KFLY_CHECK(thrown);
+  KFLY_CHECK(fcntl(fds[0], F_GETFD) < 0 && errno == EBADF);
+
+  close(fds[1]);
+}
+#endif
+}
+
+int main()
+{
+  test_rejected_not_received();
+  test_rates_over_reset();
+
+#ifdef KFLY_COMM_SERIAL_LINK
+  test_tx_counted_on_write();
+  test_invalid_buffer();
+#endif
+
+  return kfly_test::result();
+}
@@ -0,0 +1,156 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "check.hpp"
+#include "kfly_comm/flight_recorder.hpp"
+#include "kfly_comm/log_replay.hpp"
+
+using namespace kfly_comm;
+
+namespace
+{
+const char *file = "test_log_replay.kflyrec";
+
+constexpr std::size_t num_frames = 1000;
+
+std::vector< float > replayed;
+
+void on_status(const datagrams::SystemStatus &status)
+{
+  replayed.push_back(status.up_time);
+}
+
+/**
+ * @brief   Records SystemStatus frames with increasing up times.
+ */
+void write_recording()
+{
+  flight_recorder_options options;
+  options.buffer_size    = 4096;
+  options.buffer_count   = 64;
+  options.index_interval = 16384;
+
+  flight_recorder recorder(file, options);
+
+  for (std::size_t i = 0; i < num_frames; i++)
+  {
+    datagrams::SystemStatus status{};
+    status.up_time = static_cast< float >(i);
+
+    /* The frame as KFly sends it, without SLIP. */
+    uint8_t frame[sizeof(status) + 4];
+    frame[0] = static_cast< uint8_t >(commands::GetSystemStatus);
+    frame[1] = sizeof(status);
+    std::memcpy(frame + 2, &status, sizeof(status));
+
+    const uint16_t crc = CRC16_CCITT::generateCRC(frame, sizeof(frame) - 2);
+    std::memcpy(frame + sizeof(frame) - 2, &crc, sizeof(crc));
+
+    recorder.record(recording::direction::rx, 0, frame, sizeof(frame));
+
+    if (i % 100 == 0)
+      recorder.flush();
+  }
+
+  KFLY_CHECK(recorder.stats().dropped == 0);
+}
+
+/**
+ * @brief   Replays the recording in order with several workers and small
+ *          chunks.
+ */
+void test_ordered()
+{
+  write_recording();
+
+  log_replay_options options;
+  options.threads    = 4;
+  options.chunk_size = 1024;
+
+  log_replay replay(file, options);
+  replay.callbacks().register_callback(on_status);
+
+  KFLY_CHECK(replay.format() == capture_format::recording);
+
+  replayed.clear();
+  const auto stats = replay.run();
+
+  KFLY_CHECK(stats.frames == num_frames);
+  KFLY_CHECK(stats.datagrams == num_frames);
+  KFLY_CHECK(stats.crc_errors == 0);
+  KFLY_CHECK(stats.size_errors == 0);
+  KFLY_CHECK(replayed.size() == num_frames);
+
+  for (std::size_t i = 0; i < replayed.size(); i++)
+    KFLY_CHECK(replayed[i] == static_cast< float >(i));
+
+  std::remove(file);
+}
+
+/**
+ * @brief   Writes a file header and expects the replay to reject it.
+ */
+void expect_rejected(const recording::file_header &header, std::size_t size)
+{
+  {
+    std::ofstream out(file, std::ios::binary);
+    out.write(reinterpret_cast< const char * >(&header), size);
+  }
+
+  bool thrown = false;
+
+  try
+  {
+    log_replay replay(file);
+  }
+  catch (const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+
+  KFLY_CHECK(thrown);
+
+  std::remove(file);
+}
+
+/**
+ * @brief   Corrupt and truncated headers are errors, not parsed from the
+ *          wrong offset.
+ */
+void test_bad_header()
+{
+  recording::file_header header = {};
+  std::memcpy(header.magic, recording::magic, sizeof(header.magic));
+  header.version     = recording::version;
+  header.header_size = sizeof(header);
+
+  auto bad_version    = header;
+  bad_version.version = recording::version + 1;
+  expect_rejected(bad_version, sizeof(header));
+
+  auto small_header        = header;
+  small_header.header_size = 8;
+  expect_rejected(small_header, sizeof(header));
+
+  auto large_header        = header;
+  large_header.header_size = 1 << 20;
+  expect_rejected(large_header, sizeof(header));
+
+  expect_rejected(header, sizeof(header) / 2);
+}
+}
+
+int main()
+{
+  test_ordered();
+  test_bad_header();
+
+  return kfly_test::result();
+}
@@ -0,0 +1,238 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "kfly_comm/request_engine.hpp"
+
+using namespace kfly_comm;
+
+namespace
+{
+constexpr unsigned baudrate       = 115200;
+constexpr std::size_t num_uploads = 16;
+
+/**
+ * @brief   A serial link at 115200 baud to a KFly that ACKs every frame
+ *          once it has left the wire.
+ */
+class slow_link
+{
+  codec &_kfly;
+
+  std::mutex _lock;
+  std::condition_variable _cv;
+  std::deque< std::vector< uint8_t > > _queue;
+  std::vector< std::vector< uint8_t > > _delivered;
+  std::size_t _acks;
+  bool _running;
+  std::thread _thread;
+
+  void run()
+  {
+    std::unique_lock< std::mutex > lock(_lock);
+
+    while (true)
+    {
+      _cv.wait(lock, [&] { return !_running || !_queue.empty(); });
+
+      if (_queue.empty())
+        return;
+
+      auto frame = std::move(_queue.front());
+      _queue.pop_front();
+
+      lock.unlock();
+
+      std::this_thread::sleep_for(std::chrono::nanoseconds(
+          frame.size() * 10 * 1000000000ull / baudrate));
+
+      lock.lock();
+      _delivered.push_back(std::move(frame));
+      _acks++;
+      lock.unlock();
+
+      _kfly.parse(codec::generate_command(commands::ACK));
+
+      lock.lock();
+      _cv.notify_all();
+    }
+  }
+
+public:
+  explicit slow_link(codec &kfly)
+      : _kfly(kfly), _acks(0), _running(true), _thread(&slow_link::run, this)
+  {
+  }
+
+  ~slow_link()
+  {
+    {
+      std::lock_guard< std::mutex > lock(_lock);
+      _running = false;
+      _cv.notify_all();
+    }
+
+    _thread.join();
+  }
+
+  void send(const uint8_t *data, std::size_t size)
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+    _queue.emplace_back(data, data + size);
+    _cv.notify_all();
+  }
+
+  bool delivered(const std::vector< uint8_t > &frame)
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+    return std::find(_delivered.begin(), _delivered.end(), frame) !=
+           _delivered.end();
+  }
+
+  std::size_t acks()
+  {
+    std::lock_guard< std::mutex > lock(_lock);
+    return _acks;
+  }
+
+  void drain()
+  {
+    std::unique_lock< std::mutex > lock(_lock);
+    _cv.wait(lock, [&] { return _queue.empty(); });
+  }
+};
+
+datagrams::ChannelMix upload(std::size_t i)
+{
+  datagrams::ChannelMix mix{};
+
+  for (auto &w : mix.weights)
+    w[0] = static_cast< float >(i);
+
+  return mix;
+}
+
+/**
+ * @brief   Uploads ChannelMix over the slow link, every request must only
+ *          complete once its frame was delivered.
+ */
+request_stats run_uploads(const request_options &options,
+                          std::size_t &acks, std::size_t &wire_bytes,
+                          std::chrono::nanoseconds &elapsed)
+{
+  codec kfly;
+  slow_link link(kfly);
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::size_t done = 0;
+  wire_bytes       = 0;
+
+  request_stats stats;
+
+  {
+    request_engine engine(kfly,
+                          [&](const uint8_t *d, std::size_t n) {
+                            link.send(d, n);
+                          },
+                          options);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < num_uploads; i++)
+    {
+      const auto frame = codec::generate_packet(upload(i), true);
+      wire_bytes += frame.size();
+
+      engine.set(upload(i), [&, frame](std::error_code ec) {
+        KFLY_CHECK(!ec);
+        KFLY_CHECK(link.delivered(frame));
+
+        std::lock_guard< std::mutex > l(lock);
+        done++;
+        cv.notify_all();
+      });
+    }
+
+    {
+      std::unique_lock< std::mutex > l(lock);
+      cv.wait(l, [&] { return done == num_uploads; });
+    }
+
+    elapsed = std::chrono::steady_clock::now() - start;
+
+    /* Let the answers to retransmissions arrive. */
+    link.drain();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    stats = engine.stats();
+  }
+
+  acks = link.acks();
+
+  return stats;
+}
+
+/**
+ * @brief   With the baudrate known, no frame times out in the queue.
+ */
+void test_paced()
+{
+  request_options options;
+  options.window   = 8;
+  options.timeout  = std::chrono::milliseconds(100);
+  options.baudrate = baudrate;
+
+  std::size_t acks, wire_bytes;
+  std::chrono::nanoseconds elapsed;
+  const auto stats = run_uploads(options, acks, wire_bytes, elapsed);
+
+  KFLY_CHECK(stats.sent == num_uploads);
+  KFLY_CHECK(stats.retransmits == 0);
+  KFLY_CHECK(stats.completed == num_uploads);
+  KFLY_CHECK(stats.timeouts == 0);
+  KFLY_CHECK(stats.duplicates == 0);
+  KFLY_CHECK(acks == num_uploads);
+  KFLY_CHECK(elapsed >= std::chrono::nanoseconds(wire_bytes * 10 *
+                                                 1000000000ull / baudrate));
+}
+
+/**
+ * @brief   Without the baudrate frames are retransmitted from the queue,
+ *          the extra ACKs may not complete requests that were not sent.
+ */
+void test_unpaced()
+{
+  request_options options;
+  options.window  = 8;
+  options.timeout = std::chrono::milliseconds(100);
+
+  std::size_t acks, wire_bytes;
+  std::chrono::nanoseconds elapsed;
+  const auto stats = run_uploads(options, acks, wire_bytes, elapsed);
+
+  KFLY_CHECK(stats.sent == num_uploads);
+  KFLY_CHECK(stats.completed == num_uploads);
+  KFLY_CHECK(stats.timeouts == 0);
+  KFLY_CHECK(acks == num_uploads + stats.retransmits);
+  KFLY_CHECK(stats.completed + stats.duplicates <= acks);
+}
+}
+
+int main()
+{
+  test_paced();
+  test_unpaced();
+
+  return kfly_test::result();
+}
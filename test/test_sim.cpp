@@ -0,0 +1,175 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "kfly_sim.hpp"
+
+using namespace kfly_comm;
+
+namespace
+{
+std::size_t received = 0;
+float last_up_time   = 0;
+
+void on_status(const datagrams::SystemStatus &status)
+{
+  received++;
+  last_up_time = status.up_time;
+}
+
+void write_all(int fd, const std::vector< uint8_t > &data)
+{
+  for (std::size_t off = 0; off < data.size();)
+  {
+    const ssize_t n = write(fd, data.data() + off, data.size() - off);
+
+    if (n <= 0)
+      return;
+
+    off += static_cast< std::size_t >(n);
+  }
+}
+
+/**
+ * @brief   Parses everything the simulator sends for a while.
+ */
+void receive_for(int fd, codec &kfly, std::chrono::milliseconds duration)
+{
+  const auto deadline = std::chrono::steady_clock::now() + duration;
+
+  while (std::chrono::steady_clock::now() < deadline)
+  {
+    uint8_t buffer[256];
+    const ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+    if (n > 0)
+      kfly.parse(buffer, static_cast< std::size_t >(n));
+    else
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+/**
+ * @brief   Subscribes to SystemStatus and receives the streamed state.
+ */
+void test_subscription()
+{
+  int fds[2];
+  KFLY_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  codec kfly;
+  kfly.register_callback(on_status);
+  received = 0;
+
+  {
+    kfly_sim::endpoint sim(fds[0]);
+
+    datagrams::SystemStatus status{};
+    status.up_time = 42;
+    sim.set_state(status);
+
+    write_all(fds[1], codec::generate_subscribe(commands::GetSystemStatus, 2));
+    receive_for(fds[1], kfly, std::chrono::milliseconds(100));
+
+    const auto s = sim.stats();
+    KFLY_CHECK(s.rx_frames == 1);
+    KFLY_CHECK(s.dropped_samples == 0);
+    KFLY_CHECK(received >= 10);
+    KFLY_CHECK(received <= s.tx_frames);
+    KFLY_CHECK(last_up_time == 42);
+  }
+
+  KFLY_CHECK(kfly.statistics().snapshot().crc_errors == 0);
+
+  close(fds[1]);
+}
+
+/**
+ * @brief   A stream faster than the throttled link is dropped at the
+ *          backlog instead of queueing without bound.
+ */
+void test_backlog()
+{
+  int fds[2];
+  KFLY_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  codec kfly;
+  kfly.register_callback(on_status);
+  received = 0;
+
+  kfly_sim::options options;
+  options.baudrate   = 9600;
+  options.tx_backlog = 2;
+
+  const std::size_t frame_size =
+      codec::generate_packet(datagrams::SystemStatus{}).size();
+
+  {
+    kfly_sim::endpoint sim(fds[0], options);
+
+    write_all(fds[1], codec::generate_subscribe(commands::GetSystemStatus, 1));
+    receive_for(fds[1], kfly, std::chrono::milliseconds(300));
+
+    const auto s = sim.stats();
+    KFLY_CHECK(s.dropped_samples > 0);
+
+    /* The link limits the frames sent, each counted once. */
+    const std::size_t wire_frames = 9600 / 10 * 3 / 10 / frame_size;
+    KFLY_CHECK(s.tx_frames <= wire_frames + options.tx_backlog + 2);
+    KFLY_CHECK(received > 0);
+    KFLY_CHECK(received <= s.tx_frames);
+  }
+
+  close(fds[1]);
+}
+
+/**
+ * @brief   The endpoint closes its file descriptor if the constructor
+ *          throws.
+ */
+void test_invalid_options()
+{
+  int fds[2];
+  KFLY_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  kfly_sim::options options;
+  options.bit_error_rate = 2;
+
+  bool thrown = false;
+
+  try
+  {
+    kfly_sim::endpoint sim(fds[0], options);
+  }
+  catch (const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+
+  KFLY_CHECK(thrown);
+  KFLY_CHECK(fcntl(fds[0], F_GETFD) < 0 && errno == EBADF);
+
+  close(fds[1]);
+}
+}
+
+int main()
+{
+  test_subscription();
+  test_backlog();
+  test_invalid_options();
+
+  return kfly_test::result();
+}
@@ -0,0 +1,244 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "kfly_comm/kfly_comm.hpp"
+
+using namespace kfly_comm;
+
+namespace
+{
+const slip::engine engines[] = {slip::engine::scalar, slip::engine::sse2,
+                                slip::engine::avx2};
+
+const char *engine_name(slip::engine e)
+{
+  switch (e)
+  {
+    case slip::engine::scalar:
+      return "scalar";
+
+    case slip::engine::sse2:
+      return "sse2";
+
+    case slip::engine::avx2:
+      return "avx2";
+  }
+
+  return "unknown";
+}
+
+/**
+ * @brief   The byte at a time encoding the kernels must reproduce.
+ */
+std::vector< uint8_t > reference_encode(const std::vector< uint8_t > &data)
+{
+  std::vector< uint8_t > out(2 * data.size());
+  std::size_t n = 0;
+
+  for (auto b : data)
+    n += slip::encode_byte(b, out.data() + n);
+
+  out.resize(n);
+  return out;
+}
+
+std::vector< uint8_t > encode(const std::vector< uint8_t > &data)
+{
+  std::vector< uint8_t > out(2 * data.size());
+  out.resize(slip::encode(data.data(), data.size(), out.data()));
+
+  return out;
+}
+
+/**
+ * @brief   The data sets, random, only specials and single specials at
+ *          every position of plain runs across the 16 and 32 byte kernel
+ *          widths.
+ */
+std::vector< std::vector< uint8_t > > make_inputs()
+{
+  std::vector< std::vector< uint8_t > > inputs;
+  std::mt19937 rng(16);
+
+  for (std::size_t size = 0; size <= 300; size += 7)
+  {
+    std::vector< uint8_t > data(size);
+
+    for (auto &b : data)
+      b = static_cast< uint8_t >(rng());
+
+    inputs.push_back(data);
+  }
+
+  for (std::size_t size : {1, 15, 16, 17, 31, 32, 33, 100})
+  {
+    inputs.emplace_back(size, slip::END);
+    inputs.emplace_back(size, slip::ESC);
+
+    std::vector< uint8_t > mixed(size);
+
+    for (std::size_t i = 0; i < size; i++)
+      mixed[i] = (i % 2) ? slip::END : slip::ESC;
+
+    inputs.push_back(mixed);
+  }
+
+  for (std::size_t size = 1; size <= 70; size++)
+  {
+    for (std::size_t pos = 0; pos < size; pos++)
+    {
+      std::vector< uint8_t > data(size, 0x42);
+      data[pos] = (pos % 2) ? slip::END : slip::ESC;
+      inputs.push_back(data);
+    }
+  }
+
+  return inputs;
+}
+
+/**
+ * @brief   Every engine encodes exactly as the byte at a time encoder, also
+ *          from unaligned starts.
+ */
+void test_encode()
+{
+  for (const auto &data : make_inputs())
+  {
+    KFLY_CHECK(encode(data) == reference_encode(data));
+
+    /* The same bytes from unaligned starts within a 32 byte block. */
+    for (std::size_t offset = 1; offset < 32 && offset <= data.size();
+         offset += 5)
+    {
+      const std::vector< uint8_t > tail(data.begin() + offset, data.end());
+      KFLY_CHECK(encode(tail) == reference_encode(tail));
+    }
+  }
+}
+
+/**
+ * @brief   Encoded frames decode to the original, with the stream split
+ *          at every position across two parse calls.
+ */
+void test_round_trip()
+{
+  std::mt19937 rng(17);
+
+  std::vector< std::vector< uint8_t > > frames;
+  std::vector< uint8_t > stream;
+
+  for (std::size_t size : {1, 5, 16, 33, 64, 100})
+  {
+    std::vector< uint8_t > frame(size);
+
+    for (auto &b : frame)
+    {
+      /* A quarter specials, to exercise the escapes. */
+      const uint32_t r = rng();
+      b = (r % 4 == 0) ? ((r & 4) ? slip::END : slip::ESC)
+                       : static_cast< uint8_t >(r >> 8);
+    }
+
+    std::vector< uint8_t > encoded;
+    slip::encode_frame(frame, encoded);
+    stream.insert(stream.end(), encoded.begin(), encoded.end());
+    frames.push_back(frame);
+  }
+
+  for (std::size_t split = 0; split <= stream.size(); split++)
+  {
+    slip::decoder< 128 > decoder;
+    std::vector< std::vector< uint8_t > > decoded;
+    std::size_t oversized = 0;
+
+    const auto on_frame = [&](const uint8_t *f, std::size_t n, std::size_t) {
+      decoded.emplace_back(f, f + n);
+    };
+    const auto on_oversize = [&](std::size_t) { oversized++; };
+
+    decoder.parse(stream.data(), split, on_frame, on_oversize);
+    decoder.parse(stream.data() + split, stream.size() - split, on_frame,
+                  on_oversize);
+
+    KFLY_CHECK(decoded == frames);
+    KFLY_CHECK(oversized == 0);
+    KFLY_CHECK(decoder.framing_errors() == 0);
+  }
+}
+
+/**
+ * @brief   A frame longer than the buffer is dropped and reported, the
+ *          next frame decodes.
+ */
+void test_oversize()
+{
+  std::vector< uint8_t > stream;
+  std::vector< uint8_t > encoded;
+
+  slip::encode_frame(std::vector< uint8_t >(100, 0x11), encoded);
+  stream.insert(stream.end(), encoded.begin(), encoded.end());
+
+  const std::vector< uint8_t > small(10, 0x22);
+  slip::encode_frame(small, encoded);
+  stream.insert(stream.end(), encoded.begin(), encoded.end());
+
+  slip::decoder< 64 > decoder;
+  std::vector< std::vector< uint8_t > > decoded;
+  std::size_t oversized = 0;
+
+  decoder.parse(stream.data(), stream.size(),
+                [&](const uint8_t *f, std::size_t n, std::size_t) {
+                  decoded.emplace_back(f, f + n);
+                },
+                [&](std::size_t) { oversized++; });
+
+  KFLY_CHECK(oversized == 1);
+  KFLY_CHECK(decoded.size() == 1 && decoded[0] == small);
+
+  /* The codec counts it as a size error. */
+  codec kfly;
+
+  std::vector< uint8_t > large;
+  slip::encode_frame(std::vector< uint8_t >(max_frame_size + 10, 0x11),
+                     large);
+  const auto ping = codec::generate_command(commands::Ping);
+  large.insert(large.end(), ping.begin(), ping.end());
+
+  const auto result = kfly.parse(large);
+
+  KFLY_CHECK(result.size_errors == 1);
+  KFLY_CHECK(result.packets == 1);
+  KFLY_CHECK(kfly.statistics().snapshot().oversized_frames == 1);
+}
+}
+
+int main()
+{
+  const slip::engine initial = slip::active_engine();
+
+  for (auto e : engines)
+  {
+    if (!slip::select_engine(e))
+    {
+      std::cout << engine_name(e) << ": not supported, skipped\n";
+      continue;
+    }
+
+    std::cout << engine_name(e) << "\n";
+
+    test_encode();
+    test_round_trip();
+    test_oversize();
+  }
+
+  slip::select_engine(initial);
+
+  return kfly_test::result();
+}
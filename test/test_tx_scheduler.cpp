@@ -0,0 +1,217 @@
+//          Copyright Emil Fresk 2016 - 2017
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "kfly_comm/tx_scheduler.hpp"
+
+using namespace kfly_comm;
+
+namespace
+{
+/**
+ * @brief   A frame read back from the link.
+ */
+struct sent_frame
+{
+  commands command;
+
+  /** @brief First payload float, the sequence of a ChannelMix. */
+  float sequence;
+};
+
+/**
+ * @brief   Reads and SLIP decodes frames until count arrived or five
+ *          seconds passed.
+ */
+std::vector< sent_frame > receive(int fd, std::size_t count)
+{
+  std::vector< sent_frame > frames;
+  slip::decoder< max_frame_size > decoder;
+
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+  while (frames.size() < count && std::chrono::steady_clock::now() < deadline)
+  {
+    uint8_t buffer[256];
+    const ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+    if (n <= 0)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    decoder.parse(buffer, static_cast< std::size_t >(n),
+                  [&](const uint8_t *frame, std::size_t size, std::size_t) {
+                    sent_frame f;
+                    f.command  = static_cast< commands >(frame[0] & 0x7f);
+                    f.sequence = 0;
+
+                    if (size >= 2 + sizeof(float))
+                      std::memcpy(&f.sequence, frame + 2, sizeof(float));
+
+                    frames.push_back(f);
+                  },
+                  [](std::size_t) {});
+  }
+
+  return frames;
+}
+
+std::size_t find(const std::vector< sent_frame > &frames, commands command)
+{
+  return std::find_if(frames.begin(), frames.end(),
+                      [&](const sent_frame &f) {
+                        return f.command == command;
+                      }) -
+         frames.begin();
+}
+
+/**
+ * @brief   A control frame sent during a configuration upload passes the
+ *          queued uploads and requests, each class stays in order.
+ */
+void test_priority_order()
+{
+  int fds[2];
+  KFLY_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  constexpr std::size_t uploads = 20;
+  constexpr std::size_t pings   = 3;
+
+  codec kfly;
+
+  /* One frame per gather, about 15 ms each. */
+  tx_scheduler_options options;
+  options.baudrate   = 115200;
+  options.window     = std::chrono::microseconds(0);
+  options.statistics = &kfly.statistics();
+
+  std::vector< sent_frame > frames;
+
+  {
+    tx_scheduler tx(fds[1], options);
+
+    for (std::size_t i = 0; i < uploads; i++)
+    {
+      datagrams::ChannelMix mix{};
+      mix.weights[0][0] = static_cast< float >(i);
+      tx.send(mix);
+    }
+
+    for (std::size_t i = 0; i < pings; i++)
+      tx.send_command(commands::Ping);
+
+    tx.send(datagrams::ComputerControlReference{});
+
+    frames = receive(fds[0], uploads + pings + 1);
+
+    /* The counters follow the write of the last frame. */
+    for (int i = 0; i < 1000 && tx.statistics().classes[2].frames < uploads;
+         i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    const auto stats = tx.statistics();
+    KFLY_CHECK(stats.classes[0].frames == 1);
+    KFLY_CHECK(stats.classes[1].frames == pings);
+    KFLY_CHECK(stats.classes[2].frames == uploads);
+  }
+
+  KFLY_CHECK(frames.size() == uploads + pings + 1);
+
+  const std::size_t control = find(frames, commands::ComputerControlReference);
+  const std::size_t ping    = find(frames, commands::Ping);
+
+  /* Behind at most the uploads already gathered. */
+  KFLY_CHECK(control <= 2);
+  KFLY_CHECK(control < ping);
+  KFLY_CHECK(ping + pings < frames.size());
+
+  float next = 0;
+
+  for (const auto &f : frames)
+  {
+    if (f.command != commands::SetChannelMix)
+      continue;
+
+    KFLY_CHECK(f.sequence == next);
+    next += 1;
+  }
+
+  KFLY_CHECK(next == uploads);
+
+  /* The written frames are in the codec's counters. */
+  const auto s = kfly.statistics().snapshot();
+  KFLY_CHECK(s.tx.frames[static_cast< uint8_t >(commands::SetChannelMix)] ==
+             uploads);
+  KFLY_CHECK(s.tx.frames[static_cast< uint8_t >(commands::Ping)] == pings);
+  KFLY_CHECK(s.tx.total_frames() == uploads + pings + 1);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+/**
+ * @brief   Producers outrunning a small pool still deliver every frame,
+ *          the nodes are recycled or allocated.
+ */
+void test_pool()
+{
+  int fds[2];
+  KFLY_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  constexpr std::size_t producers    = 2;
+  constexpr std::size_t per_producer = 500;
+
+  codec kfly;
+
+  tx_scheduler_options options;
+  options.pool_size  = 4;
+  options.statistics = &kfly.statistics();
+
+  std::vector< sent_frame > frames;
+
+  {
+    tx_scheduler tx(fds[1], options);
+    std::vector< std::thread > threads;
+
+    for (std::size_t p = 0; p < producers; p++)
+      threads.emplace_back([&]() {
+        for (std::size_t i = 0; i < per_producer; i++)
+          tx.send_command(commands::Ping);
+      });
+
+    frames = receive(fds[0], producers * per_producer);
+
+    for (auto &t : threads)
+      t.join();
+  }
+
+  KFLY_CHECK(frames.size() == producers * per_producer);
+  KFLY_CHECK(kfly.statistics().snapshot().tx.total_frames() ==
+             producers * per_producer);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+}
+
+int main()
+{
+  test_priority_order();
+  test_pool();
+
+  return kfly_test::result();
+}